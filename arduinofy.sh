@@ -11,6 +11,7 @@ echo "destination: $DEST"
 
 mkdir -p "${DEST}"
 
+$COPY "${PWD}"/bytecode.c "${DEST}/"
 $COPY "${PWD}"/clibrary.c "${DEST}/"
 $COPY "${PWD}"/debug.c "${DEST}/"
 $COPY "${PWD}"/expression.c "${DEST}/"
@@ -22,6 +23,7 @@ $COPY "${PWD}"/parse.c "${DEST}/"
 $COPY "${PWD}"/picoc.h "${DEST}/"
 $COPY "${PWD}"/platform.c "${DEST}/"
 $COPY "${PWD}"/platform.h "${DEST}/"
+$COPY "${PWD}"/profile.c "${DEST}/"
 $COPY "${PWD}"/table.c "${DEST}/"
 $COPY "${PWD}"/type.c "${DEST}/"
 $COPY "${PWD}"/variable.c "${DEST}/"
@@ -0,0 +1,1320 @@
+/* picoc's bytecode compiler - simple functions are compiled the first time
+ * they're called into a compact stack-based code which runs without
+ * re-parsing the function's tokens on every call. anything the compiler
+ * doesn't understand is left to the usual parse-as-you-go interpreter */
+
+#include "interpreter.h"
+
+#ifndef NO_BYTECODE
+
+#define BYTECODE_LOCALS_MAX 64              /* most parameters and local variables a compiled function can have */
+#define BYTECODE_INITIAL_SIZE 64            /* the first code buffer allocated when compiling, in words */
+#define BYTECODE_NO_CHAIN -1                /* the end of a chain of jumps waiting to be patched */
+#define BYTECODE_EXPRESSION_DEPTH 16        /* the deepest evaluation stack a compiled loop expression can have */
+
+#define BYTECODE_GLOBAL(op) (((struct Value *)(op)[1].Ptr)->Val->Integer)    /* the global int an operation refers to */
+
+/* bytecode operations. the operands follow each operation in the code */
+enum BytecodeOp
+{
+    OpStatement,                /* line, column: the start of a statement */
+    OpConst,                    /* value: push a constant */
+    OpLocal,                    /* slot: push a local variable */
+    OpGlobal,                   /* value: push a global int */
+    OpSetLocal,                 /* slot: copy the top of the stack to a local variable */
+    OpSetGlobal,                /* value: copy the top of the stack to a global int */
+    OpStoreLocal,               /* slot: pop the top of the stack into a local variable */
+    OpStoreGlobal,              /* value: pop the top of the stack into a global int */
+    OpPreAddLocal,              /* slot, amount: ++x or --x on a local variable */
+    OpPostAddLocal,             /* slot, amount: x++ or x-- on a local variable */
+    OpAddLocal,                 /* slot, amount: as above when the result isn't used */
+    OpPreAddGlobal,             /* value, amount: ++x or --x on a global int */
+    OpPostAddGlobal,            /* value, amount: x++ or x-- on a global int */
+    OpAddGlobal,                /* value, amount: as above when the result isn't used */
+    OpPop,                      /* discard the top of the stack */
+    OpNegate, OpNot, OpComplement,
+    OpAdd, OpSubtract, OpMultiply, OpDivide, OpModulus, OpShiftLeft, OpShiftRight,
+    OpArithmeticAnd, OpArithmeticOr, OpArithmeticExor,
+    OpEqual, OpNotEqual, OpLessThan, OpGreaterThan, OpLessEqual, OpGreaterEqual,
+    OpTruth,                    /* turn the top of the stack into 0 or 1 */
+    OpJump,                     /* offset: jump relative to this operation */
+    OpJumpIfFalse,              /* offset: pop and jump if it's zero */
+    OpJumpIfTrue,               /* offset: pop and jump if it's non-zero */
+    OpJumpIfFalseElsePop,       /* offset: jump leaving the value if it's zero, otherwise pop it. used by && */
+    OpJumpIfTrueElsePop,        /* offset: jump leaving the value if it's non-zero, otherwise pop it. used by || */
+    OpCall,                     /* function, name, number of args, number of args on the stack, then a kind and string for each arg */
+    OpReturn,                   /* return the top of the stack */
+    OpReturnVoid,               /* return from a void function */
+    OpEnd                       /* fell off the end of the function */
+};
+
+/* the kind of value an expression leaves on the stack */
+enum BytecodeKind
+{
+    KindVoid,                   /* nothing */
+    KindInt,                    /* an int */
+    KindLong,                   /* an integer constant, which picoc treats as a long */
+    KindChar,                   /* a character constant */
+    KindString                  /* a string constant - these aren't put on the stack, only passed as arguments */
+};
+
+/* a word of compiled code */
+union BytecodeWord
+{
+    long Int;
+    void *Ptr;
+};
+
+/* a compiled function body */
+struct Bytecode
+{
+    int NumSlots;               /* how many parameters and local variables there are */
+    int MaxDepth;               /* the deepest the evaluation stack gets */
+    int Generation;             /* the GlobalGeneration this was compiled in */
+    int Assigned;               /* for a loop expression, a bit for each slot it assigns to */
+    union BytecodeWord Code[1]; /* the code itself */
+};
+
+/* a loop which break and continue can jump out of */
+struct BytecodeLoop
+{
+    int BreakChain;             /* jumps to the end of the loop */
+    int ContinueChain;          /* jumps to the next iteration */
+    struct BytecodeLoop *Outer;
+};
+
+/* the state of the compiler */
+struct BytecodeCompiler
+{
+    Picoc *pc;
+    struct ParseState Parser;   /* where we are in the function body */
+    struct FuncDef *Def;        /* the function we're compiling */
+    union BytecodeWord *Code;   /* the code so far */
+    int Size;                   /* words of code so far */
+    int Allocated;              /* words allocated for the code */
+    int OutOfMemory;            /* couldn't grow the code */
+    int LastOp;                 /* where the last operation starts */
+    int LastLabel;              /* where the last jump target is */
+    int LValueOp;               /* where the load of a plain variable starts if it was the last operation, otherwise -1 */
+    int Depth;                  /* the current depth of the evaluation stack */
+    int MaxDepth;               /* the deepest the evaluation stack gets */
+    int NumSlots;               /* parameters and local variables so far */
+    int NumNames;               /* local variable names currently in scope */
+    const char *Name[BYTECODE_LOCALS_MAX];
+    int NameSlot[BYTECODE_LOCALS_MAX];
+    const char *String;         /* the last string constant we saw */
+    struct BytecodeLoop *Loop;  /* the innermost loop */
+    int Expression;             /* compiling a loop expression, where every variable gets a slot and functions can't be called */
+    int Assigned;               /* for a loop expression, a bit for each slot it assigns to */
+};
+
+static int BytecodeExpression(struct BytecodeCompiler *Comp, enum BytecodeKind *Kind);
+static int BytecodeStatement(struct BytecodeCompiler *Comp);
+
+
+/* add a word to the code */
+static void BytecodeEmit(struct BytecodeCompiler *Comp, long Int)
+{
+    if (Comp->Size == Comp->Allocated)
+    {
+        /* grow the code buffer */
+        union BytecodeWord *NewCode = HeapAllocMem(Comp->pc, sizeof(union BytecodeWord) * Comp->Allocated * 2);
+        if (NewCode == NULL)
+        {
+            Comp->OutOfMemory = TRUE;
+            return;
+        }
+
+        memcpy((void *)NewCode, (void *)Comp->Code, sizeof(union BytecodeWord) * Comp->Size);
+        HeapFreeMem(Comp->pc, Comp->Code);
+        Comp->Code = NewCode;
+        Comp->Allocated *= 2;
+    }
+
+    Comp->Code[Comp->Size++].Int = Int;
+}
+
+/* add a pointer to the code */
+static void BytecodeEmitPtr(struct BytecodeCompiler *Comp, void *Ptr)
+{
+    BytecodeEmit(Comp, 0);
+    if (!Comp->OutOfMemory)
+        Comp->Code[Comp->Size-1].Ptr = Ptr;
+}
+
+/* add an operation to the code, keeping track of what it does to the stack */
+static void BytecodeOp(struct BytecodeCompiler *Comp, enum BytecodeOp Op, int StackChange)
+{
+    Comp->LastOp = Comp->Size;
+    Comp->LValueOp = -1;
+    Comp->Depth += StackChange;
+    if (Comp->Depth > Comp->MaxDepth)
+        Comp->MaxDepth = Comp->Depth;
+
+    BytecodeEmit(Comp, Op);
+}
+
+/* add a jump to the code. the operand links it into a chain of jumps to be patched later */
+static int BytecodeJump(struct BytecodeCompiler *Comp, enum BytecodeOp Op, int StackChange, int Chain)
+{
+    BytecodeOp(Comp, Op, StackChange);
+    BytecodeEmit(Comp, Chain);
+    return Comp->Size-1;
+}
+
+/* point a chain of jumps at a target */
+static void BytecodePatch(struct BytecodeCompiler *Comp, int Chain, int Target)
+{
+    int Next;
+
+    if (Comp->OutOfMemory)
+        return;
+
+    while (Chain != BYTECODE_NO_CHAIN)
+    {
+        Next = Comp->Code[Chain].Int;
+        Comp->Code[Chain].Int = Target - (Chain-1);
+        Chain = Next;
+    }
+}
+
+/* mark the current position as a jump target */
+static int BytecodeLabel(struct BytecodeCompiler *Comp)
+{
+    Comp->LastLabel = Comp->Size;
+    return Comp->Size;
+}
+
+/* get a token from the function body */
+static enum LexToken BytecodeGetToken(struct BytecodeCompiler *Comp, struct Value **Value)
+{
+    return LexGetToken(&Comp->Parser, Value, TRUE);
+}
+
+/* look at the next token in the function body */
+static enum LexToken BytecodePeekToken(struct BytecodeCompiler *Comp)
+{
+    return LexGetToken(&Comp->Parser, NULL, FALSE);
+}
+
+/* is this the kind of value we can do arithmetic on */
+static int BytecodeIsInt(enum BytecodeKind Kind)
+{
+    return Kind == KindInt || Kind == KindLong || Kind == KindChar;
+}
+
+/* find a local variable or parameter, -1 if it's not defined */
+static int BytecodeFindLocal(struct BytecodeCompiler *Comp, const char *Name)
+{
+    int Count;
+
+    for (Count = Comp->NumNames-1; Count >= 0; Count--)
+    {
+        if (Comp->Name[Count] == Name)
+            return Comp->NameSlot[Count];
+    }
+
+    return -1;
+}
+
+/* add a local variable or parameter, -1 if there are too many */
+static int BytecodeAddLocal(struct BytecodeCompiler *Comp, const char *Name)
+{
+    if (Comp->NumSlots >= (Comp->Expression ? BYTECODE_EXPRESSION_VARS : BYTECODE_LOCALS_MAX))
+        return -1;
+
+    Comp->Name[Comp->NumNames] = Name;
+    Comp->NameSlot[Comp->NumNames] = Comp->NumSlots;
+    Comp->NumNames++;
+    return Comp->NumSlots++;
+}
+
+/* was the last operation a load of a variable we can assign to */
+static int BytecodeIsLValue(struct BytecodeCompiler *Comp)
+{
+    struct Value *Global;
+
+    if (Comp->LValueOp < 0 || Comp->OutOfMemory)
+        return FALSE;
+
+    if (Comp->Code[Comp->LValueOp].Int == OpLocal)
+        return TRUE;
+
+    Global = Comp->Code[Comp->LValueOp+1].Ptr;
+    return (Global->Flags & FlagIsLValue) != 0;
+}
+
+/* turn the load of a variable we just compiled into an increment or decrement */
+static void BytecodeIncrement(struct BytecodeCompiler *Comp, enum LexToken Token, int Post)
+{
+    int IsLocal = Comp->Code[Comp->LValueOp].Int == OpLocal;
+
+    if (Comp->Expression)
+        Comp->Assigned |= 1 << Comp->Code[Comp->LValueOp+1].Int;
+
+    if (Post)
+        Comp->Code[Comp->LValueOp].Int = IsLocal ? OpPostAddLocal : OpPostAddGlobal;
+    else
+        Comp->Code[Comp->LValueOp].Int = IsLocal ? OpPreAddLocal : OpPreAddGlobal;
+
+    BytecodeEmit(Comp, Token == TokenIncrement ? 1 : -1);
+    Comp->LValueOp = -1;
+}
+
+/* the operation for an infix operator or compound assignment, or -1 if it's not one we handle */
+static int BytecodeInfixOp(enum LexToken Token)
+{
+    switch (Token)
+    {
+        case TokenPlus: case TokenAddAssign:                        return OpAdd;
+        case TokenMinus: case TokenSubtractAssign:                  return OpSubtract;
+        case TokenAsterisk: case TokenMultiplyAssign:               return OpMultiply;
+        case TokenSlash: case TokenDivideAssign:                    return OpDivide;
+#ifndef NO_MODULUS
+        case TokenModulus: case TokenModulusAssign:                 return OpModulus;
+#endif
+        case TokenShiftLeft: case TokenShiftLeftAssign:             return OpShiftLeft;
+        case TokenShiftRight: case TokenShiftRightAssign:           return OpShiftRight;
+        case TokenAmpersand: case TokenArithmeticAndAssign:         return OpArithmeticAnd;
+        case TokenArithmeticOr: case TokenArithmeticOrAssign:       return OpArithmeticOr;
+        case TokenArithmeticExor: case TokenArithmeticExorAssign:   return OpArithmeticExor;
+        case TokenEqual:                                            return OpEqual;
+        case TokenNotEqual:                                         return OpNotEqual;
+        case TokenLessThan:                                         return OpLessThan;
+        case TokenGreaterThan:                                      return OpGreaterThan;
+        case TokenLessEqual:                                        return OpLessEqual;
+        case TokenGreaterEqual:                                     return OpGreaterEqual;
+        default:                                                    return -1;
+    }
+}
+
+/* the precedence of an infix operator, or 0 if it isn't one */
+static int BytecodeInfixPrecedence(enum LexToken Token)
+{
+    switch (Token)
+    {
+        case TokenLogicalOr:                                        return 1;
+        case TokenLogicalAnd:                                       return 2;
+        case TokenArithmeticOr:                                     return 3;
+        case TokenArithmeticExor:                                   return 4;
+        case TokenAmpersand:                                        return 5;
+        case TokenEqual: case TokenNotEqual:                        return 6;
+        case TokenLessThan: case TokenGreaterThan:
+        case TokenLessEqual: case TokenGreaterEqual:                return 7;
+        case TokenShiftLeft: case TokenShiftRight:                  return 8;
+        case TokenPlus: case TokenMinus:                            return 9;
+        case TokenAsterisk: case TokenSlash: case TokenModulus:     return 10;
+        default:                                                    return 0;
+    }
+}
+
+/* compile a function call. the function must already be defined */
+static int BytecodeCompileCall(struct BytecodeCompiler *Comp, const char *FuncName, enum BytecodeKind *Kind)
+{
+    Picoc *pc = Comp->pc;
+    struct Value *FuncValue;
+    struct FuncDef *Def;
+    enum BytecodeKind ArgKind[PARAMETER_MAX];
+    const char *ArgString[PARAMETER_MAX];
+    enum LexToken Token;
+    int NumArgs = 0;
+    int NumStackArgs = 0;
+    int Count;
+
+    if (!TableGet(&pc->GlobalTable, FuncName, &FuncValue, NULL, NULL, NULL) || FuncValue->Typ->Base != TypeFunction)
+        return FALSE;
+
+    Def = &FuncValue->Val->FuncDef;
+    if (Def->ReturnType != &pc->IntType && Def->ReturnType != &pc->VoidType)
+        return FALSE;
+
+    BytecodeGetToken(Comp, NULL);   /* open bracket */
+    if (BytecodePeekToken(Comp) == TokenCloseBracket)
+        BytecodeGetToken(Comp, NULL);
+    else
+    {
+        do
+        {
+            if (NumArgs == PARAMETER_MAX || !BytecodeExpression(Comp, &ArgKind[NumArgs]) || ArgKind[NumArgs] == KindVoid)
+                return FALSE;
+
+            ArgString[NumArgs] = (ArgKind[NumArgs] == KindString) ? Comp->String : NULL;
+            if (ArgKind[NumArgs] != KindString)
+                NumStackArgs++;
+
+            NumArgs++;
+            Token = BytecodeGetToken(Comp, NULL);
+            if (Token != TokenComma && Token != TokenCloseBracket)
+                return FALSE;
+
+        } while (Token != TokenCloseBracket);
+    }
+
+    /* leave argument count errors to the interpreter */
+    if (NumArgs < Def->NumParams || (NumArgs > Def->NumParams && !Def->VarArgs))
+        return FALSE;
+
+    BytecodeOp(Comp, OpCall, -NumStackArgs + (Def->ReturnType == &pc->VoidType ? 0 : 1));
+    BytecodeEmitPtr(Comp, FuncValue);
+    BytecodeEmitPtr(Comp, (void *)FuncName);
+    BytecodeEmit(Comp, NumArgs);
+    BytecodeEmit(Comp, NumStackArgs);
+    for (Count = 0; Count < NumArgs; Count++)
+    {
+        BytecodeEmit(Comp, ArgKind[Count]);
+        BytecodeEmitPtr(Comp, (void *)ArgString[Count]);
+    }
+
+    *Kind = (Def->ReturnType == &pc->VoidType) ? KindVoid : KindInt;
+    return TRUE;
+}
+
+/* compile a constant, a variable, a function call or a bracketed expression, with any postfix operator */
+static int BytecodePrimary(struct BytecodeCompiler *Comp, enum BytecodeKind *Kind)
+{
+    Picoc *pc = Comp->pc;
+    struct Value *LexValue;
+    struct Value *Global;
+    enum LexToken Token = BytecodeGetToken(Comp, &LexValue);
+    const char *Name;
+    int Slot;
+
+    switch (Token)
+    {
+        case TokenIntegerConstant:
+            BytecodeOp(Comp, OpConst, 1);
+            BytecodeEmit(Comp, LexValue->Val->LongInteger);
+            *Kind = KindLong;
+            return TRUE;
+
+        case TokenCharacterConstant:
+            BytecodeOp(Comp, OpConst, 1);
+            BytecodeEmit(Comp, LexValue->Val->Character);
+            *Kind = KindChar;
+            return TRUE;
+
+        case TokenStringConstant:
+            Comp->String = LexValue->Val->Pointer;
+            *Kind = KindString;
+            return TRUE;
+
+        case TokenOpenBracket:
+            if (!BytecodeExpression(Comp, Kind) || BytecodeGetToken(Comp, NULL) != TokenCloseBracket)
+                return FALSE;
+            break;
+
+        case TokenIdentifier:
+            Name = LexValue->Val->Identifier;
+            if (BytecodePeekToken(Comp) == TokenOpenBracket)
+                return !Comp->Expression && BytecodeFindLocal(Comp, Name) < 0 && BytecodeCompileCall(Comp, Name, Kind);
+
+            Slot = BytecodeFindLocal(Comp, Name);
+            if (Slot < 0 && Comp->Expression)
+                Slot = BytecodeAddLocal(Comp, Name);
+
+            if (Slot >= 0)
+            {
+                BytecodeOp(Comp, OpLocal, 1);
+                BytecodeEmit(Comp, Slot);
+            }
+            else if (TableGet(&pc->GlobalTable, Name, &Global, NULL, NULL, NULL) && Global->Typ == &pc->IntType)
+            {
+                BytecodeOp(Comp, OpGlobal, 1);
+                BytecodeEmitPtr(Comp, Global);
+            }
+            else
+                return FALSE;
+
+            Comp->LValueOp = Comp->LastOp;
+            *Kind = KindInt;
+            break;
+
+        default:
+            return FALSE;
+    }
+
+    /* postfix increment and decrement */
+    Token = BytecodePeekToken(Comp);
+    if (Token == TokenIncrement || Token == TokenDecrement)
+    {
+        if (!BytecodeIsLValue(Comp))
+            return FALSE;
+
+        BytecodeGetToken(Comp, NULL);
+        BytecodeIncrement(Comp, Token, TRUE);
+        *Kind = KindInt;
+    }
+
+    return TRUE;
+}
+
+/* compile a prefix operator and its operand */
+static int BytecodeUnary(struct BytecodeCompiler *Comp, enum BytecodeKind *Kind)
+{
+    enum LexToken Token = BytecodePeekToken(Comp);
+
+    switch (Token)
+    {
+        case TokenMinus: case TokenUnaryNot: case TokenUnaryExor: case TokenPlus:
+            BytecodeGetToken(Comp, NULL);
+            if (!BytecodeUnary(Comp, Kind) || !BytecodeIsInt(*Kind))
+                return FALSE;
+
+            if (Token == TokenMinus)
+                BytecodeOp(Comp, OpNegate, 0);
+            else if (Token == TokenUnaryNot)
+                BytecodeOp(Comp, OpNot, 0);
+            else if (Token == TokenUnaryExor)
+                BytecodeOp(Comp, OpComplement, 0);
+            else
+                Comp->LValueOp = -1;
+
+            *Kind = KindInt;
+            return TRUE;
+
+        case TokenIncrement: case TokenDecrement:
+            BytecodeGetToken(Comp, NULL);
+            if (!BytecodePrimary(Comp, Kind) || !BytecodeIsLValue(Comp))
+                return FALSE;
+
+            BytecodeIncrement(Comp, Token, FALSE);
+            *Kind = KindInt;
+            return TRUE;
+
+        default:
+            return BytecodePrimary(Comp, Kind);
+    }
+}
+
+/* compile infix operators of at least the given precedence */
+static int BytecodeInfix(struct BytecodeCompiler *Comp, int MinPrecedence, enum BytecodeKind *Kind)
+{
+    enum BytecodeKind RightKind;
+    enum LexToken Token;
+    int Precedence;
+    int Chain;
+
+    if (!BytecodeUnary(Comp, Kind))
+        return FALSE;
+
+    while (TRUE)
+    {
+        Token = BytecodePeekToken(Comp);
+        Precedence = BytecodeInfixPrecedence(Token);
+        if (Precedence == 0 || Precedence < MinPrecedence)
+            return TRUE;
+
+        if (!BytecodeIsInt(*Kind))
+            return FALSE;
+
+        BytecodeGetToken(Comp, NULL);
+        if (Token == TokenLogicalAnd || Token == TokenLogicalOr)
+        {
+            /* only evaluate the right hand side if we need to */
+            Chain = BytecodeJump(Comp, Token == TokenLogicalAnd ? OpJumpIfFalseElsePop : OpJumpIfTrueElsePop, -1, BYTECODE_NO_CHAIN);
+            if (!BytecodeInfix(Comp, Precedence+1, &RightKind) || !BytecodeIsInt(RightKind))
+                return FALSE;
+
+            BytecodePatch(Comp, Chain, BytecodeLabel(Comp));
+            BytecodeOp(Comp, OpTruth, 0);
+        }
+        else
+        {
+            if (BytecodeInfixOp(Token) < 0 || !BytecodeInfix(Comp, Precedence+1, &RightKind) || !BytecodeIsInt(RightKind))
+                return FALSE;
+
+            BytecodeOp(Comp, (enum BytecodeOp)BytecodeInfixOp(Token), -1);
+        }
+
+        *Kind = KindInt;
+    }
+}
+
+/* compile a conditional expression */
+static int BytecodeTernary(struct BytecodeCompiler *Comp, enum BytecodeKind *Kind)
+{
+    enum BytecodeKind FalseKind;
+    int ElseChain;
+    int EndChain;
+
+    if (!BytecodeInfix(Comp, 1, Kind))
+        return FALSE;
+
+    if (BytecodePeekToken(Comp) != TokenQuestionMark)
+        return TRUE;
+
+    if (!BytecodeIsInt(*Kind))
+        return FALSE;
+
+    /* nested conditionals without brackets are left to the interpreter */
+    BytecodeGetToken(Comp, NULL);
+    ElseChain = BytecodeJump(Comp, OpJumpIfFalse, -1, BYTECODE_NO_CHAIN);
+    if (!BytecodeInfix(Comp, 1, Kind) || !BytecodeIsInt(*Kind) || BytecodeGetToken(Comp, NULL) != TokenColon)
+        return FALSE;
+
+    EndChain = BytecodeJump(Comp, OpJump, -1, BYTECODE_NO_CHAIN);
+    BytecodePatch(Comp, ElseChain, BytecodeLabel(Comp));
+    if (!BytecodeInfix(Comp, 1, &FalseKind) || !BytecodeIsInt(FalseKind) || BytecodePeekToken(Comp) == TokenQuestionMark)
+        return FALSE;
+
+    BytecodePatch(Comp, EndChain, BytecodeLabel(Comp));
+    Comp->LValueOp = -1;
+    if (FalseKind != *Kind)
+        *Kind = KindLong;
+
+    return TRUE;
+}
+
+/* compile an expression, including assignments */
+static int BytecodeExpression(struct BytecodeCompiler *Comp, enum BytecodeKind *Kind)
+{
+    enum BytecodeKind RightKind;
+    enum LexToken Token;
+    union BytecodeWord Variable[2];
+
+    if (!BytecodeTernary(Comp, Kind))
+        return FALSE;
+
+    Token = BytecodePeekToken(Comp);
+    if (Token < TokenAssign || Token > TokenArithmeticExorAssign)
+        return TRUE;
+
+    if (!BytecodeIsLValue(Comp))
+        return FALSE;
+
+    memcpy((void *)&Variable[0], (void *)&Comp->Code[Comp->LValueOp], sizeof(Variable));
+    BytecodeGetToken(Comp, NULL);
+    if (Token == TokenAssign)
+    {
+        /* we don't need the old value */
+        Comp->Size = Comp->LValueOp;
+        Comp->Depth--;
+    }
+
+    if (!BytecodeExpression(Comp, &RightKind) || !BytecodeIsInt(RightKind))
+        return FALSE;
+
+    if (Token != TokenAssign)
+    {
+        if (BytecodeInfixOp(Token) < 0)
+            return FALSE;
+
+        BytecodeOp(Comp, (enum BytecodeOp)BytecodeInfixOp(Token), -1);
+    }
+
+    if (Comp->Expression)
+        Comp->Assigned |= 1 << Variable[1].Int;
+
+    BytecodeOp(Comp, Variable[0].Int == OpLocal ? OpSetLocal : OpSetGlobal, 0);
+    BytecodeEmit(Comp, Variable[1].Int);
+    if (!Comp->OutOfMemory)
+        Comp->Code[Comp->Size-1] = Variable[1];
+
+    *Kind = KindInt;
+    return TRUE;
+}
+
+/* compile an expression whose value is used as an integer */
+static int BytecodeIntExpression(struct BytecodeCompiler *Comp)
+{
+    enum BytecodeKind Kind;
+
+    return BytecodeExpression(Comp, &Kind) && BytecodeIsInt(Kind);
+}
+
+/* compile "(expression)" */
+static int BytecodeCondition(struct BytecodeCompiler *Comp)
+{
+    return BytecodeGetToken(Comp, NULL) == TokenOpenBracket && BytecodeIntExpression(Comp) && BytecodeGetToken(Comp, NULL) == TokenCloseBracket;
+}
+
+/* discard the value of an expression statement */
+static void BytecodeDiscard(struct BytecodeCompiler *Comp, enum BytecodeKind Kind)
+{
+    if (Kind == KindVoid || Kind == KindString)
+        return;
+
+    if (Comp->LastLabel != Comp->Size && !Comp->OutOfMemory)
+    {
+        /* if the value came straight from an assignment or increment we can just not push it */
+        switch (Comp->Code[Comp->LastOp].Int)
+        {
+            case OpSetLocal:        Comp->Code[Comp->LastOp].Int = OpStoreLocal; Comp->Depth--; return;
+            case OpSetGlobal:       Comp->Code[Comp->LastOp].Int = OpStoreGlobal; Comp->Depth--; return;
+            case OpPreAddLocal:
+            case OpPostAddLocal:    Comp->Code[Comp->LastOp].Int = OpAddLocal; Comp->Depth--; return;
+            case OpPreAddGlobal:
+            case OpPostAddGlobal:   Comp->Code[Comp->LastOp].Int = OpAddGlobal; Comp->Depth--; return;
+            default: break;
+        }
+    }
+
+    BytecodeOp(Comp, OpPop, -1);
+}
+
+/* compile "int a, b = expression;" after the "int" */
+static int BytecodeDeclaration(struct BytecodeCompiler *Comp)
+{
+    struct Value *LexValue;
+    enum LexToken Token;
+    int Slot;
+
+    do
+    {
+        if (BytecodeGetToken(Comp, &LexValue) != TokenIdentifier)
+            return FALSE;
+
+        /* like the interpreter, a name which is already defined here is reused */
+        Slot = BytecodeFindLocal(Comp, LexValue->Val->Identifier);
+        if (Slot < 0)
+            Slot = BytecodeAddLocal(Comp, LexValue->Val->Identifier);
+
+        if (Slot < 0)
+            return FALSE;
+
+        Token = BytecodeGetToken(Comp, NULL);
+        if (Token == TokenAssign)
+        {
+            if (!BytecodeIntExpression(Comp))
+                return FALSE;
+
+            BytecodeOp(Comp, OpStoreLocal, -1);
+            BytecodeEmit(Comp, Slot);
+            Token = BytecodeGetToken(Comp, NULL);
+        }
+
+    } while (Token == TokenComma);
+
+    return Token == TokenSemicolon;
+}
+
+/* compile a block of statements after the "{" */
+static int BytecodeBlock(struct BytecodeCompiler *Comp)
+{
+    int NumNames = Comp->NumNames;
+    enum LexToken Token;
+
+    while ((Token = BytecodePeekToken(Comp)) != TokenRightBrace)
+    {
+        if (Token == TokenEndOfFunction || Token == TokenEOF || !BytecodeStatement(Comp))
+            return FALSE;
+    }
+
+    BytecodeGetToken(Comp, NULL);
+    Comp->NumNames = NumNames;
+    return TRUE;
+}
+
+/* compile the body of a loop */
+static int BytecodeLoopBody(struct BytecodeCompiler *Comp, struct BytecodeLoop *Loop)
+{
+    int Result;
+
+    Loop->BreakChain = BYTECODE_NO_CHAIN;
+    Loop->ContinueChain = BYTECODE_NO_CHAIN;
+    Loop->Outer = Comp->Loop;
+    Comp->Loop = Loop;
+    Result = BytecodeStatement(Comp);
+    Comp->Loop = Loop->Outer;
+
+    return Result;
+}
+
+/* compile a for loop after the "for" */
+static int BytecodeFor(struct BytecodeCompiler *Comp)
+{
+    struct BytecodeLoop Loop;
+    union BytecodeWord *Increment = NULL;
+    int IncrementSize = 0;
+    int NumNames = Comp->NumNames;
+    int ExitChain = BYTECODE_NO_CHAIN;
+    int Start;
+    enum BytecodeKind Kind;
+
+    if (BytecodeGetToken(Comp, NULL) != TokenOpenBracket || !BytecodeStatement(Comp))
+        return FALSE;
+
+    Start = BytecodeLabel(Comp);
+    if (BytecodePeekToken(Comp) != TokenSemicolon)
+    {
+        if (!BytecodeIntExpression(Comp))
+            return FALSE;
+
+        ExitChain = BytecodeJump(Comp, OpJumpIfFalse, -1, BYTECODE_NO_CHAIN);
+    }
+
+    if (BytecodeGetToken(Comp, NULL) != TokenSemicolon)
+        return FALSE;
+
+    if (BytecodePeekToken(Comp) != TokenCloseBracket)
+    {
+        /* compile the increment here then move it after the loop body. jumps are relative so it still works */
+        int IncrementStart = Comp->Size;
+
+        if (!BytecodeExpression(Comp, &Kind))
+            return FALSE;
+
+        BytecodeDiscard(Comp, Kind);
+        if (Comp->OutOfMemory)
+            return FALSE;
+
+        IncrementSize = Comp->Size - IncrementStart;
+        Increment = HeapAllocMem(Comp->pc, sizeof(union BytecodeWord) * IncrementSize);
+        if (Increment == NULL)
+            return FALSE;
+
+        memcpy((void *)Increment, (void *)&Comp->Code[IncrementStart], sizeof(union BytecodeWord) * IncrementSize);
+        Comp->Size = IncrementStart;
+    }
+
+    if (BytecodeGetToken(Comp, NULL) != TokenCloseBracket || !BytecodeLoopBody(Comp, &Loop))
+    {
+        if (Increment != NULL)
+            HeapFreeMem(Comp->pc, Increment);
+
+        return FALSE;
+    }
+
+    BytecodePatch(Comp, Loop.ContinueChain, BytecodeLabel(Comp));
+    if (Increment != NULL)
+    {
+        int Count;
+
+        for (Count = 0; Count < IncrementSize; Count++)
+            BytecodeEmit(Comp, 0);
+
+        if (!Comp->OutOfMemory)
+            memcpy((void *)&Comp->Code[Comp->Size - IncrementSize], (void *)Increment, sizeof(union BytecodeWord) * IncrementSize);
+
+        HeapFreeMem(Comp->pc, Increment);
+    }
+
+    BytecodePatch(Comp, BytecodeJump(Comp, OpJump, 0, BYTECODE_NO_CHAIN), Start);
+    BytecodePatch(Comp, ExitChain, BytecodeLabel(Comp));
+    BytecodePatch(Comp, Loop.BreakChain, Comp->Size);
+    Comp->NumNames = NumNames;
+
+    return TRUE;
+}
+
+/* compile a statement */
+static int BytecodeStatement(struct BytecodeCompiler *Comp)
+{
+    Picoc *pc = Comp->pc;
+    struct BytecodeLoop Loop;
+    struct ParseState PreState;
+    struct Value *LexValue;
+    enum BytecodeKind Kind;
+    enum LexToken Token;
+    int Chain;
+    int Start;
+
+    if (Comp->OutOfMemory)
+        return FALSE;
+
+    /* peek first so the line is the statement's own rather than where the last one ended */
+    BytecodePeekToken(Comp);
+    BytecodeOp(Comp, OpStatement, 0);
+    BytecodeEmit(Comp, Comp->Parser.Line);
+    BytecodeEmit(Comp, Comp->Parser.CharacterPos);
+
+    ParserCopy(&PreState, &Comp->Parser);
+    Token = BytecodeGetToken(Comp, &LexValue);
+    switch (Token)
+    {
+        case TokenSemicolon:
+            return TRUE;
+
+        case TokenLeftBrace:
+            return BytecodeBlock(Comp);
+
+        case TokenIntType:
+            return BytecodeDeclaration(Comp);
+
+        case TokenIf:
+            if (!BytecodeCondition(Comp))
+                return FALSE;
+
+            Chain = BytecodeJump(Comp, OpJumpIfFalse, -1, BYTECODE_NO_CHAIN);
+            if (!BytecodeStatement(Comp))
+                return FALSE;
+
+            if (BytecodePeekToken(Comp) == TokenElse)
+            {
+                int EndChain;
+
+                BytecodeGetToken(Comp, NULL);
+                EndChain = BytecodeJump(Comp, OpJump, 0, BYTECODE_NO_CHAIN);
+                BytecodePatch(Comp, Chain, BytecodeLabel(Comp));
+                if (!BytecodeStatement(Comp))
+                    return FALSE;
+
+                Chain = EndChain;
+            }
+
+            BytecodePatch(Comp, Chain, BytecodeLabel(Comp));
+            return TRUE;
+
+        case TokenWhile:
+            Start = BytecodeLabel(Comp);
+            if (!BytecodeCondition(Comp))
+                return FALSE;
+
+            Chain = BytecodeJump(Comp, OpJumpIfFalse, -1, BYTECODE_NO_CHAIN);
+            if (!BytecodeLoopBody(Comp, &Loop))
+                return FALSE;
+
+            BytecodePatch(Comp, Loop.ContinueChain, Start);
+            BytecodePatch(Comp, BytecodeJump(Comp, OpJump, 0, BYTECODE_NO_CHAIN), Start);
+            BytecodePatch(Comp, Chain, BytecodeLabel(Comp));
+            BytecodePatch(Comp, Loop.BreakChain, Comp->Size);
+            return TRUE;
+
+        case TokenDo:
+            Start = BytecodeLabel(Comp);
+            if (!BytecodeLoopBody(Comp, &Loop) || BytecodeGetToken(Comp, NULL) != TokenWhile)
+                return FALSE;
+
+            BytecodePatch(Comp, Loop.ContinueChain, BytecodeLabel(Comp));
+            if (!BytecodeCondition(Comp))
+                return FALSE;
+
+            BytecodePatch(Comp, BytecodeJump(Comp, OpJumpIfTrue, -1, BYTECODE_NO_CHAIN), Start);
+            BytecodePatch(Comp, Loop.BreakChain, BytecodeLabel(Comp));
+            return BytecodeGetToken(Comp, NULL) == TokenSemicolon;
+
+        case TokenFor:
+            return BytecodeFor(Comp);
+
+        case TokenBreak:
+        case TokenContinue:
+            if (Comp->Loop == NULL)
+                return FALSE;
+
+            if (Token == TokenBreak)
+                Comp->Loop->BreakChain = BytecodeJump(Comp, OpJump, 0, Comp->Loop->BreakChain);
+            else
+                Comp->Loop->ContinueChain = BytecodeJump(Comp, OpJump, 0, Comp->Loop->ContinueChain);
+
+            return BytecodeGetToken(Comp, NULL) == TokenSemicolon;
+
+        case TokenReturn:
+            if (Comp->Def->ReturnType == &pc->VoidType)
+                BytecodeOp(Comp, OpReturnVoid, 0);
+            else
+            {
+                if (!BytecodeIntExpression(Comp))
+                    return FALSE;
+
+                BytecodeOp(Comp, OpReturn, -1);
+            }
+            return BytecodeGetToken(Comp, NULL) == TokenSemicolon;
+
+        case TokenIdentifier:
+            /* labels are left to the interpreter */
+            if (BytecodePeekToken(Comp) == TokenColon)
+                return FALSE;
+            /* fall through */
+
+        case TokenOpenBracket:
+        case TokenIncrement:
+        case TokenDecrement:
+            /* an expression statement */
+            ParserCopy(&Comp->Parser, &PreState);
+            if (!BytecodeExpression(Comp, &Kind) || BytecodeGetToken(Comp, NULL) != TokenSemicolon)
+                return FALSE;
+
+            BytecodeDiscard(Comp, Kind);
+            return TRUE;
+
+        default:
+            return FALSE;
+    }
+}
+
+/* check a function body for things which the compiler can't handle at all */
+static int BytecodeCheckTokens(struct ParseState *Body)
+{
+    struct ParseState Parser;
+    enum LexToken Token;
+
+    ParserCopy(&Parser, Body);
+    do
+    {
+        Token = LexGetRawToken(&Parser, NULL, TRUE);
+        if (Token >= TokenHashDefine && Token <= TokenHashEndif)
+            return FALSE;
+
+    } while (Token != TokenEndOfFunction && Token != TokenEOF);
+
+    return TRUE;
+}
+
+/* copy the code we've compiled into a block of exactly the right size */
+static struct Bytecode *BytecodeCopy(struct BytecodeCompiler *Comp)
+{
+    struct Bytecode *Code = HeapAllocMem(Comp->pc, sizeof(struct Bytecode) + sizeof(union BytecodeWord) * (Comp->Size - 1));
+    
+    if (Code != NULL)
+    {
+        Code->NumSlots = Comp->NumSlots;
+        Code->MaxDepth = Comp->MaxDepth;
+        Code->Generation = Comp->pc->GlobalGeneration;
+        Code->Assigned = Comp->Assigned;
+        memcpy((void *)&Code->Code[0], (void *)Comp->Code, sizeof(union BytecodeWord) * Comp->Size);
+    }
+    
+    return Code;
+}
+
+/* compile a function body into bytecode. returns FALSE if it can't be compiled */
+int BytecodeCompile(Picoc *pc, struct FuncDef *Def)
+{
+    struct BytecodeCompiler Comp;
+    struct Bytecode *Code = NULL;
+    int Count;
+    int Compiled;
+
+    if (Def->ReturnType != &pc->IntType && Def->ReturnType != &pc->VoidType)
+        Def->NotCompilable = TRUE;
+
+    for (Count = 0; Count < Def->NumParams; Count++)
+    {
+        if (Def->ParamType[Count] != &pc->IntType)
+            Def->NotCompilable = TRUE;
+    }
+
+    if (Def->NotCompilable || Def->VarArgs || Def->Body == NULL || !BytecodeCheckTokens(Def->Body))
+    {
+        Def->NotCompilable = TRUE;
+        return FALSE;
+    }
+
+    memset((void *)&Comp, '\0', sizeof(Comp));
+    Comp.pc = pc;
+    Comp.Def = Def;
+    Comp.LValueOp = -1;
+    Comp.LastLabel = -1;
+    Comp.Allocated = BYTECODE_INITIAL_SIZE;
+    Comp.Code = HeapAllocMem(pc, sizeof(union BytecodeWord) * Comp.Allocated);
+    if (Comp.Code == NULL)
+        return FALSE;
+
+    ParserCopy(&Comp.Parser, Def->Body);
+    for (Count = 0; Count < Def->NumParams; Count++)
+        BytecodeAddLocal(&Comp, Def->ParamName[Count]);
+
+    Compiled = BytecodeStatement(&Comp);
+    BytecodeOp(&Comp, OpStatement, 0);
+    BytecodeEmit(&Comp, Comp.Parser.Line);
+    BytecodeEmit(&Comp, Comp.Parser.CharacterPos);
+    BytecodeOp(&Comp, OpEnd, 0);
+
+    if (Compiled && !Comp.OutOfMemory)
+        Code = BytecodeCopy(&Comp);
+
+    HeapFreeMem(pc, Comp.Code);
+
+    if (!Compiled)
+        Def->NotCompilable = TRUE;
+
+    Def->Bytecode = Code;
+    return Code != NULL;
+}
+
+/* free a function's compiled code */
+void BytecodeFree(Picoc *pc, struct FuncDef *Def)
+{
+    if (Def->Bytecode != NULL)
+    {
+        HeapFreeMem(pc, Def->Bytecode);
+        Def->Bytecode = NULL;
+    }
+}
+
+/* compile a loop's condition or increment, up to EndToken, so the loop can run it without
+ * parsing it every time. each variable it uses gets a slot, starting with the *NumNames 
+ * names already in Name so a loop's expressions can share their variables. new names are
+ * added to Name and the slots it assigns to are added to *Assigned. returns NULL if it 
+ * can't be compiled */
+struct Bytecode *BytecodeCompileExpression(Picoc *pc, struct ParseState *Parser, enum LexToken EndToken, const char **Name, int *NumNames, int *Assigned)
+{
+    struct BytecodeCompiler Comp;
+    struct Bytecode *Code = NULL;
+    enum BytecodeKind Kind;
+    int Count;
+    int Compiled;
+
+    memset((void *)&Comp, '\0', sizeof(Comp));
+    Comp.pc = pc;
+    Comp.Expression = TRUE;
+    Comp.LValueOp = -1;
+    Comp.LastLabel = -1;
+    Comp.Allocated = BYTECODE_INITIAL_SIZE;
+    Comp.Code = HeapAllocMem(pc, sizeof(union BytecodeWord) * Comp.Allocated);
+    if (Comp.Code == NULL)
+        return NULL;
+
+    ParserCopy(&Comp.Parser, Parser);
+    for (Count = 0; Count < *NumNames; Count++)
+        BytecodeAddLocal(&Comp, Name[Count]);
+
+    Compiled = BytecodeExpression(&Comp, &Kind) && BytecodeIsInt(Kind) && BytecodePeekToken(&Comp) == EndToken && Comp.MaxDepth <= BYTECODE_EXPRESSION_DEPTH;
+    BytecodeOp(&Comp, OpEnd, 0);
+
+    if (Compiled && !Comp.OutOfMemory)
+        Code = BytecodeCopy(&Comp);
+
+    HeapFreeMem(pc, Comp.Code);
+
+    if (Code != NULL)
+    {
+        for (Count = *NumNames; Count < Comp.NumNames; Count++)
+            Name[Count] = Comp.Name[Count];
+
+        *NumNames = Comp.NumNames;
+        *Assigned |= Comp.Assigned;
+    }
+
+    return Code;
+}
+
+/* run code until it gets to a call or the end of the code. Parser tracks the statements of a
+ * function and is unused for a loop expression, which has none. returns where it stopped,
+ * with the stack pointer in *StackPointer */
+static union BytecodeWord *BytecodeExecute(struct ParseState *Parser, union BytecodeWord *PC, long *Slot, long **StackPointer)
+{
+    long *SP = *StackPointer;
+
+    while (TRUE)
+    {
+        switch ((enum BytecodeOp)PC->Int)
+        {
+            case OpConst:           *SP++ = PC[1].Int; PC += 2; break;
+            case OpLocal:           *SP++ = Slot[PC[1].Int]; PC += 2; break;
+            case OpGlobal:          *SP++ = BYTECODE_GLOBAL(PC); PC += 2; break;
+            case OpSetLocal:        SP[-1] = Slot[PC[1].Int] = (int)SP[-1]; PC += 2; break;
+            case OpSetGlobal:       SP[-1] = BYTECODE_GLOBAL(PC) = (int)SP[-1]; PC += 2; break;
+            case OpStoreLocal:      Slot[PC[1].Int] = (int)*--SP; PC += 2; break;
+            case OpStoreGlobal:     BYTECODE_GLOBAL(PC) = (int)*--SP; PC += 2; break;
+            case OpPreAddLocal:     *SP++ = Slot[PC[1].Int] = (int)(Slot[PC[1].Int] + PC[2].Int); PC += 3; break;
+            case OpPostAddLocal:    *SP++ = Slot[PC[1].Int]; Slot[PC[1].Int] = (int)(Slot[PC[1].Int] + PC[2].Int); PC += 3; break;
+            case OpAddLocal:        Slot[PC[1].Int] = (int)(Slot[PC[1].Int] + PC[2].Int); PC += 3; break;
+            case OpPreAddGlobal:    *SP++ = BYTECODE_GLOBAL(PC) = (int)(BYTECODE_GLOBAL(PC) + PC[2].Int); PC += 3; break;
+            case OpPostAddGlobal:   *SP++ = BYTECODE_GLOBAL(PC); BYTECODE_GLOBAL(PC) = (int)(BYTECODE_GLOBAL(PC) + PC[2].Int); PC += 3; break;
+            case OpAddGlobal:       BYTECODE_GLOBAL(PC) = (int)(BYTECODE_GLOBAL(PC) + PC[2].Int); PC += 3; break;
+            case OpPop:             SP--; PC++; break;
+            case OpNegate:          SP[-1] = (int)-SP[-1]; PC++; break;
+            case OpNot:             SP[-1] = !SP[-1]; PC++; break;
+            case OpComplement:      SP[-1] = (int)~SP[-1]; PC++; break;
+            case OpAdd:             SP--; SP[-1] = (int)(SP[-1] + SP[0]); PC++; break;
+            case OpSubtract:        SP--; SP[-1] = (int)(SP[-1] - SP[0]); PC++; break;
+            case OpMultiply:        SP--; SP[-1] = (int)(SP[-1] * SP[0]); PC++; break;
+            case OpDivide:          SP--; SP[-1] = (int)(SP[-1] / SP[0]); PC++; break;
+#ifndef NO_MODULUS
+            case OpModulus:         SP--; SP[-1] = (int)(SP[-1] % SP[0]); PC++; break;
+#endif
+            case OpShiftLeft:       SP--; SP[-1] = (int)(SP[-1] << SP[0]); PC++; break;
+            case OpShiftRight:      SP--; SP[-1] = (int)(SP[-1] >> SP[0]); PC++; break;
+            case OpArithmeticAnd:   SP--; SP[-1] = (int)(SP[-1] & SP[0]); PC++; break;
+            case OpArithmeticOr:    SP--; SP[-1] = (int)(SP[-1] | SP[0]); PC++; break;
+            case OpArithmeticExor:  SP--; SP[-1] = (int)(SP[-1] ^ SP[0]); PC++; break;
+            case OpEqual:           SP--; SP[-1] = SP[-1] == SP[0]; PC++; break;
+            case OpNotEqual:        SP--; SP[-1] = SP[-1] != SP[0]; PC++; break;
+            case OpLessThan:        SP--; SP[-1] = SP[-1] < SP[0]; PC++; break;
+            case OpGreaterThan:     SP--; SP[-1] = SP[-1] > SP[0]; PC++; break;
+            case OpLessEqual:       SP--; SP[-1] = SP[-1] <= SP[0]; PC++; break;
+            case OpGreaterEqual:    SP--; SP[-1] = SP[-1] >= SP[0]; PC++; break;
+            case OpTruth:           SP[-1] = SP[-1] != 0; PC++; break;
+            case OpJump:            PC += PC[1].Int; break;
+            case OpJumpIfFalse:     PC += (*--SP == 0) ? PC[1].Int : 2; break;
+            case OpJumpIfTrue:      PC += (*--SP != 0) ? PC[1].Int : 2; break;
+            case OpJumpIfFalseElsePop: if (SP[-1] == 0) PC += PC[1].Int; else { SP--; PC += 2; } break;
+            case OpJumpIfTrueElsePop:  if (SP[-1] != 0) PC += PC[1].Int; else { SP--; PC += 2; } break;
+
+            case OpStatement:
+                Parser->Line = (short)PC[1].Int;
+                Parser->CharacterPos = (short)PC[2].Int;
+                if (--Parser->pc->StatementsLeft == 0)
+                    ParseStatementBudget(Parser);
+#ifndef NO_PROFILER
+                if (Parser->pc->Profiling)
+                    ProfileStatement(Parser);
+#endif
+
+#ifndef NO_DEBUGGER
+                if (Parser->DebugMode)
+                    DebugCheckStatement(Parser);
+#endif
+                PC += 3;
+                break;
+
+            default:
+                *StackPointer = SP;
+                return PC;
+        }
+    }
+}
+
+/* run a compiled loop expression on the variables Var points to. returns its value */
+long BytecodeRunExpression(struct Bytecode *Code, int **Var)
+{
+    long Slot[BYTECODE_EXPRESSION_VARS + BYTECODE_EXPRESSION_DEPTH];
+    long *SP = &Slot[Code->NumSlots];
+    int Count;
+
+    for (Count = 0; Count < Code->NumSlots; Count++)
+        Slot[Count] = *Var[Count];
+
+    BytecodeExecute(NULL, &Code->Code[0], Slot, &SP);
+
+    for (Count = 0; Count < Code->NumSlots; Count++)
+    {
+        if (Code->Assigned & (1 << Count))
+            *Var[Count] = (int)Slot[Count];
+    }
+
+    return SP[-1];
+}
+
+/* call a function from compiled code. returns the function's result */
+static long BytecodeRunCall(struct ParseState *Parser, union BytecodeWord *Op, long *Arg)
+{
+    Picoc *pc = Parser->pc;
+    struct Value *FuncValue = Op[1].Ptr;
+    struct FuncDef *Def = &FuncValue->Val->FuncDef;
+    const char *FuncName = Op[2].Ptr;
+    int NumArgs = Op[3].Int;
+    struct Value *ReturnValue;
+    struct Value **ParamArray;
+    struct Value *ArgValue;
+    struct ValueType *ArgType;
+    long Result = 0;
+    int Count;
+
+    HeapPushStackFrame(pc);
+    ReturnValue = VariableAllocValueFromType(pc, Parser, Def->ReturnType, FALSE, NULL, FALSE);
+    ParamArray = HeapAllocStack(pc, sizeof(struct Value *) * Def->NumParams);
+    if (ParamArray == NULL)
+        ProgramFail(Parser, "out of memory");
+
+    for (Count = 0; Count < NumArgs; Count++)
+    {
+        enum BytecodeKind Kind = (enum BytecodeKind)Op[5 + Count*2].Int;
+
+        switch (Kind)
+        {
+            case KindLong:  ArgType = &pc->LongType; break;
+            case KindChar:  ArgType = &pc->CharType; break;
+            case KindString: ArgType = pc->CharPtrType; break;
+            default:        ArgType = &pc->IntType; break;
+        }
+
+        /* declared parameters get converted to their own type, variable arguments are left on the stack as they are */
+        if (Count < Def->NumParams)
+            ParamArray[Count] = VariableAllocValueFromType(pc, Parser, Def->ParamType[Count], FALSE, NULL, FALSE);
+
+        ArgValue = VariableAllocValueFromType(pc, Parser, ArgType, FALSE, NULL, FALSE);
+        switch (Kind)
+        {
+            case KindLong:  ArgValue->Val->LongInteger = *Arg++; break;
+            case KindChar:  ArgValue->Val->Character = (char)*Arg++; break;
+            case KindString: ArgValue->Val->Pointer = Op[6 + Count*2].Ptr; break;
+            default:        ArgValue->Val->Integer = (int)*Arg++; break;
+        }
+
+        if (Count < Def->NumParams)
+        {
+            ExpressionAssign(Parser, ParamArray[Count], ArgValue, TRUE, FuncName, Count+1, FALSE);
+            VariableStackPop(Parser, ArgValue);
+        }
+    }
+
+    ExpressionCallFunction(Parser, FuncValue, FuncName, ReturnValue, ParamArray, NumArgs);
+    if (Def->ReturnType == &pc->IntType)
+        Result = ReturnValue->Val->Integer;
+
+    HeapPopStackFrame(pc);
+    return Result;
+}
+
+/* run a function's compiled code, compiling it first if necessary. returns FALSE if it can't be compiled */
+int BytecodeRun(struct ParseState *Parser, struct Value *FuncValue, const char *FuncName, struct Value *ReturnValue, struct Value **ParamArray)
+{
+    Picoc *pc = Parser->pc;
+    struct FuncDef *Def = &FuncValue->Val->FuncDef;
+    int Generation = pc->GlobalGeneration;
+    struct ParseState FuncParser;
+    union BytecodeWord *PC;
+    long *Slot;
+    long *SP;
+    int Count;
+
+    if (Def->Bytecode != NULL && Def->Bytecode->Generation != Generation)
+    {
+        /* a global this code uses might have been deleted - compile it again */
+        BytecodeFree(pc, Def);
+        Def->NotCompilable = FALSE;
+    }
+
+    if (Def->Bytecode == NULL && (Def->NotCompilable || !BytecodeCompile(pc, Def)))
+        return FALSE;
+
+    ParserCopy(&FuncParser, Def->Body);
+    VariableStackFrameAdd(Parser, FuncName, 0);
+    pc->TopStackFrame->NumParams = Def->NumParams;
+    pc->TopStackFrame->ReturnValue = ReturnValue;
+
+    Slot = HeapAllocStack(pc, sizeof(long) * (Def->Bytecode->NumSlots + Def->Bytecode->MaxDepth));
+    if (Slot == NULL)
+        ProgramFail(Parser, "out of memory");
+
+    for (Count = 0; Count < Def->NumParams; Count++)
+        Slot[Count] = ParamArray[Count]->Val->Integer;
+
+    SP = &Slot[Def->Bytecode->NumSlots];
+    PC = &Def->Bytecode->Code[0];
+    while (TRUE)
+    {
+        PC = BytecodeExecute(&FuncParser, PC, Slot, &SP);
+        switch ((enum BytecodeOp)PC->Int)
+        {
+            case OpCall:
+            {
+                long Result;
+
+                SP -= PC[4].Int;
+                Result = BytecodeRunCall(&FuncParser, PC, SP);
+                if (pc->GlobalGeneration != Generation)
+                    ProgramFail(&FuncParser, "a function or variable used by '%s' was deleted while it was running", FuncName);
+
+                if (((struct Value *)PC[1].Ptr)->Val->FuncDef.ReturnType != &pc->VoidType)
+                    *SP++ = Result;
+
+                PC += 5 + PC[3].Int * 2;
+                break;
+            }
+
+            case OpReturn:
+                ReturnValue->Val->Integer = (int)*--SP;
+                VariableStackFramePop(Parser);
+                return TRUE;
+
+            case OpReturnVoid:
+                VariableStackFramePop(Parser);
+                return TRUE;
+
+            case OpEnd:
+                if (Def->ReturnType != &pc->VoidType)
+                    ProgramFail(&FuncParser, "no value returned from a function returning %t", Def->ReturnType);
+
+                VariableStackFramePop(Parser);
+                return TRUE;
+
+            default:
+                ProgramFail(&FuncParser, "bad bytecode");
+        }
+    }
+}
+
+#endif /* !NO_BYTECODE */
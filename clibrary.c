@@ -7,8 +7,6 @@
 
 /* endian-ness checking */
 static const int __ENDIAN_CHECK__ = 1;
-static int BigEndian;
-static int LittleEndian;
 
 
 /* global initialisation for libraries */
@@ -20,11 +18,11 @@ void LibraryInit(Picoc *pc)
     VariableDefinePlatformVar(pc, NULL, "PICOC_VERSION", pc->CharPtrType, (union AnyValue *)&pc->VersionString, FALSE);
 
     /* define endian-ness macros */
-    BigEndian = ((*(char*)&__ENDIAN_CHECK__) == 0);
-    LittleEndian = ((*(char*)&__ENDIAN_CHECK__) == 1);
+    pc->BigEndian = ((*(char*)&__ENDIAN_CHECK__) == 0);
+    pc->LittleEndian = ((*(char*)&__ENDIAN_CHECK__) == 1);
 
-    VariableDefinePlatformVar(pc, NULL, "BIG_ENDIAN", &pc->IntType, (union AnyValue *)&BigEndian, FALSE);
-    VariableDefinePlatformVar(pc, NULL, "LITTLE_ENDIAN", &pc->IntType, (union AnyValue *)&LittleEndian, FALSE);
+    VariableDefinePlatformVar(pc, NULL, "BIG_ENDIAN", &pc->IntType, (union AnyValue *)&pc->BigEndian, FALSE);
+    VariableDefinePlatformVar(pc, NULL, "LITTLE_ENDIAN", &pc->IntType, (union AnyValue *)&pc->LittleEndian, FALSE);
 }
 
 /* add a library */
@@ -331,10 +329,7 @@ void GenericPrintf(struct ParseState *Parser, struct Value *ReturnValue, struct
 /* printf(): print to console output */
 void LibPrintf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    struct OutputStream ConsoleStream;
-    
-    ConsoleStream.Putch = &PlatformPutc;
-    GenericPrintf(Parser, ReturnValue, Param, NumArgs, &ConsoleStream);
+    GenericPrintf(Parser, ReturnValue, Param, NumArgs, Parser->pc->CStdOut);
 }
 
 /* sprintf(): print to a string */
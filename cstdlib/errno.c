@@ -650,6 +650,17 @@ void StdErrnoSetupFunc(Picoc *pc)
 #endif
 
     VariableDefinePlatformVar(pc, NULL, "errno", &pc->IntType, (union AnyValue *)&errno, TRUE);
+    VariableGet(pc, NULL, TableStrRegister(pc, "errno"), &pc->ErrnoValue);
 }
 
 #endif /* !BUILTIN_MINI_STDLIB */
+
+/* each thread has its own errno so the program's errno is pointed at the errno of the
+ * thread running it each time the host calls into the instance */
+void StdErrnoBind(Picoc *pc)
+{
+#ifndef BUILTIN_MINI_STDLIB
+    if (pc->ErrnoValue != NULL)
+        pc->ErrnoValue->Val = (union AnyValue *)&errno;
+#endif
+}
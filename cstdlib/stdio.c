@@ -22,10 +22,6 @@ static int _IONBFValue = _IONBF;
 static int L_tmpnamValue = L_tmpnam;
 static int GETS_MAXValue = 255;     /* arbitrary maximum size of a gets() file */
 
-static FILE *stdinValue;
-static FILE *stdoutValue;
-static FILE *stderrValue;
-
 
 /* our own internal output stream which can output to FILE * or strings */
 typedef struct StdOutStreamStruct
@@ -48,9 +44,9 @@ struct StdVararg
 void BasicIOInit(Picoc *pc)
 {
     pc->CStdOut = stdout;
-    stdinValue = stdin;
-    stdoutValue = stdout;
-    stderrValue = stderr;
+    pc->StdinValue = stdin;
+    pc->StdoutValue = stdout;
+    pc->StderrValue = stderr;
 }
 
 /* output a single character to either a FILE * or a string */
@@ -483,7 +479,7 @@ void StdioPutc(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
 
 void StdioPutchar(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
-    ReturnValue->Val->Integer = putchar(Param[0]->Val->Integer);
+    ReturnValue->Val->Integer = putc(Param[0]->Val->Integer, Parser->pc->StdoutValue);
 }
 
 void StdioSetbuf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
@@ -503,12 +499,17 @@ void StdioUngetc(struct ParseState *Parser, struct Value *ReturnValue, struct Va
 
 void StdioPuts(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
-    ReturnValue->Val->Integer = puts(Param[0]->Val->Pointer);
+    FILE *Stream = Parser->pc->StdoutValue;
+
+    if (fputs(Param[0]->Val->Pointer, Stream) == EOF || putc('\n', Stream) == EOF)
+        ReturnValue->Val->Integer = EOF;
+    else
+        ReturnValue->Val->Integer = 1;
 }
 
 void StdioGets(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
-    ReturnValue->Val->Pointer = fgets(Param[0]->Val->Pointer, GETS_MAXValue, stdin);
+    ReturnValue->Val->Pointer = fgets(Param[0]->Val->Pointer, GETS_MAXValue, Parser->pc->StdinValue);
     if (ReturnValue->Val->Pointer != NULL)
     {
         char *EOLPos = strchr(Param[0]->Val->Pointer, '\n');
@@ -519,7 +520,7 @@ void StdioGets(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
 
 void StdioGetchar(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
-    ReturnValue->Val->Integer = getchar();
+    ReturnValue->Val->Integer = getc(Parser->pc->StdinValue);
 }
 
 void StdioPrintf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -528,12 +529,12 @@ void StdioPrintf(struct ParseState *Parser, struct Value *ReturnValue, struct Va
     
     PrintfArgs.Param = Param;
     PrintfArgs.NumArgs = NumArgs-1;
-    ReturnValue->Val->Integer = StdioBasePrintf(Parser, stdout, NULL, 0, Param[0]->Val->Pointer, &PrintfArgs);
+    ReturnValue->Val->Integer = StdioBasePrintf(Parser, Parser->pc->StdoutValue, NULL, 0, Param[0]->Val->Pointer, &PrintfArgs);
 }
 
 void StdioVprintf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = StdioBasePrintf(Parser, stdout, NULL, 0, Param[0]->Val->Pointer, Param[1]->Val->Pointer);
+    ReturnValue->Val->Integer = StdioBasePrintf(Parser, Parser->pc->StdoutValue, NULL, 0, Param[0]->Val->Pointer, Param[1]->Val->Pointer);
 }
 
 void StdioFprintf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -574,7 +575,7 @@ void StdioScanf(struct ParseState *Parser, struct Value *ReturnValue, struct Val
     
     ScanfArgs.Param = Param;
     ScanfArgs.NumArgs = NumArgs-1;
-    ReturnValue->Val->Integer = StdioBaseScanf(Parser, stdin, NULL, Param[0]->Val->Pointer, &ScanfArgs);
+    ReturnValue->Val->Integer = StdioBaseScanf(Parser, Parser->pc->StdinValue, NULL, Param[0]->Val->Pointer, &ScanfArgs);
 }
 
 void StdioFscanf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -607,7 +608,7 @@ void StdioVsnprintf(struct ParseState *Parser, struct Value *ReturnValue, struct
 
 void StdioVscanf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = StdioBaseScanf(Parser, stdin, NULL, Param[0]->Val->Pointer, Param[1]->Val->Pointer);
+    ReturnValue->Val->Integer = StdioBaseScanf(Parser, Parser->pc->StdinValue, NULL, Param[0]->Val->Pointer, Param[1]->Val->Pointer);
 }
 
 void StdioVfscanf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -708,9 +709,9 @@ void StdioSetupFunc(Picoc *pc)
     VariableDefinePlatformVar(pc, NULL, "GETS_MAX", &pc->IntType, (union AnyValue *)&GETS_MAXValue, FALSE);
     
     /* define stdin, stdout and stderr */
-    VariableDefinePlatformVar(pc, NULL, "stdin", FilePtrType, (union AnyValue *)&stdinValue, FALSE);
-    VariableDefinePlatformVar(pc, NULL, "stdout", FilePtrType, (union AnyValue *)&stdoutValue, FALSE);
-    VariableDefinePlatformVar(pc, NULL, "stderr", FilePtrType, (union AnyValue *)&stderrValue, FALSE);
+    VariableDefinePlatformVar(pc, NULL, "stdin", FilePtrType, (union AnyValue *)&pc->StdinValue, FALSE);
+    VariableDefinePlatformVar(pc, NULL, "stdout", FilePtrType, (union AnyValue *)&pc->StdoutValue, FALSE);
+    VariableDefinePlatformVar(pc, NULL, "stderr", FilePtrType, (union AnyValue *)&pc->StderrValue, FALSE);
 
     /* define NULL, TRUE and FALSE */
     if (!VariableDefined(pc, TableStrRegister(pc, "NULL")))
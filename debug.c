@@ -3,14 +3,28 @@
 #ifndef NO_DEBUGGER
 
 #include "interpreter.h"
+#include <signal.h>
 
 #define BREAKPOINT_HASH(p) ( ((unsigned long)(p)->FileName) ^ (((p)->Line << 16) | ((p)->CharacterPos << 16)) )
 
+/* how many times the user has pressed break. it's set from a signal handler, which can't
+ * tell which instance the user meant, so it's shared by every instance - each one breaks
+ * when it sees it change. one Ctrl-C breaks into every instance which is running with the
+ * debugger enabled, on whichever thread it's running */
+static volatile sig_atomic_t DebugBreakCount = 0;
+
 /* initialise the debugger by clearing the breakpoint table */
 void DebugInit(Picoc *pc)
 {
-    TableInitTable(&pc->BreakpointTable, &pc->BreakpointHashTable[0], BREAKPOINT_TABLE_SIZE, TRUE);
+    TableInitTable(pc, &pc->BreakpointTable, &pc->BreakpointHashTable[0], BREAKPOINT_TABLE_SIZE, TRUE);
     pc->BreakpointCount = 0;
+    pc->DebugBreakCount = DebugBreakCount;
+}
+
+/* the user has pressed break. safe to call from a signal handler */
+void DebugBreak()
+{
+    DebugBreakCount++;
 }
 
 /* free the contents of the breakpoint table */
@@ -24,7 +38,7 @@ void DebugCleanup(Picoc *pc)
     {
         for (Entry = pc->BreakpointHashTable[Count]; Entry != NULL; Entry = NextEntry)
         {
-            NextEntry = Entry->Next;
+            NextEntry = Entry->p.b.Next;
             HeapFreeMem(pc, Entry);
         }
     }
@@ -37,7 +51,7 @@ static struct TableEntry *DebugTableSearchBreakpoint(struct ParseState *Parser,
     Picoc *pc = Parser->pc;
     int HashValue = BREAKPOINT_HASH(Parser) % pc->BreakpointTable.Size;
     
-    for (Entry = pc->BreakpointHashTable[HashValue]; Entry != NULL; Entry = Entry->Next)
+    for (Entry = pc->BreakpointHashTable[HashValue]; Entry != NULL; Entry = Entry->p.b.Next)
     {
         if (Entry->p.b.FileName == Parser->FileName && Entry->p.b.Line == Parser->Line && Entry->p.b.CharacterPos == Parser->CharacterPos)
             return Entry;   /* found */
@@ -64,7 +78,7 @@ void DebugSetBreakpoint(struct ParseState *Parser)
         NewEntry->p.b.FileName = Parser->FileName;
         NewEntry->p.b.Line = Parser->Line;
         NewEntry->p.b.CharacterPos = Parser->CharacterPos;
-        NewEntry->Next = pc->BreakpointHashTable[AddAt];
+        NewEntry->p.b.Next = pc->BreakpointHashTable[AddAt];
         pc->BreakpointHashTable[AddAt] = NewEntry;
         pc->BreakpointCount++;
     }
@@ -77,12 +91,12 @@ int DebugClearBreakpoint(struct ParseState *Parser)
     Picoc *pc = Parser->pc;
     int HashValue = BREAKPOINT_HASH(Parser) % pc->BreakpointTable.Size;
     
-    for (EntryPtr = &pc->BreakpointHashTable[HashValue]; *EntryPtr != NULL; EntryPtr = &(*EntryPtr)->Next)
+    for (EntryPtr = &pc->BreakpointHashTable[HashValue]; *EntryPtr != NULL; EntryPtr = &(*EntryPtr)->p.b.Next)
     {
         struct TableEntry *DeleteEntry = *EntryPtr;
         if (DeleteEntry->p.b.FileName == Parser->FileName && DeleteEntry->p.b.Line == Parser->Line && DeleteEntry->p.b.CharacterPos == Parser->CharacterPos)
         {
-            *EntryPtr = DeleteEntry->Next;
+            *EntryPtr = DeleteEntry->p.b.Next;
             HeapFreeMem(pc, DeleteEntry);
             pc->BreakpointCount--;
 
@@ -101,11 +115,11 @@ void DebugCheckStatement(struct ParseState *Parser)
     Picoc *pc = Parser->pc;
     
     /* has the user manually pressed break? */
-    if (pc->DebugManualBreak)
+    if (pc->DebugBreakCount != DebugBreakCount)
     {
         PlatformPrintf(pc->CStdOut, "break\n");
         DoBreak = TRUE;
-        pc->DebugManualBreak = FALSE;
+        pc->DebugBreakCount = DebugBreakCount;
     }
     
     /* is this a breakpoint location? */
@@ -279,10 +279,9 @@ double ExpressionAssignFP(struct ParseState *Parser, struct Value *DestValue, do
 }
 #endif
 
-/* push a node on to the expression stack */
-void ExpressionStackPushValueNode(struct ParseState *Parser, struct ExpressionStack **StackTop, struct Value *ValueLoc)
+/* put a node for a value on top of the expression stack */
+static void ExpressionStackLinkNode(struct ParseState *Parser, struct ExpressionStack **StackTop, struct ExpressionStack *StackNode, struct Value *ValueLoc)
 {
-    struct ExpressionStack *StackNode = VariableAlloc(Parser->pc, Parser, sizeof(struct ExpressionStack), FALSE);
     StackNode->Next = *StackTop;
     StackNode->Val = ValueLoc;
     *StackTop = StackNode;
@@ -295,15 +294,52 @@ void ExpressionStackPushValueNode(struct ParseState *Parser, struct ExpressionSt
 #endif
 }
 
-/* push a blank value on to the expression stack by type */
-struct Value *ExpressionStackPushValueByType(struct ParseState *Parser, struct ExpressionStack **StackTop, struct ValueType *PushType)
+/* push a node on to the expression stack */
+void ExpressionStackPushValueNode(struct ParseState *Parser, struct ExpressionStack **StackTop, struct Value *ValueLoc)
 {
-    struct Value *ValueLoc = VariableAllocValueFromType(Parser->pc, Parser, PushType, FALSE, NULL, FALSE);
-    ExpressionStackPushValueNode(Parser, StackTop, ValueLoc);
+    ExpressionStackLinkNode(Parser, StackTop, VariableAlloc(Parser->pc, Parser, sizeof(struct ExpressionStack), FALSE), ValueLoc);
+}
+
+/* make a new value of ValueSize bytes and push it on to the expression stack. the value and 
+ * its node are allocated together, so each temporary takes one allocation rather than two. 
+ * they're laid out the same way as if they'd been allocated one after the other so they're 
+ * popped in the same way */
+static struct Value *ExpressionStackPushNew(struct ParseState *Parser, struct ExpressionStack **StackTop, int ValueSize)
+{
+    struct Value *ValueLoc = VariableAlloc(Parser->pc, Parser, MEM_ALIGN(ValueSize) + sizeof(struct ExpressionStack), FALSE);
     
+    ExpressionStackLinkNode(Parser, StackTop, (struct ExpressionStack *)((char *)ValueLoc + MEM_ALIGN(ValueSize)), ValueLoc);
     return ValueLoc;
 }
 
+/* push a value with DataSize bytes of its own data on to the expression stack */
+static struct Value *ExpressionStackPushData(struct ParseState *Parser, struct ExpressionStack **StackTop, struct ValueType *Typ, int DataSize)
+{
+    struct Value *ValueLoc = ExpressionStackPushNew(Parser, StackTop, MEM_ALIGN(sizeof(struct Value)) + DataSize);
+    
+    ValueLoc->Typ = Typ;
+    ValueLoc->Val = (union AnyValue *)((char *)ValueLoc + MEM_ALIGN(sizeof(struct Value)));
+    ValueLoc->Flags = FlagOnStack;
+    return ValueLoc;
+}
+
+/* push a value which uses some existing data on to the expression stack */
+static void ExpressionStackPushExisting(struct ParseState *Parser, struct ExpressionStack **StackTop, struct ValueType *Typ, union AnyValue *FromValue, int IsLValue, struct Value *LValueFrom)
+{
+    struct Value *ValueLoc = ExpressionStackPushNew(Parser, StackTop, sizeof(struct Value));
+    
+    ValueLoc->Typ = Typ;
+    ValueLoc->Val = FromValue;
+    ValueLoc->Flags = IsLValue ? FlagIsLValue : 0;
+    ValueLoc->LValueFrom = LValueFrom;
+}
+
+/* push a blank value on to the expression stack by type */
+struct Value *ExpressionStackPushValueByType(struct ParseState *Parser, struct ExpressionStack **StackTop, struct ValueType *PushType)
+{
+    return ExpressionStackPushData(Parser, StackTop, PushType, TypeSize(PushType, PushType->ArraySize, FALSE));
+}
+
 /* push a value on to the expression stack */
 void ExpressionStackPushValue(struct ParseState *Parser, struct ExpressionStack **StackTop, struct Value *PushValue)
 {
@@ -313,15 +349,12 @@ void ExpressionStackPushValue(struct ParseState *Parser, struct ExpressionStack
 
 void ExpressionStackPushLValue(struct ParseState *Parser, struct ExpressionStack **StackTop, struct Value *PushValue, int Offset)
 {
-    struct Value *ValueLoc = VariableAllocValueShared(Parser, PushValue);
-    ValueLoc->Val = (void *)((char *)ValueLoc->Val + Offset);
-    ExpressionStackPushValueNode(Parser, StackTop, ValueLoc);
+    ExpressionStackPushExisting(Parser, StackTop, PushValue->Typ, (union AnyValue *)((char *)PushValue->Val + Offset), (PushValue->Flags & FlagIsLValue), (PushValue->Flags & FlagIsLValue) ? PushValue : NULL);
 }
 
 void ExpressionStackPushDereference(struct ParseState *Parser, struct ExpressionStack **StackTop, struct Value *DereferenceValue)
 {
     struct Value *DerefVal;
-    struct Value *ValueLoc;
     int Offset;
     struct ValueType *DerefType;
     int DerefIsLValue;
@@ -329,23 +362,20 @@ void ExpressionStackPushDereference(struct ParseState *Parser, struct Expression
     if (DerefDataLoc == NULL)
         ProgramFail(Parser, "NULL pointer dereference");
 
-    ValueLoc = VariableAllocValueFromExistingData(Parser, DerefType, (union AnyValue *)DerefDataLoc, DerefIsLValue, DerefVal);
-    ExpressionStackPushValueNode(Parser, StackTop, ValueLoc);
+    ExpressionStackPushExisting(Parser, StackTop, DerefType, (union AnyValue *)DerefDataLoc, DerefIsLValue, DerefVal);
 }
 
 void ExpressionPushInt(struct ParseState *Parser, struct ExpressionStack **StackTop, long IntValue)
 {
-    struct Value *ValueLoc = VariableAllocValueFromType(Parser->pc, Parser, &Parser->pc->IntType, FALSE, NULL, FALSE);
+    struct Value *ValueLoc = ExpressionStackPushData(Parser, StackTop, &Parser->pc->IntType, sizeof(ALIGN_TYPE));
     ValueLoc->Val->Integer = IntValue;
-    ExpressionStackPushValueNode(Parser, StackTop, ValueLoc);
 }
 
 #ifndef NO_FP
 void ExpressionPushFP(struct ParseState *Parser, struct ExpressionStack **StackTop, double FPValue)
 {
-    struct Value *ValueLoc = VariableAllocValueFromType(Parser->pc, Parser, &Parser->pc->FPType, FALSE, NULL, FALSE);
+    struct Value *ValueLoc = ExpressionStackPushData(Parser, StackTop, &Parser->pc->FPType, sizeof(double));
     ValueLoc->Val->FP = FPValue;
-    ExpressionStackPushValueNode(Parser, StackTop, ValueLoc);
 }
 #endif
 
@@ -530,9 +560,8 @@ void ExpressionPrefixOperator(struct ParseState *Parser, struct ExpressionStack
                 ProgramFail(Parser, "can't get the address of this");
 
 	    ValPtr = TopValue->Val;
-            Result = VariableAllocValueFromType(Parser->pc, Parser, TypeGetMatching(Parser->pc, Parser, TopValue->Typ, TypePointer, 0, Parser->pc->StrEmpty, TRUE), FALSE, NULL, FALSE);
+            Result = ExpressionStackPushValueByType(Parser, StackTop, TypeGetMatching(Parser->pc, Parser, TopValue->Typ, TypePointer, 0, Parser->pc->StrEmpty, TRUE));
             Result->Val->Pointer = (void *)ValPtr;
-            ExpressionStackPushValueNode(Parser, StackTop, Result);
             break;
 
         case TokenAsterisk:
@@ -695,7 +724,6 @@ void ExpressionInfixOperator(struct ParseState *Parser, struct ExpressionStack *
     { 
         /* array index */
         int ArrayIndex;
-        struct Value *Result = NULL;
         
         if (!IS_NUMERIC_COERCIBLE(TopValue))
             ProgramFail(Parser, "array index must be an integer");
@@ -705,12 +733,10 @@ void ExpressionInfixOperator(struct ParseState *Parser, struct ExpressionStack *
         /* make the array element result */
         switch (BottomValue->Typ->Base)
         {
-            case TypeArray:   Result = VariableAllocValueFromExistingData(Parser, BottomValue->Typ->FromType, (union AnyValue *)(&BottomValue->Val->ArrayMem[0] + TypeSize(BottomValue->Typ, ArrayIndex, TRUE)), (BottomValue->Flags & FlagIsLValue), BottomValue->LValueFrom); break;
-            case TypePointer: Result = VariableAllocValueFromExistingData(Parser, BottomValue->Typ->FromType, (union AnyValue *)((char *)BottomValue->Val->Pointer + TypeSize(BottomValue->Typ->FromType, 0, TRUE) * ArrayIndex), (BottomValue->Flags & FlagIsLValue), BottomValue->LValueFrom); break;
+            case TypeArray:   ExpressionStackPushExisting(Parser, StackTop, BottomValue->Typ->FromType, (union AnyValue *)(&BottomValue->Val->ArrayMem[0] + TypeSize(BottomValue->Typ, ArrayIndex, TRUE)), (BottomValue->Flags & FlagIsLValue), BottomValue->LValueFrom); break;
+            case TypePointer: ExpressionStackPushExisting(Parser, StackTop, BottomValue->Typ->FromType, (union AnyValue *)((char *)BottomValue->Val->Pointer + TypeSize(BottomValue->Typ->FromType, 0, TRUE) * ArrayIndex), (BottomValue->Flags & FlagIsLValue), BottomValue->LValueFrom); break;
             default:          ProgramFail(Parser, "this %t is not an array", BottomValue->Typ);
         }
-        
-        ExpressionStackPushValueNode(Parser, StackTop, Result);
     }
     else if (Op == TokenQuestionMark)
         ExpressionQuestionMarkOperator(Parser, StackTop, TopValue, BottomValue);
@@ -1037,10 +1063,105 @@ void ExpressionStackPushOperator(struct ParseState *Parser, struct ExpressionSta
 #endif
 }
 
+/* hash a token position for the indexes kept on a function */
+#define EXPRESSION_POS_HASH(Pos, Size) ((int)(((uint32_t)(unsigned long)(Pos) * (uint32_t)0x9e3779b9UL) >> 16) & ((Size) - 1))
+
+#ifndef NO_MEMBER_CACHE
+/* the struct member which a '.' or '->' found the last time it was run */
+struct ExpressionMemberSite
+{
+    const unsigned char *Pos;       /* where the member name is, or NULL for an empty entry */
+    struct ValueType *StructType;   /* the struct or union it was found in */
+    char *Identifier;               /* the member name */
+    struct ValueType *MemberType;   /* the member's type and offset */
+    int Offset;
+};
+
+/* the struct member sites of a function, hashed by where they are */
+struct ExpressionMemberIndex
+{
+    int NumSites;
+    int HashSize;
+    struct ExpressionMemberSite *Site;
+};
+
+/* find the entry for a member name at Pos, or the empty entry it would go in */
+static struct ExpressionMemberSite *ExpressionFindMemberSite(struct ExpressionMemberIndex *Index, const unsigned char *Pos)
+{
+    int Hash = EXPRESSION_POS_HASH(Pos, Index->HashSize);
+    
+    while (Index->Site[Hash].Pos != NULL && Index->Site[Hash].Pos != Pos)
+        Hash = (Hash + 1) & (Index->HashSize - 1);
+    
+    return &Index->Site[Hash];
+}
+
+/* make a function's member site index with room for HashSize sites, moving any from the old one */
+static struct ExpressionMemberIndex *ExpressionNewMemberIndex(struct ParseState *Parser, struct ExpressionMemberIndex *Old, int HashSize)
+{
+    Picoc *pc = Parser->pc;
+    int Size = sizeof(struct ExpressionMemberIndex) + sizeof(struct ExpressionMemberSite) * HashSize;
+    struct ExpressionMemberIndex *Index = HeapAllocMem(pc, Size);
+    int Count;
+    
+    if (Index == NULL)
+        ProgramFail(Parser, "out of memory");
+    
+    HEAP_ALLOC_USE(pc, PicocHeapTables, Size);
+    Index->HashSize = HashSize;
+    Index->Site = (struct ExpressionMemberSite *)((char *)Index + sizeof(struct ExpressionMemberIndex));
+    if (Old != NULL)
+    {
+        Index->NumSites = Old->NumSites;
+        for (Count = 0; Count < Old->HashSize; Count++)
+        {
+            if (Old->Site[Count].Pos != NULL)
+                *ExpressionFindMemberSite(Index, Old->Site[Count].Pos) = Old->Site[Count];
+        }
+        
+        HeapFreeMem(pc, Old);
+    }
+    
+    return Index;
+}
+
+/* get the entry for the member name at Pos in the function we're running, adding it if it's 
+ * new. returns NULL if we're not in a function */
+static struct ExpressionMemberSite *ExpressionGetMemberSite(struct ParseState *Parser, const unsigned char *Pos)
+{
+    struct FuncDef *Func = (Parser->pc->TopStackFrame != NULL) ? Parser->pc->TopStackFrame->Func : NULL;
+    struct ExpressionMemberSite *Site;
+    
+    if (Func == NULL || Func->Body == NULL)
+        return NULL;
+    
+    if (Func->MemberSites == NULL)
+        Func->MemberSites = ExpressionNewMemberIndex(Parser, NULL, 8);
+    
+    Site = ExpressionFindMemberSite(Func->MemberSites, Pos);
+    if (Site->Pos == NULL)
+    {
+        if ((Func->MemberSites->NumSites + 1) * 2 > Func->MemberSites->HashSize)
+        {
+            Func->MemberSites = ExpressionNewMemberIndex(Parser, Func->MemberSites, Func->MemberSites->HashSize * 2);
+            Site = ExpressionFindMemberSite(Func->MemberSites, Pos);
+        }
+        
+        Site->Pos = Pos;
+        Func->MemberSites->NumSites++;
+    }
+    
+    return Site;
+}
+#endif
+
 /* do the '.' and '->' operators */
 void ExpressionGetStructElement(struct ParseState *Parser, struct ExpressionStack **StackTop, enum LexToken Token)
 {
     struct Value *Ident;
+#ifndef NO_MEMBER_CACHE
+    const unsigned char *MemberPos = Parser->Pos;
+#endif
     
     /* get the identifier following the '.' or '->' */
     if (LexGetToken(Parser, &Ident, TRUE) != TokenIdentifier)
@@ -1054,7 +1175,11 @@ void ExpressionGetStructElement(struct ParseState *Parser, struct ExpressionStac
         struct ValueType *StructType = ParamVal->Typ;
         char *DerefDataLoc = (char *)ParamVal->Val;
         struct Value *MemberValue = NULL;
-        struct Value *Result;
+        struct ValueType *MemberType;
+        int MemberOffset;
+#ifndef NO_MEMBER_CACHE
+        struct ExpressionMemberSite *Site;
+#endif
 
         /* if we're doing '->' dereference the struct pointer first */
         if (Token == TokenArrow)
@@ -1063,19 +1188,221 @@ void ExpressionGetStructElement(struct ParseState *Parser, struct ExpressionStac
         if (StructType->Base != TypeStruct && StructType->Base != TypeUnion)
             ProgramFail(Parser, "can't use '%s' on something that's not a struct or union %s : it's a %t", (Token == TokenDot) ? "." : "->", (Token == TokenArrow) ? "pointer" : "", ParamVal->Typ);
             
-        if (!TableGet(StructType->Members, Ident->Val->Identifier, &MemberValue, NULL, NULL, NULL))
-            ProgramFail(Parser, "doesn't have a member called '%s'", Ident->Val->Identifier);
+#ifndef NO_MEMBER_CACHE
+        /* this is usually the same member of the same struct as last time, so use where it was */
+        Site = ExpressionGetMemberSite(Parser, MemberPos);
+        if (Site != NULL && Site->StructType == StructType && Site->Identifier == Ident->Val->Identifier)
+        {
+            MemberType = Site->MemberType;
+            MemberOffset = Site->Offset;
+        }
+        else
+#endif
+        {
+            if (!TableGet(StructType->Members, Ident->Val->Identifier, &MemberValue, NULL, NULL, NULL))
+                ProgramFail(Parser, "doesn't have a member called '%s'", Ident->Val->Identifier);
+            
+            MemberType = MemberValue->Typ;
+            MemberOffset = MemberValue->Val->Integer;
+#ifndef NO_MEMBER_CACHE
+            if (Site != NULL)
+            {
+                Site->StructType = StructType;
+                Site->Identifier = Ident->Val->Identifier;
+                Site->MemberType = MemberType;
+                Site->Offset = MemberOffset;
+            }
+#endif
+        }
         
         /* pop the value - assume it'll still be there until we're done */
         HeapPopStack(Parser->pc, ParamVal, sizeof(struct ExpressionStack) + sizeof(struct Value) + TypeStackSizeValue(StructVal));
         *StackTop = (*StackTop)->Next;
         
         /* make the result value for this member only */
-        Result = VariableAllocValueFromExistingData(Parser, MemberValue->Typ, (void *)(DerefDataLoc + MemberValue->Val->Integer), TRUE, (StructVal != NULL) ? StructVal->LValueFrom : NULL);
-        ExpressionStackPushValueNode(Parser, StackTop, Result);
+        ExpressionStackPushExisting(Parser, StackTop, MemberType, (void *)(DerefDataLoc + MemberOffset), TRUE, (StructVal != NULL) ? StructVal->LValueFrom : NULL);
     }
 }
 
+#ifndef NO_FOLDING
+/* a constant expression in a function's body, which is worked out the first time it's run */
+struct ExpressionFold
+{
+    const unsigned char *Pos;       /* where the expression starts, or NULL for an empty entry */
+    const unsigned char *End;       /* where it ends, or NULL if it isn't constant */
+    short int Line;                 /* the line and column at the end */
+    short int CharacterPos;
+    int Value;                      /* its value */
+};
+
+/* the constant expressions of a function, hashed by where they start */
+struct ExpressionFoldIndex
+{
+    const unsigned char *BodyEnd;   /* the end of the function's tokens, so macro bodies aren't included */
+    int Generation;                 /* the GlobalGeneration the values were found in */
+    int NumFolds;
+    int HashSize;
+    struct ExpressionFold *Fold;
+};
+
+/* check whether a macro with no parameters has a constant int value, working it out the first 
+ * time it's used. only macros can be used in its body since they can't be hidden by a local */
+static int ExpressionFoldMacro(struct ParseState *Parser, struct MacroDef *MDef)
+{
+    struct ParseState MacroParser;
+    struct Value *MacroResult;
+    
+    if (MDef->FoldGeneration != Parser->pc->GlobalGeneration)
+        MDef->Folded = 0;
+    
+    if (MDef->Folded == 0)
+    {
+        MDef->Folded = -1;
+        MDef->FoldGeneration = Parser->pc->GlobalGeneration;
+        ParserCopy(&MacroParser, &MDef->Body);
+        if (MDef->NumParams == 0 && ParseIsConstantExpression(&MacroParser, TokenEndOfFunction, TRUE))
+        {
+            ParserCopy(&MacroParser, &MDef->Body);
+            MacroParser.Mode = RunModeRun;
+            if (ExpressionParse(&MacroParser, &MacroResult))
+            {
+                if (MacroResult->Typ == &Parser->pc->IntType)
+                {
+                    MDef->FoldedValue = MacroResult->Val->Integer;
+                    MDef->Folded = 1;
+                }
+                
+                VariableStackPop(Parser, MacroResult);
+            }
+        }
+    }
+    
+    return MDef->Folded > 0;
+}
+
+/* find the entry for an expression starting at Pos, or the empty entry it would go in */
+static struct ExpressionFold *ExpressionFindFold(struct ExpressionFoldIndex *Index, const unsigned char *Pos)
+{
+    int Hash = EXPRESSION_POS_HASH(Pos, Index->HashSize);
+    
+    while (Index->Fold[Hash].Pos != NULL && Index->Fold[Hash].Pos != Pos)
+        Hash = (Hash + 1) & (Index->HashSize - 1);
+    
+    return &Index->Fold[Hash];
+}
+
+/* make a function's constant expression index with room for HashSize expressions, moving 
+ * any from the old one */
+static struct ExpressionFoldIndex *ExpressionNewFoldIndex(struct ParseState *Parser, struct ExpressionFoldIndex *Old, int HashSize)
+{
+    Picoc *pc = Parser->pc;
+    int Size = sizeof(struct ExpressionFoldIndex) + sizeof(struct ExpressionFold) * HashSize;
+    struct ExpressionFoldIndex *Index = HeapAllocMem(pc, Size);
+    int Count;
+    
+    if (Index == NULL)
+        ProgramFail(Parser, "out of memory");
+    
+    HEAP_ALLOC_USE(pc, PicocHeapTables, Size);
+    Index->HashSize = HashSize;
+    Index->Fold = (struct ExpressionFold *)((char *)Index + sizeof(struct ExpressionFoldIndex));
+    if (Old != NULL)
+    {
+        Index->BodyEnd = Old->BodyEnd;
+        Index->Generation = Old->Generation;
+        Index->NumFolds = Old->NumFolds;
+        for (Count = 0; Count < Old->HashSize; Count++)
+        {
+            if (Old->Fold[Count].Pos != NULL)
+                *ExpressionFindFold(Index, Old->Fold[Count].Pos) = Old->Fold[Count];
+        }
+        
+        HeapFreeMem(pc, Old);
+    }
+    
+    return Index;
+}
+
+/* get the value of the constant expression starting at Parser in the function we're running. 
+ * it runs to the end of the expression it's in, like the right hand side of an assignment 
+ * or the inside of a pair of brackets. the first time it's run its value is worked out and 
+ * kept, or it's remembered as not being constant. returns NULL if it isn't constant */
+static struct ExpressionFold *ExpressionGetFold(struct ParseState *Parser)
+{
+    Picoc *pc = Parser->pc;
+    struct FuncDef *Func = (pc->TopStackFrame != NULL) ? pc->TopStackFrame->Func : NULL;
+    struct ExpressionFoldIndex *Index;
+    struct ExpressionFold *Fold;
+    struct ParseState ScanParser;
+    struct Value *Result;
+    enum LexToken Token;
+    
+    if (Func == NULL || Func->Body == NULL)
+        return NULL;
+    
+    if (Func->Folds == NULL)
+    {
+        Func->Folds = ExpressionNewFoldIndex(Parser, NULL, 16);
+        ParserCopy(&ScanParser, Func->Body);
+        while ((Token = LexGetRawToken(&ScanParser, NULL, TRUE)) != TokenEndOfFunction && Token != TokenEOF)
+        {}
+        
+        Func->Folds->BodyEnd = ScanParser.Pos;
+        Func->Folds->Generation = pc->GlobalGeneration;
+    }
+    
+    Index = Func->Folds;
+    if (Parser->Pos < Func->Body->Pos || Parser->Pos >= Index->BodyEnd)
+        return NULL;
+    
+    if (Index->Generation != pc->GlobalGeneration)
+    {
+        /* a name it used might have been deleted so work the values out again */
+        memset((void *)Index->Fold, '\0', sizeof(struct ExpressionFold) * Index->HashSize);
+        Index->NumFolds = 0;
+        Index->Generation = pc->GlobalGeneration;
+    }
+    
+    Fold = ExpressionFindFold(Index, Parser->Pos);
+    if (Fold->Pos != NULL)
+        return (Fold->End != NULL) ? Fold : NULL;
+    
+    if (Parser->Mode != RunModeRun)
+        return NULL;
+    
+    if ((Index->NumFolds + 1) * 2 > Index->HashSize)
+    {
+        Index = Func->Folds = ExpressionNewFoldIndex(Parser, Index, Index->HashSize * 2);
+        Fold = ExpressionFindFold(Index, Parser->Pos);
+    }
+    
+    /* add it as not constant first, so evaluating it doesn't come back here */
+    Fold->Pos = Parser->Pos;
+    Index->NumFolds++;
+    ParserCopy(&ScanParser, Parser);
+    if (!ParseIsConstantExpression(&ScanParser, TokenNone, FALSE))
+        return NULL;
+    
+    ParserCopy(&ScanParser, Parser);
+    ScanParser.Mode = RunModeRun;
+    if (!ExpressionParse(&ScanParser, &Result))
+        return NULL;
+    
+    /* the index might have grown while it was being evaluated */
+    Fold = ExpressionFindFold(Func->Folds, Parser->Pos);
+    if (Result->Typ == &pc->IntType)
+    {
+        Fold->End = ScanParser.Pos;
+        Fold->Line = ScanParser.Line;
+        Fold->CharacterPos = ScanParser.CharacterPos;
+        Fold->Value = Result->Val->Integer;
+    }
+    
+    VariableStackPop(Parser, Result);
+    return (Fold->End != NULL) ? Fold : NULL;
+}
+#endif
+
 /* parse an expression with operator precedence */
 int ExpressionParse(struct ParseState *Parser, struct Value **Result)
 {
@@ -1088,6 +1415,9 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
     int IgnorePrecedence = DEEP_PRECEDENCE;
     struct ExpressionStack *StackTop = NULL;
     int TernaryDepth = 0;
+#ifndef NO_FOLDING
+    int FoldStart = TRUE;       /* the next token starts an operand which runs to the end of the expression */
+#endif
     
     debugf("ExpressionParse():\n");
     do
@@ -1096,6 +1426,25 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
         enum LexToken Token;
 
         ParserCopy(&PreState, Parser);
+#ifndef NO_FOLDING
+        if (FoldStart)
+        {
+            /* if the rest of the expression is constant use the value it had the first time */
+            struct ExpressionFold *Fold = ExpressionGetFold(Parser);
+            
+            FoldStart = FALSE;
+            if (Fold != NULL)
+            {
+                Parser->Pos = Fold->End;
+                Parser->Line = Fold->Line;
+                Parser->CharacterPos = Fold->CharacterPos;
+                ExpressionPushInt(Parser, &StackTop, Fold->Value);
+                PrefixState = FALSE;
+                continue;
+            }
+        }
+        
+#endif
         Token = LexGetToken(Parser, &LexValue, TRUE);
         if ( ( ( (int)Token > TokenComma && (int)Token <= (int)TokenOpenBracket) || 
                (Token == TokenCloseBracket && BracketPrecedence != 0)) && 
@@ -1130,15 +1479,17 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
                         Precedence = BracketPrecedence + OperatorPrecedence[(int)TokenCast].PrefixPrecedence;
 
                         ExpressionStackCollapse(Parser, &StackTop, Precedence+1, &IgnorePrecedence);
-                        CastTypeValue = VariableAllocValueFromType(Parser->pc, Parser, &Parser->pc->TypeType, FALSE, NULL, FALSE);
+                        CastTypeValue = ExpressionStackPushValueByType(Parser, &StackTop, &Parser->pc->TypeType);
                         CastTypeValue->Val->Typ = CastType;
-                        ExpressionStackPushValueNode(Parser, &StackTop, CastTypeValue);
                         ExpressionStackPushOperator(Parser, &StackTop, OrderInfix, TokenCast, Precedence);
                     }
                     else
                     {
                         /* boost the bracket operator precedence */
                         BracketPrecedence += BRACKET_PRECEDENCE;
+#ifndef NO_FOLDING
+                        FoldStart = TRUE;
+#endif
                     }
                 }
                 else
@@ -1230,6 +1581,11 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
                             case TokenColon: TernaryDepth--; break;
                             default: break;
                         }
+
+#ifndef NO_FOLDING
+                        /* the right hand side of an assignment, '?', ':' or '[' is a whole expression */
+                        FoldStart = (Token <= TokenColon || Token == TokenLeftSquareBracket);
+#endif
                     }
 
                     /* treat an open square bracket as an infix array index operator followed by an open bracket */
@@ -1260,6 +1616,11 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
                     struct Value *VariableValue = NULL;
                     
                     VariableGet(Parser->pc, Parser, LexValue->Val->Identifier, &VariableValue);
+#ifndef NO_FOLDING
+                    if (VariableValue->Typ->Base == TypeMacro && ExpressionFoldMacro(Parser, &VariableValue->Val->MacroDef))
+                        ExpressionPushInt(Parser, &StackTop, VariableValue->Val->MacroDef.FoldedValue);
+                    else
+#endif
                     if (VariableValue->Typ->Base == TypeMacro)
                     {
                         /* evaluate a macro as a kind of simple subroutine */
@@ -1299,7 +1660,10 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
                 ProgramFail(Parser, "value not expected here");
                 
             PrefixState = FALSE;
-            ExpressionStackPushValue(Parser, &StackTop, LexValue);
+            if (LexValue->Typ == &Parser->pc->IntType)
+                ExpressionPushInt(Parser, &StackTop, LexValue->Val->Integer);
+            else
+                ExpressionStackPushValue(Parser, &StackTop, LexValue);
         }
         else if (IsTypeToken(Parser, Token, LexValue))
         {
@@ -1314,9 +1678,8 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
             PrefixState = FALSE;
             ParserCopy(Parser, &PreState);
             TypeParse(Parser, &Typ, &Identifier, NULL);
-            TypeValue = VariableAllocValueFromType(Parser->pc, Parser, &Parser->pc->TypeType, FALSE, NULL, FALSE);
+            TypeValue = ExpressionStackPushValueByType(Parser, &StackTop, &Parser->pc->TypeType);
             TypeValue->Val->Typ = Typ;
-            ExpressionStackPushValueNode(Parser, &StackTop, TypeValue);
         }
         else
         { 
@@ -1440,6 +1803,50 @@ void ExpressionParseMacroCall(struct ParseState *Parser, struct ExpressionStack
     }
 }
 
+/* run a function once its arguments have been evaluated */
+void ExpressionCallFunction(struct ParseState *Parser, struct Value *FuncValue, const char *FuncName, struct Value *ReturnValue, struct Value **ParamArray, int ArgCount)
+{
+    if (FuncValue->Val->FuncDef.Intrinsic == NULL)
+    { 
+        /* run a user-defined function */
+        struct ParseState FuncParser;
+        int Count;
+        
+        if (FuncValue->Val->FuncDef.Body == NULL)
+            ProgramFail(Parser, "'%s' is undefined", FuncName);
+
+#ifndef NO_BYTECODE
+        /* run the compiled version of the function if it can be compiled */
+        if (BytecodeRun(Parser, FuncValue, FuncName, ReturnValue, ParamArray))
+            return;
+#endif
+        
+        ParserCopy(&FuncParser, FuncValue->Val->FuncDef.Body);
+        VariableStackFrameAdd(Parser, FuncName, FuncValue->Val->FuncDef.Intrinsic ? FuncValue->Val->FuncDef.NumParams : 0);
+        Parser->pc->TopStackFrame->Func = &FuncValue->Val->FuncDef;
+        Parser->pc->TopStackFrame->NumParams = ArgCount;
+        Parser->pc->TopStackFrame->ReturnValue = ReturnValue;
+        if (FuncValue->Val->FuncDef.SlotMap != NULL)
+            VariableStackFrameSlots(Parser, FuncValue->Val->FuncDef.SlotMap);
+
+        for (Count = 0; Count < FuncValue->Val->FuncDef.NumParams; Count++)
+            VariableDefine(Parser->pc, Parser, FuncValue->Val->FuncDef.ParamName[Count], ParamArray[Count], NULL, TRUE);
+            
+        if (ParseStatement(&FuncParser, TRUE) != ParseResultOk)
+            ProgramFail(&FuncParser, "function body expected");
+        
+        if (FuncParser.Mode == RunModeRun && FuncValue->Val->FuncDef.ReturnType != &Parser->pc->VoidType)
+            ProgramFail(&FuncParser, "no value returned from a function returning %t", FuncValue->Val->FuncDef.ReturnType);
+
+        else if (FuncParser.Mode == RunModeGoto)
+            ProgramFail(&FuncParser, "couldn't find goto label '%s'", FuncParser.SearchGotoLabel);
+        
+        VariableStackFramePop(Parser);
+    }
+    else
+        FuncValue->Val->FuncDef.Intrinsic(Parser, ReturnValue, ParamArray, ArgCount);
+}
+
 /* do a function call */
 void ExpressionParseFunctionCall(struct ParseState *Parser, struct ExpressionStack **StackTop, const char *FuncName, int RunIt)
 {
@@ -1522,46 +1929,7 @@ void ExpressionParseFunctionCall(struct ParseState *Parser, struct ExpressionSta
         if (ArgCount < FuncValue->Val->FuncDef.NumParams)
             ProgramFail(Parser, "not enough arguments to '%s'", FuncName);
         
-        if (FuncValue->Val->FuncDef.Intrinsic == NULL)
-        { 
-            /* run a user-defined function */
-            struct ParseState FuncParser;
-            int Count;
-            int16_t OldScopeID = Parser->ScopeID;
-            
-            if (FuncValue->Val->FuncDef.Body == NULL)
-                ProgramFail(Parser, "'%s' is undefined", FuncName);
-            
-            ParserCopy(&FuncParser, FuncValue->Val->FuncDef.Body);
-            VariableStackFrameAdd(Parser, FuncName, FuncValue->Val->FuncDef.Intrinsic ? FuncValue->Val->FuncDef.NumParams : 0);
-            Parser->pc->TopStackFrame->NumParams = ArgCount;
-            Parser->pc->TopStackFrame->ReturnValue = ReturnValue;
-
-            /* Function parameters should not go out of scope */
-            Parser->ScopeID = -1;
-
-            for (Count = 0; Count < FuncValue->Val->FuncDef.NumParams; Count++)
-                VariableDefine(Parser->pc, Parser, FuncValue->Val->FuncDef.ParamName[Count], ParamArray[Count], NULL, TRUE);
-
-            Parser->ScopeID = OldScopeID;
-                
-            if (ParseStatement(&FuncParser, TRUE) != ParseResultOk)
-                ProgramFail(&FuncParser, "function body expected");
-            
-            if (RunIt)
-            {
-                if (FuncParser.Mode == RunModeRun && FuncValue->Val->FuncDef.ReturnType != &Parser->pc->VoidType)
-                    ProgramFail(&FuncParser, "no value returned from a function returning %t", FuncValue->Val->FuncDef.ReturnType);
-
-                else if (FuncParser.Mode == RunModeGoto)
-                    ProgramFail(&FuncParser, "couldn't find goto label '%s'", FuncParser.SearchGotoLabel);
-            }
-            
-            VariableStackFramePop(Parser);
-        }
-        else
-            FuncValue->Val->FuncDef.Intrinsic(Parser, ReturnValue, ParamArray, ArgCount);
-
+        ExpressionCallFunction(Parser, FuncValue, FuncName, ReturnValue, ParamArray, ArgCount);
         HeapPopStackFrame(Parser->pc);
     }
 
@@ -1,11 +1,28 @@
 /* picoc heap memory allocation. This is a complete (but small) memory
  * allocator for embedded systems which have no memory allocator. Alternatively
- * you can define USE_MALLOC_HEAP to use your system's own malloc() allocator */
+ * you can define USE_MALLOC_HEAP to use your system's own malloc() allocator,
+ * or USE_TLSF_HEAP for a segregated fit allocator which joins free blocks
+ * back together so long running programs don't fragment the heap */
  
 /* stack grows up from the bottom and heap grows down from the top of heap space */
+#include "picoc.h"
 #include "interpreter.h"
 
-#ifdef DEBUG_HEAP
+#ifdef USE_TLSF_HEAP
+#define HEAP_BLOCK_FREE 1                   /* in a block's size: this block is free */
+#define HEAP_BELOW_FREE 2                   /* the block below this one is free */
+#define HEAP_SIZE_MASK (~(unsigned int)(HEAP_BLOCK_FREE | HEAP_BELOW_FREE))
+#define HEAP_BLOCK_HEADER MEM_ALIGN(sizeof(unsigned int))
+#define HEAP_FOOTER_SIZE MEM_ALIGN(sizeof(unsigned int))
+#define HEAP_MIN_BLOCK (MEM_ALIGN(sizeof(struct HeapBlock)) + HEAP_FOOTER_SIZE)
+#define HEAP_SMALL_SIZE (HEAP_SL_COUNT * sizeof(ALIGN_TYPE))     /* smaller blocks have a size class for each size */
+
+#define HEAP_BLOCK_SIZE(Block) ((Block)->Size & HEAP_SIZE_MASK)
+#define HEAP_BLOCK_ABOVE(Block) ((struct HeapBlock *)((char *)(Block) + HEAP_BLOCK_SIZE(Block)))
+#define HEAP_BLOCK_FOOTER(Block) (*(unsigned int *)((char *)(Block) + HEAP_BLOCK_SIZE(Block) - HEAP_FOOTER_SIZE))
+#endif
+
+#if defined(DEBUG_HEAP) && !defined(USE_TLSF_HEAP)
 void ShowBigList(Picoc *pc)
 {
     struct AllocNode *LPos;
@@ -18,14 +35,27 @@ void ShowBigList(Picoc *pc)
 }
 #endif
 
-/* initialise the stack and heap storage */
-void HeapInit(Picoc *pc, int StackOrHeapSize)
+/* initialise the stack and heap storage. returns FALSE if there's no memory for them */
+int HeapInit(Picoc *pc, int StackOrHeapSize)
 {
     int Count;
     int AlignOffset = 0;
     
 #ifdef USE_MALLOC_STACK
-    pc->HeapMemory = malloc(StackOrHeapSize);
+    pc->HeapMemory = HeapGetMemory(StackOrHeapSize);
+#ifdef HEAP_MIN_SIZE
+    /* if there isn't that much to be had take what we can get */
+    while (pc->HeapMemory == NULL && StackOrHeapSize / 2 >= HEAP_MIN_SIZE)
+    {
+        StackOrHeapSize /= 2;
+        pc->HeapMemory = HeapGetMemory(StackOrHeapSize);
+    }
+#endif
+    
+    if (pc->HeapMemory == NULL)
+        return FALSE;
+    
+    pc->HeapMemorySize = StackOrHeapSize;
     pc->HeapBottom = NULL;                     /* the bottom of the (downward-growing) heap */
     pc->StackFrame = NULL;                     /* the current stack frame */
     pc->HeapStackTop = NULL;                          /* the top of the stack */
@@ -50,18 +80,69 @@ void HeapInit(Picoc *pc, int StackOrHeapSize)
     pc->HeapStackTop = &(pc->HeapMemory)[AlignOffset];
     *(void **)(pc->StackFrame) = NULL;
     pc->HeapBottom = &(pc->HeapMemory)[StackOrHeapSize-sizeof(ALIGN_TYPE)+AlignOffset];
+#ifdef USE_TLSF_HEAP
+    pc->HeapFlBitmap = 0;
+    for (Count = 0; Count < HEAP_FL_COUNT; Count++)
+    {
+        int SlCount;
+
+        pc->HeapSlBitmap[Count] = 0;
+        for (SlCount = 0; SlCount < HEAP_SL_COUNT; SlCount++)
+            pc->HeapFreeList[Count][SlCount] = NULL;
+    }
+
+    /* a block which is never freed marks the top of the heap so every block has one above it */
+    pc->HeapBottom = (void *)((char *)pc->HeapBottom - HEAP_BLOCK_HEADER);
+    ((struct HeapBlock *)pc->HeapBottom)->Size = 0;
+#else
     pc->FreeListBig = NULL;
     for (Count = 0; Count < FREELIST_BUCKETS; Count++)
         pc->FreeListBucket[Count] = NULL;
+#endif
+
+    pc->HeapStackBase = pc->HeapStackTop;
+    pc->HeapTop = pc->HeapBottom;
+    pc->HeapStackMax = pc->HeapStackTop;
+    pc->HeapBottomMin = pc->HeapBottom;
+    for (Count = 0; Count < PicocHeapUses; Count++)
+    {
+        pc->HeapAllocCount[Count] = 0;
+        pc->HeapAllocBytes[Count] = 0;
+    }
+    
+    return TRUE;
 }
 
 void HeapCleanup(Picoc *pc)
 {
 #ifdef USE_MALLOC_STACK
-    free(pc->HeapMemory);
+    HeapPutMemory(pc->HeapMemory, pc->HeapMemorySize);
 #endif
 }
 
+#ifdef USE_MALLOC_STACK
+/* get memory for the stack and heap. with mmap() it's only address space until it's used,
+ * so it can be big without costing anything */
+unsigned char *HeapGetMemory(int Size)
+{
+#ifdef USE_MMAP_STACK
+    return PlatformMapMemory(Size);
+#else
+    return malloc(Size);
+#endif
+}
+
+/* free the stack and heap's memory */
+void HeapPutMemory(unsigned char *Memory, int Size)
+{
+#ifdef USE_MMAP_STACK
+    PlatformUnmapMemory(Memory, Size);
+#else
+    free(Memory);
+#endif
+}
+#endif
+
 /* allocate some space on the stack, in the current stack frame
  * clears memory. can return NULL if out of stack space */
 void *HeapAllocStack(Picoc *pc, int Size)
@@ -75,6 +156,9 @@ void *HeapAllocStack(Picoc *pc, int Size)
         return NULL;
         
     pc->HeapStackTop = (void *)NewTop;
+    if (pc->HeapStackTop > pc->HeapStackMax)
+        pc->HeapStackMax = pc->HeapStackTop;
+        
     memset((void *)NewMem, '\0', Size);
     return NewMem;
 }
@@ -86,6 +170,8 @@ void HeapUnpopStack(Picoc *pc, int Size)
     printf("HeapUnpopStack(%ld) at 0x%lx\n", (unsigned long)MEM_ALIGN(Size), (unsigned long)pc->HeapStackTop);
 #endif
     pc->HeapStackTop = (void *)((char *)pc->HeapStackTop + MEM_ALIGN(Size));
+    if (pc->HeapStackTop > pc->HeapStackMax)
+        pc->HeapStackMax = pc->HeapStackTop;
 }
 
 /* free some space at the top of the stack */
@@ -113,6 +199,8 @@ void HeapPushStackFrame(Picoc *pc)
     *(void **)pc->HeapStackTop = pc->StackFrame;
     pc->StackFrame = pc->HeapStackTop;
     pc->HeapStackTop = (void *)((char *)pc->HeapStackTop + MEM_ALIGN(sizeof(ALIGN_TYPE)));
+    if (pc->HeapStackTop > pc->HeapStackMax)
+        pc->HeapStackMax = pc->HeapStackTop;
 }
 
 /* pop the current stack frame, freeing all memory in the frame. can return NULL */
@@ -131,12 +219,244 @@ int HeapPopStackFrame(Picoc *pc)
         return FALSE;
 }
 
-int memused = 0;
+#ifdef USE_TLSF_HEAP
+/* the heap is a two-level segregated fit allocator. free blocks are kept in lists by size
+ * class - a power of two range, split into HEAP_SL_COUNT classes - with a bitmap of which
+ * lists have blocks in them, so finding a block and freeing one both take constant time.
+ * freed blocks are joined with free blocks next to them so the heap doesn't fragment */
+
+/* the number of the lowest bit set */
+static int HeapLowestBit(unsigned int Bits)
+{
+#ifdef __GNUC__
+    return __builtin_ctz(Bits);
+#else
+    int Bit = 0;
+    
+    for (; (Bits & 1) == 0; Bits >>= 1)
+        Bit++;
+        
+    return Bit;
+#endif
+}
+
+/* the number of the highest bit set */
+static int HeapHighestBit(unsigned int Bits)
+{
+#ifdef __GNUC__
+    return sizeof(unsigned int) * 8 - 1 - __builtin_clz(Bits);
+#else
+    int Bit = 0;
+    
+    while (Bits >>= 1)
+        Bit++;
+        
+    return Bit;
+#endif
+}
+
+/* find the size class a block belongs in */
+static void HeapSizeClass(unsigned int Size, int *Fl, int *Sl)
+{
+    if (Size < HEAP_SMALL_SIZE)
+    {
+        *Fl = 0;
+        *Sl = Size / sizeof(ALIGN_TYPE);
+    }
+    else
+    {
+        int Bit = HeapHighestBit(Size);
+        
+        *Fl = Bit - HeapHighestBit(HEAP_SMALL_SIZE) + 1;
+        *Sl = (Size >> (Bit - HEAP_SL_LOG2)) - HEAP_SL_COUNT;
+    }
+}
+
+/* add a block to its free list */
+static void HeapAddFree(Picoc *pc, struct HeapBlock *Block)
+{
+    int Fl;
+    int Sl;
+    
+    HeapSizeClass(HEAP_BLOCK_SIZE(Block), &Fl, &Sl);
+    Block->PrevFree = NULL;
+    Block->NextFree = pc->HeapFreeList[Fl][Sl];
+    if (Block->NextFree != NULL)
+        Block->NextFree->PrevFree = Block;
+        
+    pc->HeapFreeList[Fl][Sl] = Block;
+    pc->HeapFlBitmap |= 1U << Fl;
+    pc->HeapSlBitmap[Fl] |= 1U << Sl;
+    
+    /* mark it free and leave its size at the end for the block above */
+    Block->Size |= HEAP_BLOCK_FREE;
+    HEAP_BLOCK_FOOTER(Block) = HEAP_BLOCK_SIZE(Block);
+    HEAP_BLOCK_ABOVE(Block)->Size |= HEAP_BELOW_FREE;
+}
+
+/* take a block off its free list */
+static void HeapRemoveFree(Picoc *pc, struct HeapBlock *Block)
+{
+    int Fl;
+    int Sl;
+    
+    HeapSizeClass(HEAP_BLOCK_SIZE(Block), &Fl, &Sl);
+    if (Block->PrevFree != NULL)
+        Block->PrevFree->NextFree = Block->NextFree;
+    else
+        pc->HeapFreeList[Fl][Sl] = Block->NextFree;
+        
+    if (Block->NextFree != NULL)
+        Block->NextFree->PrevFree = Block->PrevFree;
+        
+    if (pc->HeapFreeList[Fl][Sl] == NULL)
+    {
+        pc->HeapSlBitmap[Fl] &= ~(1U << Sl);
+        if (pc->HeapSlBitmap[Fl] == 0)
+            pc->HeapFlBitmap &= ~(1U << Fl);
+    }
+    
+    Block->Size &= ~HEAP_BLOCK_FREE;
+    HEAP_BLOCK_ABOVE(Block)->Size &= ~HEAP_BELOW_FREE;
+}
+
+/* find a free block at least this big, or NULL if there isn't one */
+static struct HeapBlock *HeapFindFree(Picoc *pc, unsigned int Size)
+{
+    unsigned int SlBitmap;
+    unsigned int FlBitmap;
+    int Fl;
+    int Sl;
+    
+    /* round up to the next size class so any block in the class we find is big enough */
+    if (Size >= HEAP_SMALL_SIZE)
+        Size += (1U << (HeapHighestBit(Size) - HEAP_SL_LOG2)) - 1;
+        
+    HeapSizeClass(Size, &Fl, &Sl);
+    if (Fl >= HEAP_FL_COUNT)
+        return NULL;
+        
+    SlBitmap = pc->HeapSlBitmap[Fl] & (~0U << Sl);
+    if (SlBitmap == 0)
+    {
+        /* nothing in this range - use the smallest class in a bigger range */
+        FlBitmap = (Fl + 1 < HEAP_FL_COUNT) ? (pc->HeapFlBitmap & (~0U << (Fl + 1))) : 0;
+        if (FlBitmap == 0)
+            return NULL;
+            
+        Fl = HeapLowestBit(FlBitmap);
+        SlBitmap = pc->HeapSlBitmap[Fl];
+    }
+    
+    return pc->HeapFreeList[Fl][HeapLowestBit(SlBitmap)];
+}
+
+/* allocate some dynamically allocated memory. memory is cleared. can return NULL if out of memory */
+void *HeapAllocMem(Picoc *pc, int Size)
+{
+    struct HeapBlock *NewMem;
+    unsigned int AllocSize = MEM_ALIGN(Size) + HEAP_BLOCK_HEADER;
+    unsigned int BlockSize;
+    void *ReturnMem;
+    
+    if (Size == 0)
+        return NULL;
+    
+    assert(Size > 0);
+    if (AllocSize < HEAP_MIN_BLOCK)
+        AllocSize = HEAP_MIN_BLOCK;
+        
+    NewMem = HeapFindFree(pc, AllocSize);
+    if (NewMem != NULL)
+    {
+        HeapRemoveFree(pc, NewMem);
+        BlockSize = HEAP_BLOCK_SIZE(NewMem);
+        if (BlockSize - AllocSize >= HEAP_MIN_BLOCK)
+        {
+            /* split it and free the part we don't need */
+            struct HeapBlock *Rest = (struct HeapBlock *)((char *)NewMem + AllocSize);
+            
+            Rest->Size = BlockSize - AllocSize;
+            NewMem->Size = AllocSize | (NewMem->Size & HEAP_BELOW_FREE);
+            HeapAddFree(pc, Rest);
+        }
+    }
+    else
+    {
+        /* nothing free is big enough - grow the heap down towards the stack */
+        if ((char *)pc->HeapBottom - AllocSize < (char *)pc->HeapStackTop)
+            return NULL;
+        
+        pc->HeapBottom = (void *)((char *)pc->HeapBottom - AllocSize);
+        if (pc->HeapBottom < pc->HeapBottomMin)
+            pc->HeapBottomMin = pc->HeapBottom;
+            
+        NewMem = pc->HeapBottom;
+        NewMem->Size = AllocSize;
+    }
+    
+    BlockSize = HEAP_BLOCK_SIZE(NewMem);
+    pc->HeapMemUsed += BlockSize;
+    pc->HeapAllocCount[PicocHeapOther]++;
+    pc->HeapAllocBytes[PicocHeapOther] += Size;
+    ReturnMem = (void *)((char *)NewMem + HEAP_BLOCK_HEADER);
+    memset(ReturnMem, '\0', BlockSize - HEAP_BLOCK_HEADER);
+#ifdef DEBUG_HEAP
+    printf("HeapAllocMem(%d) = 0x%lx\n", Size, (unsigned long)ReturnMem);
+#endif
+    return ReturnMem;
+}
+
+/* free some dynamically allocated memory */
+void HeapFreeMem(Picoc *pc, void *Mem)
+{
+    struct HeapBlock *Block;
+    struct HeapBlock *Above;
+    
+#ifdef DEBUG_HEAP
+    printf("HeapFreeMem(0x%lx)\n", (unsigned long)Mem);
+#endif
+    if (Mem == NULL)
+        return;
+        
+    Block = (struct HeapBlock *)((char *)Mem - HEAP_BLOCK_HEADER);
+    assert((void *)Block >= pc->HeapBottom && (void *)Block < pc->HeapTop);
+    assert(!(Block->Size & HEAP_BLOCK_FREE) && HEAP_BLOCK_SIZE(Block) >= HEAP_MIN_BLOCK);
+    pc->HeapMemUsed -= HEAP_BLOCK_SIZE(Block);
+    
+    /* join it with the free blocks either side of it */
+    Above = HEAP_BLOCK_ABOVE(Block);
+    if (Above->Size & HEAP_BLOCK_FREE)
+    {
+        HeapRemoveFree(pc, Above);
+        Block->Size += HEAP_BLOCK_SIZE(Above);
+    }
+    
+    if (Block->Size & HEAP_BELOW_FREE)
+    {
+        struct HeapBlock *Below = (struct HeapBlock *)((char *)Block - *(unsigned int *)((char *)Block - HEAP_FOOTER_SIZE));
+        
+        HeapRemoveFree(pc, Below);
+        Below->Size += HEAP_BLOCK_SIZE(Block);
+        Block = Below;
+    }
+    
+    if ((void *)Block == pc->HeapBottom)
+    {
+        /* it's at the bottom of the heap - give it back to the stack */
+        pc->HeapBottom = (void *)((char *)pc->HeapBottom + HEAP_BLOCK_SIZE(Block));
+    }
+    else
+        HeapAddFree(pc, Block);
+}
 
+#else
 /* allocate some dynamically allocated memory. memory is cleared. can return NULL if out of memory */
 void *HeapAllocMem(Picoc *pc, int Size)
 {
 #ifdef USE_MALLOC_HEAP
+    pc->HeapAllocCount[PicocHeapOther]++;
+    pc->HeapAllocBytes[PicocHeapOther] += Size;
     return calloc(Size, 1);
 #else
     struct AllocNode *NewMem = NULL;
@@ -154,7 +474,7 @@ void *HeapAllocMem(Picoc *pc, int Size)
     if (AllocSize < sizeof(struct AllocNode))
         AllocSize = sizeof(struct AllocNode);
 
-    memused += AllocSize;
+    pc->HeapMemUsed += AllocSize;
 
     Bucket = AllocSize >> 2;
     if (Bucket < FREELIST_BUCKETS && pc->FreeListBucket[Bucket] != NULL)
@@ -213,10 +533,15 @@ void *HeapAllocMem(Picoc *pc, int Size)
             return NULL;
         
         pc->HeapBottom = (void *)((char *)pc->HeapBottom - AllocSize);
+        if (pc->HeapBottom < pc->HeapBottomMin)
+            pc->HeapBottomMin = pc->HeapBottom;
+            
         NewMem = pc->HeapBottom;
         NewMem->Size = AllocSize;
     }
     
+    pc->HeapAllocCount[PicocHeapOther]++;
+    pc->HeapAllocBytes[PicocHeapOther] += Size;
     ReturnMem = (void *)((char *)NewMem + MEM_ALIGN(sizeof(NewMem->Size)));
     memset(ReturnMem, '\0', AllocSize - MEM_ALIGN(sizeof(NewMem->Size)));
 #ifdef DEBUG_HEAP
@@ -243,7 +568,7 @@ void HeapFreeMem(Picoc *pc, void *Mem)
     if (Mem == NULL)
         return;
     
-    memused -= MemNode->Size;
+    pc->HeapMemUsed -= MemNode->Size;
 
     if ((void *)MemNode == pc->HeapBottom)
     { 
@@ -281,4 +606,79 @@ void HeapFreeMem(Picoc *pc, void *Mem)
     }
 #endif
 }
+#endif
+
+#ifndef USE_MALLOC_HEAP
+/* the number of bytes which can be used in a block from HeapAllocMem() */
+int HeapMemSize(void *Mem)
+{
+#ifdef USE_TLSF_HEAP
+    return HEAP_BLOCK_SIZE((struct HeapBlock *)((char *)Mem - HEAP_BLOCK_HEADER)) - HEAP_BLOCK_HEADER;
+#else
+    struct AllocNode *MemNode = (struct AllocNode *)((char *)Mem - MEM_ALIGN(sizeof(MemNode->Size)));
+    
+    return MemNode->Size - MEM_ALIGN(sizeof(MemNode->Size));
+#endif
+}
+#endif
+
+/* add a free block to the statistics */
+static void HeapStatsFreeBlock(struct PicocHeapStats *Stats, int Size)
+{
+    int Range = 0;
+    
+    while (Range < PICOC_HEAP_RANGES-1 && (Size >> (Range+1)) != 0)
+        Range++;
+        
+    Stats->HeapFree += Size;
+    Stats->FreeBlocks++;
+    Stats->FreeBytes[Range] += Size;
+    if (Size > Stats->LargestFreeBlock)
+        Stats->LargestFreeBlock = Size;
+}
 
+/* fill in statistics about how the stack and the heap are being used */
+void PicocHeapStats(Picoc *pc, struct PicocHeapStats *Stats)
+{
+    int Count;
+#ifdef USE_TLSF_HEAP
+    int SlCount;
+    struct HeapBlock *Block;
+#elif !defined(USE_MALLOC_HEAP)
+    struct AllocNode *Node;
+#endif
+    
+    memset((void *)Stats, '\0', sizeof(*Stats));
+    Stats->Size = (char *)pc->HeapTop - (char *)pc->HeapStackBase;
+    Stats->StackUsed = (char *)pc->HeapStackTop - (char *)pc->HeapStackBase;
+    Stats->StackHighWater = (char *)pc->HeapStackMax - (char *)pc->HeapStackBase;
+    Stats->HeapSize = (char *)pc->HeapTop - (char *)pc->HeapBottom;
+    Stats->HeapHighWater = (char *)pc->HeapTop - (char *)pc->HeapBottomMin;
+    Stats->HeapUsed = pc->HeapMemUsed;
+    Stats->Unused = (char *)pc->HeapBottom - (char *)pc->HeapStackTop;
+    for (Count = 0; Count < PicocHeapUses; Count++)
+    {
+        Stats->Allocations[Count] = pc->HeapAllocCount[Count];
+        Stats->AllocatedBytes[Count] = pc->HeapAllocBytes[Count];
+    }
+    
+#ifdef USE_TLSF_HEAP
+    for (Count = 0; Count < HEAP_FL_COUNT; Count++)
+    {
+        for (SlCount = 0; SlCount < HEAP_SL_COUNT; SlCount++)
+        {
+            for (Block = pc->HeapFreeList[Count][SlCount]; Block != NULL; Block = Block->NextFree)
+                HeapStatsFreeBlock(Stats, HEAP_BLOCK_SIZE(Block));
+        }
+    }
+#elif !defined(USE_MALLOC_HEAP)
+    for (Count = 0; Count < FREELIST_BUCKETS; Count++)
+    {
+        for (Node = pc->FreeListBucket[Count]; Node != NULL; Node = *(struct AllocNode **)Node)
+            HeapStatsFreeBlock(Stats, Count << 2);
+    }
+    
+    for (Node = pc->FreeListBig; Node != NULL; Node = Node->NextFree)
+        HeapStatsFreeBlock(Stats, Node->Size);
+#endif
+}
@@ -57,6 +57,13 @@ typedef FILE IOFILE;
 
 struct Table;
 struct Picoc_Struct;
+struct Bytecode;
+struct VariableSlotMap;
+struct ParseSwitch;
+struct ParseGotoIndex;
+struct ParseLoop;
+struct ExpressionFoldIndex;
+struct ExpressionMemberIndex;
 
 typedef struct Picoc_Struct Picoc;
 
@@ -116,6 +123,40 @@ struct AllocNode
     struct AllocNode *NextFree;
 };
 
+/* a block in the two-level segregated fit heap. the size includes the header and its low
+ * bits say whether this block and the one below it are free. a free block also has its
+ * size in its last word so the block above can find its start */
+struct HeapBlock
+{
+    unsigned int Size;
+    struct HeapBlock *NextFree;             /* only used while the block's free */
+    struct HeapBlock *PrevFree;
+};
+
+/* what the heap's allocations are for, counted for PicocHeapStats() */
+enum PicocHeapUse
+{
+    PicocHeapValues,            /* variables and their values */
+    PicocHeapTokens,            /* tokenised source code */
+    PicocHeapTables,            /* symbol table entries and identifiers */
+    PicocHeapTypes,             /* types and their struct members */
+    PicocHeapOther,             /* everything else */
+    PicocHeapUses
+};
+
+/* the address pointers into the heap are hashed relative to, so they hash the same if the
+ * instance is moved by PicocRestore() */
+#ifdef USE_MALLOC_STACK
+#define HEAP_HASH_BASE(pc) ((void *)(pc)->HeapMemory)
+#else
+#define HEAP_HASH_BASE(pc) ((void *)(pc))
+#endif
+
+/* HeapAllocMem() counts every allocation as PicocHeapOther. this moves one which is for
+ * something else to where it belongs. Size must be the size asked of HeapAllocMem() */
+#define HEAP_ALLOC_USE(pc, Use, Size) ((pc)->HeapAllocCount[Use]++, (pc)->HeapAllocBytes[Use] += (Size), \
+        (pc)->HeapAllocCount[PicocHeapOther]--, (pc)->HeapAllocBytes[PicocHeapOther] -= (Size))
+
 /* whether we're running or skipping code */
 enum RunMode
 {
@@ -144,7 +185,6 @@ struct ParseState
     short int HashIfLevel;      /* how many "if"s we're nested down */
     short int HashIfEvaluateToLevel;    /* if we're not evaluating an if branch, what the last evaluated level was */
     char DebugMode;             /* debugging mode */
-    int16_t ScopeID;            /* for keeping track of local variables (free them after they go out of scope) */
 };
 
 /* values */
@@ -198,6 +238,20 @@ struct FuncDef
     char **ParamName;               /* array of parameter names */
     void (*Intrinsic)();            /* intrinsic call address or NULL */
     struct ParseState *Body;        /* lexical tokens of the function body if not intrinsic (otherwise NULL) */
+    struct VariableSlotMap *SlotMap;    /* stack frame slots for the names used in the body, or NULL */
+    struct ParseSwitch *Switches;   /* the case labels of the switch statements which have been run */
+    struct ParseGotoIndex *Gotos;   /* the goto labels, or NULL if no goto has been run */
+#ifndef NO_FOLDING
+    struct ExpressionFoldIndex *Folds;  /* the values of the constant expressions which have been run, or NULL */
+#endif
+#ifndef NO_MEMBER_CACHE
+    struct ExpressionMemberIndex *MemberSites;  /* where the struct members used in the body were found, or NULL */
+#endif
+#ifndef NO_BYTECODE
+    struct Bytecode *Bytecode;      /* the compiled function body or NULL */
+    int8_t NotCompilable;           /* the body can't be compiled so don't try again */
+    struct ParseLoop *Loops;        /* the compiled conditions and increments of its loops */
+#endif
 };
 
 /* macro definition */
@@ -206,6 +260,11 @@ struct MacroDef
     int8_t NumParams;                  /* the number of parameters */
     char **ParamName;               /* array of parameter names */
     struct ParseState Body;         /* lexical tokens of the function body if not intrinsic */
+#ifndef NO_FOLDING
+    int8_t Folded;                  /* 1 if FoldedValue is the body's value, -1 if it isn't constant, 0 if we don't know yet */
+    int FoldedValue;                /* the value of a constant body */
+    int FoldGeneration;             /* the GlobalGeneration FoldedValue was found in */
+#endif
 };
 
 /* values */
@@ -236,7 +295,7 @@ struct Value
     union AnyValue *Val;            /* pointer to the AnyValue which holds the actual content */
     struct Value *LValueFrom;       /* if an LValue, this is a Value our LValue is contained within (or NULL) */
     enum ValueFlags Flags;
-    int16_t ScopeID;                    /* to know when it goes out of scope */
+    int16_t ScopeDepth;             /* how deeply nested the block it was declared in is, to know when it goes out of scope */
 };
 
 /* Used to disable usage of DeclFileName, DeclLine and DeclColumn from TableEntry (doesn't seem to be necessary) */
@@ -245,7 +304,6 @@ struct Value
 /* hash table data structure */
 struct TableEntry
 {
-    struct TableEntry *Next;        /* next item in this hash chain */
 #ifndef DISABLE_TABLEENTRY_DECL
     const char *DeclFileName;       /* where the variable was declared */
     unsigned short DeclLine;
@@ -258,12 +316,21 @@ struct TableEntry
         {
             char *Key;              /* points to the shared string table */
             struct Value *Val;      /* the value we're storing */
+            struct TableEntry *NextInScope;     /* the variable declared before this one in an enclosing block */
+            const unsigned char *DeclPos;       /* where the variable was declared, to reuse it when the block is entered again */
         } v;                        /* used for tables of values */
         
-        char Key[1];                /* dummy size - used for the shared string table */
+        struct StringEntry          /* used for the shared string table */
+        {
+            uint32_t Hash;          /* the hash of the string, to skip comparing most strings which don't match */
+            int Len;                /* the length of the string */
+            int Index;              /* its number in StringIndex, or -1 if tokens haven't used it yet */
+            char Key[1];            /* dummy size - the string follows */
+        } s;
         
         struct BreakpointEntry      /* defines a breakpoint */
         {
+            struct TableEntry *Next;    /* next breakpoint in this hash chain */
             const char *FileName;
             short int Line;
             short int CharacterPos;
@@ -274,22 +341,58 @@ struct TableEntry
     
 struct Table
 {
-    short Size;
-    short OnHeap;
+    int Size;                           /* the number of slots, a power of two */
+    int Count;                          /* the number of entries */
+    short Shift;                        /* how far to shift a mixed 32 bit hash to get a slot */
+    char OnHeap;
+    char Grown;                         /* the slots have been allocated on the heap */
     struct TableEntry **HashTable;
+    void *HashBase;                     /* keys are hashed by their address relative to this */
 };
 
+/* a variable which is out of scope is kept under its name with the low bit set. it won't
+ * be found by normal searches but it's still stored where its name hashes to */
+#define TABLE_HIDDEN_KEY(k) ((char *)((intptr_t)(k) | 1))
+#define TABLE_VISIBLE_KEY(k) ((char *)((intptr_t)(k) & ~(intptr_t)1))
+
+/* maps the names used in a function body to slots in its stack frames */
+struct VariableSlotMap
+{
+    short NumSlots;                 /* the number of slots each stack frame needs */
+    short HashSize;                 /* the size of the collision-free hash of names */
+    const char **Name;              /* the name in each slot */
+    unsigned char *Index;           /* the slot for each hash position, or VARIABLE_NO_SLOT */
+};
+
+#define VARIABLE_NO_SLOT 0xff
+#define VARIABLE_SLOTS_MAX 64       /* most names a function can use and still have a slot map */
+#define BYTECODE_EXPRESSION_VARS 8  /* most variables a compiled loop condition and increment can use */
+
 /* stack frame for function calls */
+/* the variables declared in the blocks we're inside, most recent first */
+struct VariableScope
+{
+    struct TableEntry *Variables;
+    int Depth;                      /* how many blocks we're nested down */
+};
+
 struct StackFrame
 {
     struct ParseState ReturnParser;         /* how we got here */
     const char *FuncName;                   /* the name of the function we're in */
+    struct FuncDef *Func;                   /* the function we're in, or NULL for a macro */
     struct Value *ReturnValue;              /* copy the return value here */
     struct Value **Parameter;               /* array of parameter values */
     int8_t NumParams;                          /* the number of parameters */
     struct Table LocalTable;                /* the local variables and parameters */
     struct TableEntry *LocalHashTable[LOCAL_TABLE_SIZE];
+    struct VariableSlotMap *SlotMap;        /* which names have slots in this frame, or NULL */
+    struct Value **Slot;                    /* the local variable in each slot, or NULL if there isn't one yet */
+    struct VariableScope Scope;             /* the variables declared in the blocks we're inside */
     struct StackFrame *PreviousStackFrame;  /* the next lower stack frame */
+#ifndef NO_PROFILER
+    struct ProfileNode *ProfileNode;        /* where this call is in the profile's calling tree */
+#endif
 };
 
 /* lexer state */
@@ -352,6 +455,9 @@ struct CleanupTokenNode
     struct CleanupTokenNode *Next;
 };
 
+/* saved token images start with this - see LexImageCreate() */
+#define LEX_IMAGE_MAGIC "picotok"
+
 /* linked list of lexical tokens used in interactive mode */
 struct TokenLine
 {
@@ -373,7 +479,10 @@ struct IncludeLibrary
 
 #define FREELIST_BUCKETS 8                          /* freelists for 4, 8, 12 ... 32 byte allocs */
 #define SPLIT_MEM_THRESHOLD 16                      /* don't split memory which is close in size */
-#define BREAKPOINT_TABLE_SIZE 21
+#define HEAP_SL_LOG2 3                              /* each power of two size range is split into 8 size classes */
+#define HEAP_SL_COUNT (1 << HEAP_SL_LOG2)
+#define HEAP_FL_COUNT 26                            /* the number of power of two size ranges */
+#define BREAKPOINT_TABLE_SIZE 16
 
 
 /* the entire state of the picoc system */
@@ -383,6 +492,7 @@ struct Picoc_Struct
     struct Table GlobalTable;
     struct CleanupTokenNode *CleanupTokenList;
     struct TableEntry *GlobalHashTable[GLOBAL_TABLE_SIZE];
+    struct VariableScope GlobalScope;
     
     /* lexer global data */
     struct TokenLine *InteractiveHead;
@@ -391,8 +501,6 @@ struct Picoc_Struct
     int LexUseStatementPrompt;
     union AnyValue LexAnyValue;
     struct Value LexValue;
-    struct Table ReservedWordTable;
-    struct TableEntry *ReservedWordHashTable[RESERVED_WORD_TABLE_SIZE];
 
     /* the table of string literal values */
     struct Table StringLiteralTable;
@@ -410,6 +518,7 @@ struct Picoc_Struct
     /* heap memory */
 #ifdef USE_MALLOC_STACK
     unsigned char *HeapMemory;          /* stack memory since our heap is malloc()ed */
+    int HeapMemorySize;
     void *HeapBottom;                   /* the bottom of the (downward-growing) heap */
     void *StackFrame;                   /* the current stack frame */
     void *HeapStackTop;                 /* the top of the stack */
@@ -428,8 +537,22 @@ struct Picoc_Struct
 # endif
 #endif
 
+#ifdef USE_TLSF_HEAP
+    unsigned int HeapFlBitmap;                                  /* which size ranges have free blocks */
+    unsigned int HeapSlBitmap[HEAP_FL_COUNT];                   /* which size classes in each range have free blocks */
+    struct HeapBlock *HeapFreeList[HEAP_FL_COUNT][HEAP_SL_COUNT];   /* the free blocks in each size class */
+#else
     struct AllocNode *FreeListBucket[FREELIST_BUCKETS];      /* we keep a pool of freelist buckets to reduce fragmentation */
     struct AllocNode *FreeListBig;                           /* free memory which doesn't fit in a bucket */
+#endif
+    int HeapMemUsed;                    /* bytes allocated from the heap */
+    int VariableMemUsed;                /* bytes of that allocated for variables */
+    void *HeapStackBase;                /* the bottom of the stack */
+    void *HeapTop;                      /* the top of the heap */
+    void *HeapStackMax;                 /* the highest the stack top has been */
+    void *HeapBottomMin;                /* the lowest the heap bottom has been */
+    long HeapAllocCount[PicocHeapUses]; /* heap allocations by what they're for */
+    long HeapAllocBytes[PicocHeapUses];
 
     /* types */    
     struct ValueType UberType;
@@ -454,12 +577,31 @@ struct Picoc_Struct
     struct ValueType *CharPtrPtrType;
     struct ValueType *CharArrayType;
     struct ValueType *VoidPtrType;
+    int IntAlignBytes;
+    int PointerAlignBytes;
+    char StructTempName[7];             /* the last name made up for an anonymous struct */
+    char EnumTempName[7];               /* and for an anonymous enum */
 
     /* debugger */
     struct Table BreakpointTable;
     struct TableEntry *BreakpointHashTable[BREAKPOINT_TABLE_SIZE];
     int BreakpointCount;
-    int DebugManualBreak;
+    int DebugBreakCount;                /* how many breaks we've seen - see DebugBreak() */
+
+    /* statement budget */
+    int StatementBudget;                /* statements to run before stopping or yielding, 0 for no limit */
+    unsigned int StatementsLeft;        /* counts down to zero, see ParseStatementBudget() */
+#ifndef NO_TIME_SLICE
+    void *Slice;                        /* the time slice we're running in, NULL if we aren't */
+#endif
+
+    /* profiler */
+#ifndef NO_PROFILER
+    struct Profile *Profile;            /* what's been collected, or NULL */
+    int Profiling;                      /* TRUE while we're collecting */
+    volatile sig_atomic_t ProfileTicks; /* counted by ProfileTick() from this instance's timer */
+    void *ProfileTimer;                 /* the platform's timer for this instance, or NULL */
+#endif
     
     /* C library */
     int BigEndian;
@@ -467,6 +609,12 @@ struct Picoc_Struct
 
     IOFILE *CStdOut;
     IOFILE CStdOutBase;
+#ifndef BUILTIN_MINI_STDLIB
+    FILE *StdinValue;                   /* the program's stdin, stdout and stderr */
+    FILE *StdoutValue;
+    FILE *StderrValue;
+    struct Value *ErrnoValue;           /* the program's errno once errno.h is included, see StdErrnoBind() */
+#endif
 
     /* the picoc version string */
     const char *VersionString;
@@ -483,16 +631,27 @@ struct Picoc_Struct
     struct Table StringTable;
     struct TableEntry *StringHashTable[STRING_TABLE_SIZE];
     char *StrEmpty;
+    char **StringIndex;                 /* the strings used by tokens, which refer to them by number */
+    int StringIndexUsed;
+    int StringIndexSize;
+
+    /* changes when globals are deleted so old compiled code and constant values aren't used */
+    int GlobalGeneration;
 };
 
 /* table.c */
 void TableInit(Picoc *pc);
 char *TableStrRegister(Picoc *pc, const char *Str);
 char *TableStrRegister2(Picoc *pc, const char *Str, int Len);
-void TableInitTable(struct Table *Tbl, struct TableEntry **HashTable, int Size, int OnHeap);
+void TableStrRegisterList(Picoc *pc, const char **Strs, int NumStrs, char **Registered);
+int TableStrIndex(Picoc *pc, const char *Str);
+void TableInitTable(Picoc *pc, struct Table *Tbl, struct TableEntry **HashTable, int Size, int OnHeap);
 int TableSet(Picoc *pc, struct Table *Tbl, char *Key, struct Value *Val, const char *DeclFileName, int DeclLine, int DeclColumn);
 int TableGet(struct Table *Tbl, const char *Key, struct Value **Val, const char **DeclFileName, int *DeclLine, int *DeclColumn);
 struct Value *TableDelete(Picoc *pc, struct Table *Tbl, const char *Key);
+struct TableEntry *TableFindNext(struct Table *Tbl, const char *Key, int *Pos);
+struct TableEntry *TableNext(struct Table *Tbl, int *Pos);
+void TableFree(Picoc *pc, struct Table *Tbl);
 char *TableSetIdentifier(Picoc *pc, struct Table *Tbl, const char *Ident, int IdentLen);
 void TableStrFree(Picoc *pc);
 
@@ -500,8 +659,13 @@ void TableStrFree(Picoc *pc);
 void LexInit(Picoc *pc);
 void LexCleanup(Picoc *pc);
 void *LexAnalyse(Picoc *pc, const char *FileName, const char *Source, int SourceLen, int *TokenLen);
+#ifndef NO_TOKEN_IMAGE
+void *LexImageCreate(Picoc *pc, const char *FileName, const void *Tokens, int TokenLen, int *ImageLen);
+void *LexImageLoad(Picoc *pc, const void *Image, int ImageLen, char **FileName);
+#endif
 void LexInitParser(struct ParseState *Parser, Picoc *pc, const char *SourceText, void *TokenSource, char *FileName, void *FilePointer, int RunIt, int SetDebugMode);
 enum LexToken LexGetToken(struct ParseState *Parser, struct Value **Value, int IncPos);
+enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value, int IncPos);
 enum LexToken LexRawPeekToken(struct ParseState *Parser);
 void LexToEndOfLine(struct ParseState *Parser);
 void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser);
@@ -515,14 +679,18 @@ void LexInteractiveStatementPrompt(Picoc *pc);
  * void PicocParseInteractive(); */
 void PicocParseInteractiveNoStartPrompt(Picoc *pc, int EnableDebugger);
 enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemicolon);
+void ParseStatementBudget(struct ParseState *Parser);
 struct Value *ParseFunctionDefinition(struct ParseState *Parser, struct ValueType *ReturnType, char *Identifier);
 void ParseCleanup(Picoc *pc);
 void ParserCopyPos(struct ParseState *To, struct ParseState *From);
 void ParserCopy(struct ParseState *To, struct ParseState *From);
+void ParseFreeIndexes(Picoc *pc, struct FuncDef *Def);
+int ParseIsConstantExpression(struct ParseState *Parser, enum LexToken EndToken, int MacrosOnly);
 
 /* expression.c */
 int ExpressionParse(struct ParseState *Parser, struct Value **Result);
 long ExpressionParseInt(struct ParseState *Parser);
+void ExpressionCallFunction(struct ParseState *Parser, struct Value *FuncValue, const char *FuncName, struct Value *ReturnValue, struct Value **ParamArray, int ArgCount);
 void ExpressionAssign(struct ParseState *Parser, struct Value *DestValue, struct Value *SourceValue, int Force, const char *FuncName, int ParamNo, int AllowPointerCoercion);
 long ExpressionCoerceInteger(struct Value *Val);
 unsigned long ExpressionCoerceUnsignedInteger(struct Value *Val);
@@ -545,8 +713,12 @@ struct ValueType *TypeCreateOpaqueStruct(Picoc *pc, struct ParseState *Parser, c
 int TypeIsForwardDeclared(struct ParseState *Parser, struct ValueType *Typ);
 
 /* heap.c */
-void HeapInit(Picoc *pc, int StackSize);
+int HeapInit(Picoc *pc, int StackSize);
 void HeapCleanup(Picoc *pc);
+#ifdef USE_MALLOC_STACK
+unsigned char *HeapGetMemory(int Size);
+void HeapPutMemory(unsigned char *Memory, int Size);
+#endif
 void *HeapAllocStack(Picoc *pc, int Size);
 int HeapPopStack(Picoc *pc, void *Addr, int Size);
 void HeapUnpopStack(Picoc *pc, int Size);
@@ -554,6 +726,7 @@ void HeapPushStackFrame(Picoc *pc);
 int HeapPopStackFrame(Picoc *pc);
 void *HeapAllocMem(Picoc *pc, int Size);
 void HeapFreeMem(Picoc *pc, void *Mem);
+int HeapMemSize(void *Mem);
 
 /* variable.c */
 void VariableInit(Picoc *pc);
@@ -573,14 +746,18 @@ int VariableDefined(Picoc *pc, const char *Ident);
 int VariableDefinedAndOutOfScope(Picoc *pc, const char *Ident);
 void VariableRealloc(struct ParseState *Parser, struct Value *FromValue, int NewSize);
 void VariableGet(Picoc *pc, struct ParseState *Parser, const char *Ident, struct Value **LVal);
+struct Value *VariableGetConstant(Picoc *pc, const char *Ident);
 void VariableDefinePlatformVar(Picoc *pc, struct ParseState *Parser, char *Ident, struct ValueType *Typ, union AnyValue *FromValue, int IsWritable);
 void VariableStackFrameAdd(struct ParseState *Parser, const char *FuncName, int NumParams);
 void VariableStackFramePop(struct ParseState *Parser);
+struct VariableSlotMap *VariableSlotMapCreate(Picoc *pc, struct FuncDef *Def);
+void VariableStackFrameSlots(struct ParseState *Parser, struct VariableSlotMap *SlotMap);
 struct Value *VariableStringLiteralGet(Picoc *pc, char *Ident);
 void VariableStringLiteralDefine(Picoc *pc, char *Ident, struct Value *Val);
 void *VariableDereferencePointer(struct ParseState *Parser, struct Value *PointerValue, struct Value **DerefVal, int *DerefOffset, struct ValueType **DerefType, int *DerefIsLValue);
-int VariableScopeBegin(struct ParseState * Parser, int16_t *PrevScopeID);
-void VariableScopeEnd(struct ParseState * Parser, int ScopeID, int16_t PrevScopeID);
+void VariableScopeBegin(struct ParseState *Parser);
+void VariableScopeEnd(struct ParseState *Parser);
+void VariableScopeForget(Picoc *pc, const char *Ident);
 
 /* clibrary.c */
 void BasicIOInit(Picoc *pc);
@@ -603,7 +780,7 @@ const extern struct LibraryFunction CLibrary[];
 /* the following are defined in picoc.h:
  * void PicocCallMain(int argc, char **argv);
  * int PicocPlatformSetExitPoint();
- * void PicocInitialise(int StackSize);
+ * int PicocInitialise(Picoc *pc, int StackSize);
  * void PicocCleanup();
  * void PicocPlatformScanFile(const char *FileName);
  * extern int PicocExitValue; */
@@ -622,6 +799,17 @@ void PlatformVPrintf(IOFILE *Stream, const char *Format, va_list Args);
 void PlatformExit(Picoc *pc, int ExitVal);
 char *PlatformMakeTempName(Picoc *pc, char *TempNameBuffer);
 void PlatformLibraryInit(Picoc *pc);
+#ifndef NO_TIME_SLICE
+void PlatformSliceYield(Picoc *pc);
+#endif
+#ifndef NO_PROFILER
+void PlatformProfileTimer(Picoc *pc, int On);
+#endif
+#ifdef USE_MMAP_STACK
+void *PlatformMapMemory(int Size);
+void PlatformUnmapMemory(void *Memory, int Size);
+void PlatformDiscardMemory(void *Memory, int Size);
+#endif
 
 /* include.c */
 void IncludeInit(Picoc *pc);
@@ -635,7 +823,29 @@ void IncludeFile(Picoc *pc, char *Filename, int LineByLine);
 void DebugInit();
 void DebugCleanup();
 void DebugCheckStatement(struct ParseState *Parser);
+void DebugBreak();
 
+/* profile.c */
+/* the following are defined in picoc.h:
+ * void PicocProfileStart(Picoc *pc);
+ * void PicocProfileStop(Picoc *pc);
+ * void PicocProfileReport(Picoc *pc, FILE *Stream);
+ * void PicocProfileFolded(Picoc *pc, FILE *Stream, int CountStatements); */
+#ifndef NO_PROFILER
+void ProfileCleanup(Picoc *pc);
+void ProfileTick(Picoc *pc);
+void ProfileCall(Picoc *pc, struct StackFrame *Frame);
+void ProfileStatement(struct ParseState *Parser);
+#endif
+
+/* bytecode.c */
+#ifndef NO_BYTECODE
+int BytecodeCompile(Picoc *pc, struct FuncDef *Def);
+int BytecodeRun(struct ParseState *Parser, struct Value *FuncValue, const char *FuncName, struct Value *ReturnValue, struct Value **ParamArray);
+void BytecodeFree(Picoc *pc, struct FuncDef *Def);
+struct Bytecode *BytecodeCompileExpression(Picoc *pc, struct ParseState *Parser, enum LexToken EndToken, const char **Name, int *NumNames, int *Assigned);
+long BytecodeRunExpression(struct Bytecode *Code, int **Var);
+#endif
 
 /* stdio.c */
 extern const char StdioDefs[];
@@ -661,6 +871,7 @@ void StdTimeSetupFunc(Picoc *pc);
 
 /* errno.c */
 void StdErrnoSetupFunc(Picoc *pc);
+void StdErrnoBind(Picoc *pc);
 
 /* ctype.c */
 extern struct LibraryFunction StdCtypeFunctions[];
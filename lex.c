@@ -2,14 +2,44 @@
 
 #include "interpreter.h"
 
-#ifdef NO_CTYPE
-#define isalpha(c) (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z'))
-#define isdigit(c) ((c) >= '0' && (c) <= '9')
-#define isalnum(c) (isalpha(c) || isdigit(c))
-#define isspace(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+#ifdef USE_SSE2_LEXER
+#include <emmintrin.h>
 #endif
-#define isCidstart(c) (isalpha(c) || (c)=='_' || (c)=='#')
-#define isCident(c) (isalnum(c) || (c)=='_')
+
+/* the kinds of character the scanner looks for most, so it can test them with one lookup */
+#define LEX_CHAR_SPACE 1                /* white space */
+#define LEX_CHAR_IDENT 2                /* can be part of an identifier */
+#define LEX_CHAR_IDSTART 4              /* can start an identifier */
+#define LEX_CHAR_DIGIT 8                /* starts a number */
+#define LEX_CHAR_IS(c, Class) (LexCharClass[(unsigned char)(c)] & (Class))
+
+#define S LEX_CHAR_SPACE
+#define A (LEX_CHAR_IDENT | LEX_CHAR_IDSTART)
+#define D (LEX_CHAR_IDENT | LEX_CHAR_DIGIT)
+#define H LEX_CHAR_IDSTART
+static const unsigned char LexCharClass[256] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, S, S, S, S, S, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    S, 0, 0, H, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0,
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, A,
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+#undef S
+#undef A
+#undef D
+#undef H
 
 #define IS_HEX_ALPHA_DIGIT(c) (((c) >= 'a' && (c) <= 'f') || ((c) >= 'A' && (c) <= 'F'))
 #define IS_BASE_DIGIT(c,b) (((c) >= '0' && (c) < '0' + (((b)<10)?(b):10)) || (((b) > 10) ? IS_HEX_ALPHA_DIGIT(c) : FALSE))
@@ -24,77 +54,46 @@
 #define LEXER_INC(l) ( (l)->Pos++, (l)->CharacterPos++ )
 #define LEXER_INCN(l, n) ( (l)->Pos+=(n), (l)->CharacterPos+=(n) )
 #define TOKEN_DATA_OFFSET 2
+#define LEX_TOKEN_CHUNK 1024    /* how much stack to take at a time for the tokens while scanning. a multiple of the alignment so it stays contiguous */
 
 #define MAX_CHAR_VALUE 255      /* maximum value which can be represented by a "char" data type */
 
+#ifndef NO_TOKEN_IMAGE
+#define LEX_IMAGE_VERSION 2
+#define LEX_IMAGE_BYTE_ORDER 0x01020304L
 
-struct ReservedWord
+/* the start of a saved token image. the numbers and token values are in the host's own
+ * format so an image can only be loaded by a picoc built the same way as the one which saved it */
+struct LexImageHeader
 {
-    const char *Word;
-    enum LexToken Token;
+    char Magic[sizeof(LEX_IMAGE_MAGIC)];
+    unsigned char Version;          /* LEX_IMAGE_VERSION */
+    unsigned char NumTokens;        /* how many kinds of token there are */
+    unsigned char PointerSize;
+    unsigned char LongSize;
+    unsigned char DoubleSize;
+    long ByteOrder;                 /* LEX_IMAGE_BYTE_ORDER */
+    int NumStrings;                 /* the file name followed by the strings the tokens use */
+    int StringBytes;
+    int TokenBytes;
 };
 
-const static struct ReservedWord ReservedWords[] =
+/* the strings used by the tokens of an image being saved. the tokens refer to them by index */
+struct LexImageStrings
 {
-    { "#define", TokenHashDefine },
-    { "#else", TokenHashElse },
-    { "#endif", TokenHashEndif },
-    { "#if", TokenHashIf },
-    { "#ifdef", TokenHashIfdef },
-    { "#ifndef", TokenHashIfndef },
-    { "#include", TokenHashInclude },
-    { "auto", TokenAutoType },
-    { "break", TokenBreak },
-    { "case", TokenCase },
-    { "char", TokenCharType },
-    { "continue", TokenContinue },
-    { "default", TokenDefault },
-    { "delete", TokenDelete },
-    { "do", TokenDo },
-#ifndef NO_FP
-    { "double", TokenDoubleType },
-#endif
-    { "else", TokenElse },
-    { "enum", TokenEnumType },
-    { "extern", TokenExternType },
-#ifndef NO_FP
-    { "float", TokenFloatType },
-#endif
-    { "for", TokenFor },
-    { "goto", TokenGoto },
-    { "if", TokenIf },
-    { "int", TokenIntType },
-    { "long", TokenLongType },
-    { "new", TokenNew },
-    { "register", TokenRegisterType },
-    { "return", TokenReturn },
-    { "short", TokenShortType },
-    { "signed", TokenSignedType },
-    { "sizeof", TokenSizeof },
-    { "static", TokenStaticType },
-    { "struct", TokenStructType },
-    { "switch", TokenSwitch },
-    { "typedef", TokenTypedef },
-    { "union", TokenUnionType },
-    { "unsigned", TokenUnsignedType },
-    { "void", TokenVoidType },
-    { "while", TokenWhile }
+    const char **Hash;              /* hashed by their registered address */
+    int *HashIndex;
+    int HashSize;
+    const char **List;              /* in index order */
+    int NumStrings;
+    int StringBytes;
 };
-
+#endif
 
 
 /* initialise the lexer */
 void LexInit(Picoc *pc)
 {
-    int Count;
-    
-    TableInitTable(&pc->ReservedWordTable, &pc->ReservedWordHashTable[0], sizeof(ReservedWords) / sizeof(struct ReservedWord) * 2, TRUE);
-
-    for (Count = 0; Count < sizeof(ReservedWords) / sizeof(struct ReservedWord); Count++)
-    {
-        TableSet(pc, &pc->ReservedWordTable, TableStrRegister(pc, ReservedWords[Count].Word), (struct Value *)&ReservedWords[Count], NULL, 0, 0);
-    }
-    
     pc->LexValue.Typ = NULL;
     pc->LexValue.Val = &pc->LexAnyValue;
     pc->LexValue.LValueFrom = NULL;
@@ -104,12 +103,7 @@ void LexInit(Picoc *pc)
 /* deallocate */
 void LexCleanup(Picoc *pc)
 {
-    int Count;
-
     LexInteractiveClear(pc, NULL);
-
-    for (Count = 0; Count < sizeof(ReservedWords) / sizeof(struct ReservedWord); Count++)
-        TableDelete(pc, &pc->ReservedWordTable, TableStrRegister(pc, ReservedWords[Count].Word));
 }
 
 /* used in interactive mode / line by line mode to get more source text from user/file input */
@@ -214,15 +208,117 @@ int LexGetMoreSource(struct ParseState *Parser, char *LineBuffer, int Size)
 #endif
 }
 
-/* check if a word is a reserved word - used while scanning */
-enum LexToken LexCheckReservedWord(Picoc *pc, const char *Word)
+/* find the first of two characters in the source, or End if there isn't one. this is
+ * how the scanner skips through comments and string constants */
+#ifdef USE_SSE2_LEXER
+static const char *LexFindChar(const char *Pos, const char *End, char Ch1, char Ch2)
 {
-    struct Value *val;
+    __m128i Match1 = _mm_set1_epi8(Ch1);
+    __m128i Match2 = _mm_set1_epi8(Ch2);
+    __m128i Block;
+    int Found;
     
-    if (TableGet(&pc->ReservedWordTable, Word, &val, NULL, NULL, NULL))
-        return ((struct ReservedWord *)val)->Token;
-    else
-        return TokenNone;
+    /* look at sixteen characters at a time */
+    for (; End - Pos >= 16; Pos += 16)
+    {
+        Block = _mm_loadu_si128((const __m128i *)Pos);
+        Found = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(Block, Match1), _mm_cmpeq_epi8(Block, Match2)));
+        if (Found != 0)
+            return Pos + __builtin_ctz(Found);
+    }
+    
+    while (Pos != End && *Pos != Ch1 && *Pos != Ch2)
+        Pos++;
+    
+    return Pos;
+}
+#else
+static const char *LexFindChar(const char *Pos, const char *End, char Ch1, char Ch2)
+{
+    while (Pos != End && *Pos != Ch1 && *Pos != Ch2)
+        Pos++;
+    
+    return Pos;
+}
+#endif
+
+/* move the lexer up to the next of two characters, or to the end of the source */
+static void LexSkipTo(struct LexState *Lexer, char Ch1, char Ch2)
+{
+    const char *Found = LexFindChar(Lexer->Pos, Lexer->End, Ch1, Ch2);
+    
+    Lexer->CharacterPos += Found - Lexer->Pos;
+    Lexer->Pos = Found;
+}
+
+/* check if a word is a reserved word - used while scanning. it switches on the length and
+ * checks the first character before comparing, so most identifiers are ruled out quickly */
+#define LEX_WORD_IS(Word, Reserved) ((Word)[0] == (Reserved)[0] && memcmp((void *)&(Word)[1], (void *)&(Reserved)[1], sizeof(Reserved) - 2) == 0)
+
+static enum LexToken LexCheckReservedWord(const char *Word, int Len)
+{
+    switch (Len)
+    {
+        case 2:
+            if (LEX_WORD_IS(Word, "do")) return TokenDo;
+            if (LEX_WORD_IS(Word, "if")) return TokenIf;
+            break;
+        case 3:
+            if (LEX_WORD_IS(Word, "#if")) return TokenHashIf;
+            if (LEX_WORD_IS(Word, "for")) return TokenFor;
+            if (LEX_WORD_IS(Word, "int")) return TokenIntType;
+            if (LEX_WORD_IS(Word, "new")) return TokenNew;
+            break;
+        case 4:
+            if (LEX_WORD_IS(Word, "auto")) return TokenAutoType;
+            if (LEX_WORD_IS(Word, "case")) return TokenCase;
+            if (LEX_WORD_IS(Word, "char")) return TokenCharType;
+            if (LEX_WORD_IS(Word, "else")) return TokenElse;
+            if (LEX_WORD_IS(Word, "enum")) return TokenEnumType;
+            if (LEX_WORD_IS(Word, "goto")) return TokenGoto;
+            if (LEX_WORD_IS(Word, "long")) return TokenLongType;
+            if (LEX_WORD_IS(Word, "void")) return TokenVoidType;
+            break;
+        case 5:
+            if (LEX_WORD_IS(Word, "#else")) return TokenHashElse;
+            if (LEX_WORD_IS(Word, "break")) return TokenBreak;
+#ifndef NO_FP
+            if (LEX_WORD_IS(Word, "float")) return TokenFloatType;
+#endif
+            if (LEX_WORD_IS(Word, "short")) return TokenShortType;
+            if (LEX_WORD_IS(Word, "union")) return TokenUnionType;
+            if (LEX_WORD_IS(Word, "while")) return TokenWhile;
+            break;
+        case 6:
+            if (LEX_WORD_IS(Word, "#endif")) return TokenHashEndif;
+            if (LEX_WORD_IS(Word, "#ifdef")) return TokenHashIfdef;
+            if (LEX_WORD_IS(Word, "delete")) return TokenDelete;
+#ifndef NO_FP
+            if (LEX_WORD_IS(Word, "double")) return TokenDoubleType;
+#endif
+            if (LEX_WORD_IS(Word, "extern")) return TokenExternType;
+            if (LEX_WORD_IS(Word, "return")) return TokenReturn;
+            if (LEX_WORD_IS(Word, "signed")) return TokenSignedType;
+            if (LEX_WORD_IS(Word, "sizeof")) return TokenSizeof;
+            if (LEX_WORD_IS(Word, "static")) return TokenStaticType;
+            if (LEX_WORD_IS(Word, "struct")) return TokenStructType;
+            if (LEX_WORD_IS(Word, "switch")) return TokenSwitch;
+            break;
+        case 7:
+            if (LEX_WORD_IS(Word, "#define")) return TokenHashDefine;
+            if (LEX_WORD_IS(Word, "#ifndef")) return TokenHashIfndef;
+            if (LEX_WORD_IS(Word, "default")) return TokenDefault;
+            if (LEX_WORD_IS(Word, "typedef")) return TokenTypedef;
+            break;
+        case 8:
+            if (LEX_WORD_IS(Word, "#include")) return TokenHashInclude;
+            if (LEX_WORD_IS(Word, "continue")) return TokenContinue;
+            if (LEX_WORD_IS(Word, "register")) return TokenRegisterType;
+            if (LEX_WORD_IS(Word, "unsigned")) return TokenUnsignedType;
+            break;
+    }
+    
+    return TokenNone;
 }
 
 /* get a numeric literal - used while scanning */
@@ -342,12 +438,10 @@ enum LexToken LexGetWord(Picoc *pc, struct LexState *Lexer, struct Value *Value)
     
     do {
         LEXER_INC(Lexer);
-    } while (Lexer->Pos != Lexer->End && isCident((int)*Lexer->Pos));
+    } while (Lexer->Pos != Lexer->End && LEX_CHAR_IS(*Lexer->Pos, LEX_CHAR_IDENT));
     
     Value->Typ = NULL;
-    Value->Val->Identifier = TableStrRegister2(pc, StartPos, Lexer->Pos - StartPos);
-    
-    Token = LexCheckReservedWord(pc, Value->Val->Identifier);
+    Token = LexCheckReservedWord(StartPos, Lexer->Pos - StartPos);
     switch (Token)
     {
         case TokenHashInclude: Lexer->Mode = LexModeHashInclude; break;
@@ -358,6 +452,8 @@ enum LexToken LexGetWord(Picoc *pc, struct LexState *Lexer, struct Value *Value)
     if (Token != TokenNone)
         return Token;
     
+    Value->Val->Identifier = TableStrRegister2(pc, StartPos, Lexer->Pos - StartPos);
+    
     if (Lexer->Mode == LexModeHashDefineSpace)
         Lexer->Mode = LexModeHashDefineSpaceIdent;
     
@@ -420,37 +516,53 @@ unsigned char LexUnEscapeCharacter(const char **From, const char *End)
         return *(*From)++;
 }
 
+/* make sure there's a string literal value for a registered string */
+static void LexStringLiteral(Picoc *pc, char *RegString)
+{
+    struct Value *ArrayValue = VariableStringLiteralGet(pc, RegString);
+
+    if (ArrayValue == NULL)
+    {
+        /* create and store this string literal */
+        ArrayValue = VariableAllocValueAndData(pc, NULL, 0, FALSE, NULL, TRUE);
+        ArrayValue->Typ = pc->CharArrayType;
+        ArrayValue->Val = (union AnyValue *)RegString;
+        VariableStringLiteralDefine(pc, RegString, ArrayValue);
+    }
+}
+
 /* get a string constant - used while scanning */
 enum LexToken LexGetStringConstant(Picoc *pc, struct LexState *Lexer, struct Value *Value, char EndChar)
 {
-    int Escape = FALSE;
     const char *StartPos = Lexer->Pos;
     const char *EndPos;
+    const char *EscapePos;
     char *EscBuf;
     char *EscBufPos;
     char *RegString;
-    struct Value *ArrayValue;
 
-    while (Lexer->Pos != Lexer->End && (*Lexer->Pos != EndChar || Escape))
+    for (;;)
     { 
-        /* find the end */
-        if (Escape)
+        /* find the end or the next escape */
+        LexSkipTo(Lexer, EndChar, '\\');
+        if (Lexer->Pos == Lexer->End || *Lexer->Pos == EndChar)
+            break;
+        
+        /* skip the escaped character */
+        LEXER_INC(Lexer);
+        if (Lexer->Pos == Lexer->End)
+            break;
+        
+        if (*Lexer->Pos == '\r' && Lexer->Pos+1 != Lexer->End)
+            Lexer->Pos++;
+        
+        if (*Lexer->Pos == '\n' && Lexer->Pos+1 != Lexer->End)
         {
-            if (*Lexer->Pos == '\r' && Lexer->Pos+1 != Lexer->End)
-                Lexer->Pos++;
-            
-            if (*Lexer->Pos == '\n' && Lexer->Pos+1 != Lexer->End)
-            {
-                Lexer->Line++;
-                Lexer->Pos++;
-                Lexer->CharacterPos = 0;
-                Lexer->EmitExtraNewlines++;
-            }
-            
-            Escape = FALSE;
+            Lexer->Line++;
+            Lexer->Pos++;
+            Lexer->CharacterPos = 0;
+            Lexer->EmitExtraNewlines++;
         }
-        else if (*Lexer->Pos == '\\')
-            Escape = TRUE;
             
         LEXER_INC(Lexer);
     }
@@ -461,20 +573,20 @@ enum LexToken LexGetStringConstant(Picoc *pc, struct LexState *Lexer, struct Val
         LexFail(pc, Lexer, "out of memory");
     
     for (EscBufPos = EscBuf, Lexer->Pos = StartPos; Lexer->Pos != EndPos;)
-        *EscBufPos++ = LexUnEscapeCharacter(&Lexer->Pos, EndPos);
+    {
+        /* copy up to the next escape as it is */
+        EscapePos = LexFindChar(Lexer->Pos, EndPos, '\\', '\\');
+        memcpy((void *)EscBufPos, (void *)Lexer->Pos, EscapePos - Lexer->Pos);
+        EscBufPos += EscapePos - Lexer->Pos;
+        Lexer->Pos = EscapePos;
+        if (Lexer->Pos != EndPos)
+            *EscBufPos++ = LexUnEscapeCharacter(&Lexer->Pos, EndPos);
+    }
     
     /* try to find an existing copy of this string literal */
     RegString = TableStrRegister2(pc, EscBuf, EscBufPos - EscBuf);
     HeapPopStack(pc, EscBuf, EndPos - StartPos);
-    ArrayValue = VariableStringLiteralGet(pc, RegString);
-    if (ArrayValue == NULL)
-    {
-        /* create and store this string literal */
-        ArrayValue = VariableAllocValueAndData(pc, NULL, 0, FALSE, NULL, TRUE);
-        ArrayValue->Typ = pc->CharArrayType;
-        ArrayValue->Val = (union AnyValue *)RegString;
-        VariableStringLiteralDefine(pc, RegString, ArrayValue);
-    }
+    LexStringLiteral(pc, RegString);
 
     /* create the the pointer for this char* */
     Value->Typ = pc->CharPtrType;
@@ -502,9 +614,13 @@ void LexSkipComment(struct LexState *Lexer, char NextChar, enum LexToken *Return
 {
     if (NextChar == '*')
     {   
-        /* conventional C comment */
-        while (Lexer->Pos != Lexer->End && (*(Lexer->Pos-1) != '*' || *Lexer->Pos != '/'))
+        /* conventional C comment. look for the end of each line or a '/' which might end it */
+        for (;;)
         {
+            LexSkipTo(Lexer, '/', '\n');
+            if (Lexer->Pos == Lexer->End || (*Lexer->Pos == '/' && *(Lexer->Pos-1) == '*'))
+                break;
+            
             if (*Lexer->Pos == '\n')
                 Lexer->EmitExtraNewlines++;
 
@@ -519,8 +635,7 @@ void LexSkipComment(struct LexState *Lexer, char NextChar, enum LexToken *Return
     else
     {   
         /* C++ style comment */
-        while (Lexer->Pos != Lexer->End && *Lexer->Pos != '\n')
-            LEXER_INC(Lexer);
+        LexSkipTo(Lexer, '\n', '\n');
     }
 }
 
@@ -542,7 +657,7 @@ enum LexToken LexScanGetToken(Picoc *pc, struct LexState *Lexer, struct Value **
     do
     {
         *Value = &pc->LexValue;
-        while (Lexer->Pos != Lexer->End && isspace((int)*Lexer->Pos))
+        while (Lexer->Pos != Lexer->End && LEX_CHAR_IS(*Lexer->Pos, LEX_CHAR_SPACE))
         {
             if (*Lexer->Pos == '\n')
             {
@@ -565,10 +680,10 @@ enum LexToken LexScanGetToken(Picoc *pc, struct LexState *Lexer, struct Value **
             return TokenEOF;
         
         ThisChar = *Lexer->Pos;
-        if (isCidstart((int)ThisChar))
+        if (LEX_CHAR_IS(ThisChar, LEX_CHAR_IDSTART))
             return LexGetWord(pc, Lexer, *Value);
         
-        if (isdigit((int)ThisChar))
+        if (LEX_CHAR_IS(ThisChar, LEX_CHAR_DIGIT))
             return LexGetNumber(pc, Lexer, *Value);
         
         NextChar = (Lexer->Pos+1 != Lexer->End) ? *(Lexer->Pos+1) : 0;
@@ -608,16 +723,90 @@ enum LexToken LexScanGetToken(Picoc *pc, struct LexState *Lexer, struct Value **
     return GotToken;
 }
 
-/* what size value goes with each token */
-int LexTokenSize(enum LexToken Token)
+/* the most bytes a token's value can take */
+#define LEX_VARINT_MAX ((int)(sizeof(unsigned long) * 8 + 6) / 7)
+#ifndef NO_FP
+#define LEX_VALUE_MAX (LEX_VARINT_MAX > (int)sizeof(double) ? LEX_VARINT_MAX : (int)sizeof(double))
+#else
+#define LEX_VALUE_MAX LEX_VARINT_MAX
+#endif
+
+/* integer constants are stored zigzag encoded so small negative numbers are short too */
+#define LEX_ZIGZAG(v) (((unsigned long)(v) << 1) ^ ((v) < 0 ? ~0UL : 0UL))
+#define LEX_UNZIGZAG(u) ((long)((u) >> 1) ^ -(long)((u) & 1))
+
+/* store a number seven bits to a byte, with the top bit set on all but the last byte. 
+ * returns the position after it */
+static unsigned char *LexPutVarint(unsigned char *Pos, unsigned long Num)
+{
+    for (; Num >= 0x80; Num >>= 7)
+        *Pos++ = (unsigned char)(Num | 0x80);
+    
+    *Pos++ = (unsigned char)Num;
+    return Pos;
+}
+
+/* read a number stored by LexPutVarint(). returns the position after it */
+static const unsigned char *LexGetVarint(const unsigned char *Pos, unsigned long *Num)
+{
+    unsigned long Result = 0;
+    int Shift = 0;
+    
+    for (; *Pos & 0x80; Pos++, Shift += 7)
+        Result |= (unsigned long)(*Pos & 0x7f) << Shift;
+    
+    *Num = Result | ((unsigned long)*Pos << Shift);
+    return Pos + 1;
+}
+
+/* how many bytes a token takes, including its value. identifiers and strings are stored
+ * as their number in the string index and integers as varints, while characters and
+ * floating point numbers are stored as they are */
+static int LexTokenBytes(const unsigned char *Pos)
+{
+    int Bytes = TOKEN_DATA_OFFSET;
+    
+    switch ((enum LexToken)*Pos)
+    {
+        case TokenIdentifier: case TokenStringConstant: case TokenIntegerConstant:
+            while (Pos[Bytes] & 0x80)
+                Bytes++;
+            
+            return Bytes + 1;
+            
+        case TokenCharacterConstant: return Bytes + sizeof(unsigned char);
+#ifndef NO_FP
+        case TokenFPConstant: return Bytes + sizeof(double);
+#endif
+        default: return Bytes;
+    }
+}
+
+/* store a token's value after it. returns the number of bytes taken */
+static int LexPutValue(Picoc *pc, enum LexToken Token, struct Value *Val, unsigned char *Pos)
 {
     switch (Token)
     {
-        case TokenIdentifier: case TokenStringConstant: return sizeof(char *);
-        case TokenIntegerConstant: return sizeof(long);
-        case TokenCharacterConstant: return sizeof(unsigned char);
-        case TokenFPConstant: return sizeof(double);
-        default: return 0;
+        case TokenIdentifier:
+            return LexPutVarint(Pos, TableStrIndex(pc, Val->Val->Identifier)) - Pos;
+            
+        case TokenStringConstant:
+            return LexPutVarint(Pos, TableStrIndex(pc, Val->Val->Pointer)) - Pos;
+            
+        case TokenIntegerConstant:
+            return LexPutVarint(Pos, LEX_ZIGZAG(Val->Val->LongInteger)) - Pos;
+            
+        case TokenCharacterConstant:
+            *Pos = Val->Val->Character;
+            return sizeof(unsigned char);
+            
+#ifndef NO_FP
+        case TokenFPConstant:
+            memcpy((void *)Pos, (void *)&Val->Val->FP, sizeof(double));
+            return sizeof(double);
+#endif
+        default:
+            return 0;
     }
 }
 
@@ -629,7 +818,7 @@ void *LexTokenise(Picoc *pc, struct LexState *Lexer, int *TokenLen)
     struct Value *GotValue;
     int MemUsed = 0;
     int ValueSize;
-    int ReserveSpace = (Lexer->End - Lexer->Pos) * 4 + 16; 
+    int ReserveSpace = LEX_TOKEN_CHUNK;
     void *TokenSpace = HeapAllocStack(pc, ReserveSpace);
     char *TokenPos = (char *)TokenSpace;
     int LastCharacterPos = 0;
@@ -645,6 +834,17 @@ void *LexTokenise(Picoc *pc, struct LexState *Lexer, int *TokenLen)
 #ifdef DEBUG_LEXER
         printf("Token: %02x\n", Token);
 #endif
+        if (MemUsed + TOKEN_DATA_OFFSET + LEX_VALUE_MAX > ReserveSpace)
+        {
+            /* the tokens are on the top of the stack so we can extend them in place */
+            void *MoreSpace = HeapAllocStack(pc, LEX_TOKEN_CHUNK);
+            if (MoreSpace == NULL)
+                LexFail(pc, Lexer, "out of memory");
+            
+            assert(MoreSpace == (char *)TokenSpace + ReserveSpace);
+            ReserveSpace += LEX_TOKEN_CHUNK;
+        }
+        
         *(unsigned char *)TokenPos = Token;
         TokenPos++;
         MemUsed++;
@@ -653,14 +853,10 @@ void *LexTokenise(Picoc *pc, struct LexState *Lexer, int *TokenLen)
         TokenPos++;
         MemUsed++;
 
-        ValueSize = LexTokenSize(Token);
-        if (ValueSize > 0)
-        { 
-            /* store a value as well */
-            memcpy((void *)TokenPos, (void *)GotValue->Val, ValueSize);
-            TokenPos += ValueSize;
-            MemUsed += ValueSize;
-        }
+        /* store a value as well */
+        ValueSize = LexPutValue(pc, Token, GotValue, (unsigned char *)TokenPos);
+        TokenPos += ValueSize;
+        MemUsed += ValueSize;
     
         LastCharacterPos = Lexer->CharacterPos;
                     
@@ -670,6 +866,7 @@ void *LexTokenise(Picoc *pc, struct LexState *Lexer, int *TokenLen)
     if (HeapMem == NULL)
         LexFail(pc, Lexer, "out of memory");
         
+    HEAP_ALLOC_USE(pc, PicocHeapTokens, MemUsed);
     assert(ReserveSpace >= MemUsed);
     memcpy(HeapMem, TokenSpace, MemUsed);
     HeapPopStack(pc, TokenSpace, ReserveSpace);
@@ -705,6 +902,275 @@ void *LexAnalyse(Picoc *pc, const char *FileName, const char *Source, int Source
     return LexTokenise(pc, &Lexer, TokenLen);
 }
 
+#ifndef NO_TOKEN_IMAGE
+/* get the index of a string used by a token image, adding it if it's new */
+static int LexImageStringIndex(struct LexImageStrings *Strings, const char *Str)
+{
+    int HashPos = ((unsigned long)Str) % Strings->HashSize;   /* registered strings have unique addresses */
+
+    while (Strings->Hash[HashPos] != NULL)
+    {
+        if (Strings->Hash[HashPos] == Str)
+            return Strings->HashIndex[HashPos];
+
+        HashPos = (HashPos + 1) % Strings->HashSize;
+    }
+
+    Strings->Hash[HashPos] = Str;
+    Strings->HashIndex[HashPos] = Strings->NumStrings;
+    Strings->List[Strings->NumStrings] = Str;
+    Strings->StringBytes += strlen(Str) + 1;
+    return Strings->NumStrings++;
+}
+
+/* the number of bytes a varint takes */
+static int LexVarintSize(unsigned long Num)
+{
+    unsigned char Buf[LEX_VARINT_MAX];
+    
+    return LexPutVarint(&Buf[0], Num) - &Buf[0];
+}
+
+/* save the tokens from LexAnalyse() as an image which can be loaded again without
+ * lexing the source. FileName must be registered. the image is allocated on the heap */
+void *LexImageCreate(Picoc *pc, const char *FileName, const void *Tokens, int TokenLen, int *ImageLen)
+{
+    struct LexImageStrings Strings;
+    struct LexImageHeader *Header;
+    const unsigned char *Pos;
+    unsigned char *ImagePos;
+    enum LexToken Token;
+    unsigned long Num;
+    int ImageTokenLen = TokenLen;
+    int NumValues = 1;
+    int Bytes;
+    int Count;
+
+    /* make space to look up the strings the tokens use */
+    for (Pos = Tokens; (Token = (enum LexToken)*Pos) != TokenEOF; Pos += LexTokenBytes(Pos))
+    {
+        if (Token == TokenIdentifier || Token == TokenStringConstant)
+            NumValues++;
+    }
+
+    Strings.HashSize = NumValues * 2 + 1;
+    Strings.Hash = HeapAllocMem(pc, (sizeof(const char *) + sizeof(int)) * Strings.HashSize + sizeof(const char *) * NumValues);
+    if (Strings.Hash == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+
+    Strings.List = &Strings.Hash[Strings.HashSize];
+    Strings.HashIndex = (int *)&Strings.List[NumValues];
+    Strings.NumStrings = 0;
+    Strings.StringBytes = 0;
+
+    /* number the strings in the order they're first used. the image's numbers can take 
+     * a different number of bytes to this instance's */
+    LexImageStringIndex(&Strings, FileName);
+    for (Pos = Tokens; (Token = (enum LexToken)*Pos) != TokenEOF; Pos += Bytes)
+    {
+        Bytes = LexTokenBytes(Pos);
+        if (Token == TokenIdentifier || Token == TokenStringConstant)
+        {
+            LexGetVarint(Pos + TOKEN_DATA_OFFSET, &Num);
+            ImageTokenLen += TOKEN_DATA_OFFSET + LexVarintSize(LexImageStringIndex(&Strings, pc->StringIndex[Num])) - Bytes;
+        }
+    }
+
+    *ImageLen = sizeof(struct LexImageHeader) + Strings.StringBytes + ImageTokenLen;
+    Header = HeapAllocMem(pc, *ImageLen);
+    if (Header == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+
+    memcpy((void *)&Header->Magic[0], LEX_IMAGE_MAGIC, sizeof(LEX_IMAGE_MAGIC));
+    Header->Version = LEX_IMAGE_VERSION;
+    Header->NumTokens = TokenEndOfFunction + 1;
+    Header->PointerSize = sizeof(char *);
+    Header->LongSize = sizeof(long);
+#ifndef NO_FP
+    Header->DoubleSize = sizeof(double);
+#endif
+    Header->ByteOrder = LEX_IMAGE_BYTE_ORDER;
+    Header->NumStrings = Strings.NumStrings;
+    Header->StringBytes = Strings.StringBytes;
+    Header->TokenBytes = ImageTokenLen;
+
+    /* the strings follow the header */
+    ImagePos = (unsigned char *)Header + sizeof(struct LexImageHeader);
+    for (Count = 0; Count < Strings.NumStrings; Count++)
+    {
+        strcpy((char *)ImagePos, Strings.List[Count]);
+        ImagePos += strlen(Strings.List[Count]) + 1;
+    }
+
+    /* then the tokens, with the image's string numbers instead of this instance's */
+    for (Pos = Tokens; ; Pos += Bytes)
+    {
+        Token = (enum LexToken)*Pos;
+        Bytes = LexTokenBytes(Pos);
+        if (Token == TokenIdentifier || Token == TokenStringConstant)
+        {
+            memcpy((void *)ImagePos, (void *)Pos, TOKEN_DATA_OFFSET);
+            LexGetVarint(Pos + TOKEN_DATA_OFFSET, &Num);
+            ImagePos = LexPutVarint(ImagePos + TOKEN_DATA_OFFSET, LexImageStringIndex(&Strings, pc->StringIndex[Num]));
+        }
+        else
+        {
+            memcpy((void *)ImagePos, (void *)Pos, Bytes);
+            ImagePos += Bytes;
+        }
+        
+        if (Token == TokenEOF)
+            break;
+    }
+
+    assert(ImagePos == (unsigned char *)Header + *ImageLen);
+    HeapFreeMem(pc, Strings.Hash);
+    return Header;
+}
+
+/* how many bytes a token in an image being loaded takes, or 0 if it runs past the end */
+static int LexImageTokenBytes(const unsigned char *Pos, const unsigned char *End)
+{
+    int Bytes = TOKEN_DATA_OFFSET;
+    
+    switch ((enum LexToken)*Pos)
+    {
+        case TokenIdentifier: case TokenStringConstant: case TokenIntegerConstant:
+            for (; Pos + Bytes < End && (Pos[Bytes] & 0x80); Bytes++)
+            {}
+            
+            Bytes++;
+            if (Bytes - TOKEN_DATA_OFFSET > LEX_VARINT_MAX)
+                return 0;
+            break;
+            
+        case TokenCharacterConstant: Bytes += sizeof(unsigned char); break;
+#ifndef NO_FP
+        case TokenFPConstant: Bytes += sizeof(double); break;
+#endif
+        default: break;
+    }
+    
+    return Pos + Bytes <= End ? Bytes : 0;
+}
+
+/* load an image saved by LexImageCreate(). returns the tokens on the heap and the name of
+ * the file they came from, or NULL if the image wasn't saved by a picoc like this one */
+void *LexImageLoad(Picoc *pc, const void *Image, int ImageLen, char **FileName)
+{
+    struct LexImageHeader Header;
+    char **String;
+    const char *StringPos;
+    const char *StringEnd;
+    const char *Str;
+    unsigned char *Tokens = NULL;
+    unsigned char *TokenPos;
+    const unsigned char *Pos;
+    const unsigned char *End;
+    enum LexToken Token = TokenNone;
+    unsigned long Num;
+    int TokenLen = TOKEN_DATA_OFFSET;
+    int Bytes;
+    int Count;
+
+    if (ImageLen < sizeof(struct LexImageHeader))
+        return NULL;
+
+    memcpy((void *)&Header, Image, sizeof(struct LexImageHeader));
+    if (memcmp((void *)&Header.Magic[0], LEX_IMAGE_MAGIC, sizeof(LEX_IMAGE_MAGIC)) != 0 ||
+            Header.Version != LEX_IMAGE_VERSION ||
+            Header.NumTokens != TokenEndOfFunction + 1 ||
+            Header.PointerSize != sizeof(char *) ||
+            Header.LongSize != sizeof(long) ||
+#ifndef NO_FP
+            Header.DoubleSize != sizeof(double) ||
+#else
+            Header.DoubleSize != 0 ||
+#endif
+            Header.ByteOrder != LEX_IMAGE_BYTE_ORDER ||
+            Header.NumStrings < 1 || Header.StringBytes < 0 || Header.TokenBytes < TOKEN_DATA_OFFSET ||
+            ImageLen != sizeof(struct LexImageHeader) + Header.StringBytes + Header.TokenBytes)
+        return NULL;
+
+    /* register the strings */
+    String = HeapAllocStack(pc, sizeof(char *) * Header.NumStrings);
+    if (String == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+
+    StringPos = (const char *)Image + sizeof(struct LexImageHeader);
+    StringEnd = StringPos + Header.StringBytes;
+    for (Count = 0; Count < Header.NumStrings; Count++)
+    {
+        for (Str = StringPos; StringPos != StringEnd && *StringPos != '\0'; StringPos++)
+        {}
+
+        if (StringPos == StringEnd)
+            break;
+
+        String[Count] = TableStrRegister2(pc, Str, StringPos - Str);
+        StringPos++;
+    }
+
+    if (Count == Header.NumStrings && StringPos == StringEnd)
+    {
+        /* check the tokens and work out how much space they'll take with this instance's string numbers */
+        End = (const unsigned char *)StringEnd + Header.TokenBytes - TOKEN_DATA_OFFSET;
+        for (Pos = (const unsigned char *)StringEnd; Pos < End; Pos += Bytes)
+        {
+            Token = (enum LexToken)*Pos;
+            if (Token == TokenEOF || Token > TokenEndOfFunction || (Bytes = LexImageTokenBytes(Pos, End)) == 0)
+                break;
+
+            if (Token == TokenIdentifier || Token == TokenStringConstant)
+            {
+                LexGetVarint(Pos + TOKEN_DATA_OFFSET, &Num);
+                if (Num >= (unsigned long)Header.NumStrings)
+                    break;
+
+                TokenLen += TOKEN_DATA_OFFSET + LexVarintSize(TableStrIndex(pc, String[Num]));
+            }
+            else
+                TokenLen += Bytes;
+        }
+
+        if (Pos == End && *End == TokenEOF)
+        {
+            /* copy the tokens, pointing them at the registered strings */
+            Tokens = HeapAllocMem(pc, TokenLen);
+            if (Tokens == NULL)
+                ProgramFailNoParser(pc, "out of memory");
+
+            HEAP_ALLOC_USE(pc, PicocHeapTokens, TokenLen);
+            TokenPos = Tokens;
+            for (Pos = (const unsigned char *)StringEnd; Pos <= End; Pos += Bytes)
+            {
+                Token = (enum LexToken)*Pos;
+                Bytes = LexTokenBytes(Pos);
+                if (Token == TokenIdentifier || Token == TokenStringConstant)
+                {
+                    memcpy((void *)TokenPos, (void *)Pos, TOKEN_DATA_OFFSET);
+                    LexGetVarint(Pos + TOKEN_DATA_OFFSET, &Num);
+                    TokenPos = LexPutVarint(TokenPos + TOKEN_DATA_OFFSET, TableStrIndex(pc, String[Num]));
+                    if (Token == TokenStringConstant)
+                        LexStringLiteral(pc, String[Num]);
+                }
+                else
+                {
+                    memcpy((void *)TokenPos, (void *)Pos, Bytes);
+                    TokenPos += Bytes;
+                }
+            }
+
+            assert(TokenPos == Tokens + TokenLen);
+            *FileName = String[0];
+        }
+    }
+
+    HeapPopStack(pc, String, sizeof(char *) * Header.NumStrings);
+    return Tokens;
+}
+#endif
+
 /* prepare to parse a pre-tokenised buffer */
 void LexInitParser(struct ParseState *Parser, Picoc *pc, const char *SourceText, void *TokenSource, char *FileName, void *FilePointer, int RunIt, int EnableDebugger)
 {
@@ -726,7 +1192,6 @@ void LexInitParser(struct ParseState *Parser, Picoc *pc, const char *SourceText,
 enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value, int IncPos)
 {
     enum LexToken Token = TokenNone;
-    int ValueSize;
     Picoc *pc = Parser->pc;
     
     do
@@ -760,6 +1225,7 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value, in
                 /* put the new line at the end of the linked list of interactive lines */        
                 LineTokens = LexAnalyse(pc, pc->StrEmpty, &LineBuffer[0], strlen(LineBuffer), &LineBytes);
                 LineNode = VariableAlloc(pc, Parser, sizeof(struct TokenLine), TRUE);
+                HEAP_ALLOC_USE(pc, PicocHeapTokens, sizeof(struct TokenLine));
                 LineNode->Tokens = LineTokens;
                 LineNode->NumBytes = LineBytes;
                 if (pc->InteractiveHead == NULL)
@@ -797,32 +1263,56 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value, in
     } while (((Parser->LineFilePointer || Parser->FileName == pc->StrEmpty) && Token == TokenEOF) || Token == TokenEndOfLine);
 
     Parser->CharacterPos = *((unsigned char *)Parser->Pos + 1);
-    ValueSize = LexTokenSize(Token);
-    if (ValueSize > 0)
+    if (Token >= TokenIdentifier && Token <= TokenCharacterConstant)
     { 
         /* this token requires a value - unpack it */
         if (Value != NULL)
         { 
+            const unsigned char *ValuePos = (const unsigned char *)Parser->Pos + TOKEN_DATA_OFFSET;
+            unsigned long Num;
+            
             switch (Token)
             {
-                case TokenStringConstant:       pc->LexValue.Typ = pc->CharPtrType; break;
-                case TokenIdentifier:           pc->LexValue.Typ = NULL; break;
-                case TokenIntegerConstant:      pc->LexValue.Typ = &pc->LongType; break;
-                case TokenCharacterConstant:    pc->LexValue.Typ = &pc->CharType; break;
+                case TokenStringConstant:
+                    pc->LexValue.Typ = pc->CharPtrType;
+                    ValuePos = LexGetVarint(ValuePos, &Num);
+                    pc->LexValue.Val->Pointer = pc->StringIndex[Num];
+                    break;
+                    
+                case TokenIdentifier:
+                    pc->LexValue.Typ = NULL;
+                    ValuePos = LexGetVarint(ValuePos, &Num);
+                    pc->LexValue.Val->Identifier = pc->StringIndex[Num];
+                    break;
+                    
+                case TokenIntegerConstant:
+                    pc->LexValue.Typ = &pc->LongType;
+                    ValuePos = LexGetVarint(ValuePos, &Num);
+                    pc->LexValue.Val->LongInteger = LEX_UNZIGZAG(Num);
+                    break;
+                    
+                case TokenCharacterConstant:
+                    pc->LexValue.Typ = &pc->CharType;
+                    pc->LexValue.Val->Character = *ValuePos++;
+                    break;
 #ifndef NO_FP
-                case TokenFPConstant:           pc->LexValue.Typ = &pc->FPType; break;
+                case TokenFPConstant:
+                    pc->LexValue.Typ = &pc->FPType;
+                    memcpy((void *)&pc->LexValue.Val->FP, (void *)ValuePos, sizeof(double));
+                    ValuePos += sizeof(double);
+                    break;
 #endif
                 default: break;
             }
             
-            memcpy((void *)pc->LexValue.Val, (void *)((char *)Parser->Pos + TOKEN_DATA_OFFSET), ValueSize);
             pc->LexValue.Flags &= ~(FlagValOnHeap | FlagOnStack | FlagIsLValue);
             pc->LexValue.LValueFrom = NULL;
             *Value = &pc->LexValue;
+            if (IncPos)
+                Parser->Pos = ValuePos;
         }
-        
-        if (IncPos)
-            Parser->Pos += ValueSize + TOKEN_DATA_OFFSET;
+        else if (IncPos)
+            Parser->Pos += LexTokenBytes(Parser->Pos);
     }
     else
     {
@@ -1026,11 +1516,17 @@ void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser
     unsigned char *NewTokens;
     unsigned char *NewTokenPos;
     struct TokenLine *ILine;
+    struct TokenLine *StartLine;
     Picoc *pc = StartParser->pc;
     
-    if (pc->InteractiveHead == NULL)
+    /* in interactive mode find the line we just counted. the tokens won't be in any line if 
+     * they've already been copied, like a define in a function body which is running */
+    for (StartLine = pc->InteractiveHead; StartLine != NULL && (Pos < &StartLine->Tokens[0] || Pos >= &StartLine->Tokens[StartLine->NumBytes]); StartLine = StartLine->Next)
+    {}
+    
+    if (StartLine == NULL)
     { 
-        /* non-interactive mode - copy the tokens */
+        /* non-interactive mode or tokens which have been copied - copy the tokens */
         MemSize = EndParser->Pos - StartParser->Pos;
         NewTokens = VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, TRUE);
         memcpy(NewTokens, (void *)StartParser->Pos, MemSize);
@@ -1038,9 +1534,7 @@ void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser
     else
     { 
         /* we're in interactive mode - add up line by line */
-        for (pc->InteractiveCurrentLine = pc->InteractiveHead; pc->InteractiveCurrentLine != NULL && (Pos < &pc->InteractiveCurrentLine->Tokens[0] || Pos >= &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes]); pc->InteractiveCurrentLine = pc->InteractiveCurrentLine->Next)
-        {} /* find the line we just counted */
-        
+        pc->InteractiveCurrentLine = StartLine;
         if (EndParser->Pos >= StartParser->Pos && EndParser->Pos < &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes])
         { 
             /* all on a single line */
@@ -1074,6 +1568,7 @@ void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser
     }
     
     NewTokens[MemSize] = (unsigned char)TokenEndOfFunction;
+    HEAP_ALLOC_USE(pc, PicocHeapTokens, MemSize + TOKEN_DATA_OFFSET);
         
     return NewTokens;
 }
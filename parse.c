@@ -154,6 +154,7 @@ struct Value *ParseFunctionDefinition(struct ParseState *Parser, struct ValueTyp
 
         FuncValue->Val->FuncDef.Body = FuncBody;
         FuncValue->Val->FuncDef.Body->Pos = LexCopyTokens(FuncBody, Parser);
+        FuncValue->Val->FuncDef.SlotMap = VariableSlotMapCreate(pc, &FuncValue->Val->FuncDef);
 
         /* is this function already in the global table? */
         if (TableGet(&pc->GlobalTable, Identifier, &OldFuncValue, NULL, NULL, NULL))
@@ -162,6 +163,7 @@ struct Value *ParseFunctionDefinition(struct ParseState *Parser, struct ValueTyp
             {
                 /* override an old function prototype */
                 VariableFree(pc, TableDelete(pc, &pc->GlobalTable, Identifier));
+                pc->GlobalGeneration++;
             }
             else
                 ProgramFail(Parser, "'%s' is already defined", Identifier);
@@ -375,6 +377,7 @@ void ParseMacroDefinition(struct ParseState *Parser)
     char *MacroNameStr;
     struct Value *ParamName;
     struct Value *MacroValue;
+    struct Value *OldValue;
 
     if (LexGetToken(Parser, &MacroName, TRUE) != TokenIdentifier)
         ProgramFail(Parser, "identifier expected");
@@ -428,7 +431,21 @@ void ParseMacroDefinition(struct ParseState *Parser)
     MacroValue->Val->MacroDef.Body.Pos = LexCopyTokens(&MacroValue->Val->MacroDef.Body, Parser);
     
     if (!TableSet(Parser->pc, &Parser->pc->GlobalTable, MacroNameStr, MacroValue, (char *)Parser->FileName, Parser->Line, Parser->CharacterPos))
-        ProgramFail(Parser, "'%s' is already defined", MacroNameStr);
+    {
+        /* a define in a function body is met when the function is defined and again each 
+         * time it's run. if it's the same define there's nothing more to do */
+        TableGet(&Parser->pc->GlobalTable, MacroNameStr, &OldValue, NULL, NULL, NULL);
+        if (OldValue->Typ != &Parser->pc->MacroType || OldValue->Val->MacroDef.Body.FileName != MacroValue->Val->MacroDef.Body.FileName || 
+                OldValue->Val->MacroDef.Body.Line != MacroValue->Val->MacroDef.Body.Line || OldValue->Val->MacroDef.Body.CharacterPos != MacroValue->Val->MacroDef.Body.CharacterPos)
+            ProgramFail(Parser, "'%s' is already defined", MacroNameStr);
+        
+        VariableFree(Parser->pc, MacroValue);
+    }
+    else
+    {
+        /* values worked out from an earlier macro of this name have to be found again */
+        Parser->pc->GlobalGeneration++;
+    }
 }
 
 /* copy the entire parser state */
@@ -447,6 +464,200 @@ void ParserCopyPos(struct ParseState *To, struct ParseState *From)
     To->CharacterPos = From->CharacterPos;
 }
 
+#ifndef NO_BYTECODE
+/* the compiled condition and increment of a for or while loop in a function, made the 
+ * first time the loop goes round a second time so later iterations don't parse them */
+struct ParseLoop
+{
+    const unsigned char *Pos;       /* the loop's condition */
+    struct ParseLoop *Next;         /* the next loop in the same function */
+    struct Bytecode *Condition;     /* the compiled condition, or NULL if it can't be compiled */
+    struct Bytecode *Increment;     /* the compiled increment of a for loop, or NULL */
+    int NumNames;                   /* how many variables they use */
+    int Assigned;                   /* a bit for each variable they assign to */
+    int Generation;                 /* the GlobalGeneration the macros' values were found in */
+    const char *Name[BYTECODE_EXPRESSION_VARS];
+    struct Value *Macro[BYTECODE_EXPRESSION_VARS];  /* the macros among the variables, which are constants */
+    int MacroValue[BYTECODE_EXPRESSION_VARS];
+};
+#endif
+
+/* a loop which is running, with the variables its compiled expressions use */
+struct ParseLoopRun
+{
+#ifndef NO_BYTECODE
+    struct ParseLoop *Loop;         /* the loop's compiled expressions, or NULL if they have to be parsed */
+    int Generation;                 /* the GlobalGeneration the variables were found in */
+    int *Var[BYTECODE_EXPRESSION_VARS];
+#else
+    int Unused;
+#endif
+};
+
+#ifndef NO_BYTECODE
+static int ParseIsConstantName(Picoc *pc, const char *Ident, int MacrosOnly, int Depth);
+
+/* find the variables a loop's compiled expressions use. returns FALSE if they aren't all
+ * int variables or integer constants. the values of constants defined as macros are kept 
+ * with the loop */
+static int ParseLoopVariables(struct ParseState *Parser, struct ParseLoopRun *Run)
+{
+    Picoc *pc = Parser->pc;
+    struct ParseLoop *Loop = Run->Loop;
+    struct ParseState MacroParser;
+    struct Value *Val;
+    int Count;
+    
+    if (Loop->Generation != pc->GlobalGeneration)
+    {
+        /* a macro might have been deleted so work out their values again */
+        memset((void *)&Loop->Macro[0], '\0', sizeof(Loop->Macro));
+        Loop->Generation = pc->GlobalGeneration;
+    }
+    
+    for (Count = 0; Count < Loop->NumNames; Count++)
+    {
+        if (!VariableDefined(pc, Loop->Name[Count]))
+            return FALSE;
+        
+        VariableGet(pc, Parser, Loop->Name[Count], &Val);
+        if (Val->Typ == &pc->IntType && ((Val->Flags & FlagIsLValue) || !(Loop->Assigned & (1 << Count))))
+            Run->Var[Count] = &Val->Val->Integer;
+        else if (Val->Typ == &pc->MacroType && !(Loop->Assigned & (1 << Count)))
+        {
+            if (Loop->Macro[Count] != Val)
+            {
+                if (!ParseIsConstantName(pc, Loop->Name[Count], FALSE, 0))
+                    return FALSE;
+                
+                ParserCopy(&MacroParser, &Val->Val->MacroDef.Body);
+                MacroParser.Mode = RunModeRun;
+                Loop->MacroValue[Count] = ExpressionParseInt(&MacroParser);
+                Loop->Macro[Count] = Val;
+            }
+            
+            Run->Var[Count] = &Loop->MacroValue[Count];
+        }
+        else
+            return FALSE;
+    }
+    
+    Run->Generation = pc->GlobalGeneration;
+    return TRUE;
+}
+
+/* get the compiled expressions of a loop in the function we're running, compiling them the
+ * first time. Condition and Increment are the positions they start at. returns NULL if 
+ * we're not in a function */
+static struct ParseLoop *ParseGetLoop(struct ParseState *Parser, struct ParseState *Condition, struct ParseState *Increment)
+{
+    Picoc *pc = Parser->pc;
+    struct FuncDef *Func = (pc->TopStackFrame != NULL) ? pc->TopStackFrame->Func : NULL;
+    struct ParseState ExpressionParser;
+    struct ParseLoop *Loop;
+    
+    if (Func == NULL)
+        return NULL;
+    
+    for (Loop = Func->Loops; Loop != NULL; Loop = Loop->Next)
+    {
+        if (Loop->Pos == Condition->Pos)
+            return Loop;
+    }
+    
+    Loop = HeapAllocMem(pc, sizeof(struct ParseLoop));
+    if (Loop == NULL)
+        ProgramFail(Parser, "out of memory");
+    
+    HEAP_ALLOC_USE(pc, PicocHeapTables, sizeof(struct ParseLoop));
+    Loop->Pos = Condition->Pos;
+    ParserCopy(&ExpressionParser, Parser);
+    ParserCopyPos(&ExpressionParser, Condition);
+    Loop->Condition = BytecodeCompileExpression(pc, &ExpressionParser, (Increment != NULL) ? TokenSemicolon : TokenCloseBracket, Loop->Name, &Loop->NumNames, &Loop->Assigned);
+    if (Increment != NULL)
+    {
+        ParserCopyPos(&ExpressionParser, Increment);
+        Loop->Increment = BytecodeCompileExpression(pc, &ExpressionParser, TokenCloseBracket, Loop->Name, &Loop->NumNames, &Loop->Assigned);
+    }
+    
+    Loop->Next = Func->Loops;
+    Func->Loops = Loop;
+    return Loop;
+}
+
+/* check whether a running loop's compiled expressions can be used, finding their variables
+ * again if a global might have been deleted */
+static int ParseLoopCompiled(struct ParseState *Parser, struct ParseLoopRun *Run)
+{
+    if (Run->Loop == NULL)
+        return FALSE;
+    
+    if (Run->Generation != Parser->pc->GlobalGeneration && !ParseLoopVariables(Parser, Run))
+    {
+        Run->Loop = NULL;
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+#endif
+
+/* get ready to run a loop's condition and increment from compiled code the next times 
+ * round, if they can be */
+static void ParseLoopStart(struct ParseState *Parser, struct ParseLoopRun *Run, struct ParseState *Condition, struct ParseState *Increment)
+{
+#ifndef NO_BYTECODE
+    Run->Loop = ParseGetLoop(Parser, Condition, Increment);
+    if (Run->Loop != NULL && (Run->Loop->Condition != NULL || Run->Loop->Increment != NULL))
+    {
+        if (!ParseLoopVariables(Parser, Run))
+            Run->Loop = NULL;
+    }
+    else
+        Run->Loop = NULL;
+#endif
+}
+
+/* evaluate a loop's condition. Parser is at the condition */
+static int ParseLoopCondition(struct ParseState *Parser, struct ParseLoopRun *Run)
+{
+#ifndef NO_BYTECODE
+    if (ParseLoopCompiled(Parser, Run) && Run->Loop->Condition != NULL)
+        return (int)BytecodeRunExpression(Run->Loop->Condition, Run->Var);
+#endif
+    
+    if (LexGetToken(Parser, NULL, FALSE) == TokenSemicolon)
+        return TRUE;
+    
+    return ExpressionParseInt(Parser);
+}
+
+/* run a for loop's increment. Parser is at the increment */
+static void ParseLoopIncrement(struct ParseState *Parser, struct ParseLoopRun *Run)
+{
+#ifndef NO_BYTECODE
+    if (ParseLoopCompiled(Parser, Run) && Run->Loop->Increment != NULL)
+    {
+        /* it counts as a statement just as if it was parsed */
+        if (--Parser->pc->StatementsLeft == 0)
+            ParseStatementBudget(Parser);
+        
+        if (Parser->DebugMode)
+            DebugCheckStatement(Parser);
+        
+#ifndef NO_PROFILER
+        if (Parser->pc->Profiling)
+            ProfileStatement(Parser);
+#endif
+        
+        BytecodeRunExpression(Run->Loop->Increment, Run->Var);
+        return;
+    }
+#endif
+    
+    ParseStatement(Parser, FALSE);
+}
+
 /* parse a "for" statement */
 void ParseFor(struct ParseState *Parser)
 {
@@ -455,10 +666,11 @@ void ParseFor(struct ParseState *Parser)
     struct ParseState PreIncrement;
     struct ParseState PreStatement;
     struct ParseState After;
+    struct ParseLoopRun Run;
     
     enum RunMode OldMode = Parser->Mode;
     
-    int16_t PrevScopeID = 0, ScopeID = VariableScopeBegin(Parser, &PrevScopeID);
+    VariableScopeBegin(Parser);
 
     if (LexGetToken(Parser, NULL, TRUE) != TokenOpenBracket)
         ProgramFail(Parser, "'(' expected");
@@ -489,17 +701,17 @@ void ParseFor(struct ParseState *Parser)
         Parser->Mode = RunModeRun;
         
     ParserCopyPos(&After, Parser);
+    
+    if (Condition && Parser->Mode == RunModeRun)
+        ParseLoopStart(Parser, &Run, &PreConditional, &PreIncrement);
         
     while (Condition && Parser->Mode == RunModeRun)
     {
         ParserCopyPos(Parser, &PreIncrement);
-        ParseStatement(Parser, FALSE);
+        ParseLoopIncrement(Parser, &Run);
                         
         ParserCopyPos(Parser, &PreConditional);
-        if (LexGetToken(Parser, NULL, FALSE) == TokenSemicolon)
-            Condition = TRUE;
-        else
-            Condition = ExpressionParseInt(Parser);
+        Condition = ParseLoopCondition(Parser, &Run);
         
         if (Condition)
         {
@@ -514,19 +726,301 @@ void ParseFor(struct ParseState *Parser)
     if (Parser->Mode == RunModeBreak && OldMode == RunModeRun)
         Parser->Mode = RunModeRun;
 
-    VariableScopeEnd(Parser, ScopeID, PrevScopeID);
+    VariableScopeEnd(Parser);
 
     ParserCopyPos(Parser, &After);
 }
 
+/* a goto label in a function */
+struct ParseGotoLabel
+{
+    const char *Name;               /* the label's name, or NULL for an empty hash slot */
+    const unsigned char *Pos;       /* the label, or NULL if a goto to it has to search */
+    const unsigned char *Block;     /* the start of the block it's directly in */
+    const unsigned char *Declaration;   /* the last declaration before it in the same block, or NULL */
+    short int Line;
+};
+
+/* a block in a function */
+struct ParseGotoBlock
+{
+    const unsigned char *Start;     /* just after its opening brace */
+    const unsigned char *End;       /* its closing brace */
+    short int Line;
+};
+
+/* the goto labels and blocks of a function, found the first time a goto is run in it 
+ * so a goto can jump straight to its label instead of searching for it */
+struct ParseGotoIndex
+{
+    int HashSize;                   /* the size of Label, a power of two, or 0 if the function can't be indexed */
+    int NumBlocks;
+    struct ParseGotoLabel *Label;   /* the labels hashed by their names */
+    struct ParseGotoBlock *Block;   /* the blocks in the order they start */
+};
+
+#define PARSE_GOTO_DEPTH 64         /* how deeply blocks can be nested in a function with a goto index */
+#define PARSE_GOTO_HASH(Name, Size) ((int)(((uint32_t)((unsigned long)(Name) >> 3) * (uint32_t)0x9e3779b9UL) >> 16) & ((Size) - 1))
+
+/* add a label to a goto index. a name which is used more than once, or for a label 
+ * which a search might not find, is kept with no position so gotos to it search */
+static void ParseGotoAddLabel(struct ParseGotoIndex *Index, const char *Name, const unsigned char *Pos, short int Line, const unsigned char *Block, const unsigned char *Declaration)
+{
+    int Slot;
+    
+    for (Slot = PARSE_GOTO_HASH(Name, Index->HashSize); Index->Label[Slot].Name != NULL && Index->Label[Slot].Name != Name; Slot = (Slot + 1) & (Index->HashSize - 1))
+    {}
+    
+    if (Index->Label[Slot].Name != NULL)
+        Pos = NULL;
+    
+    Index->Label[Slot].Name = Name;
+    Index->Label[Slot].Pos = Pos;
+    Index->Label[Slot].Line = Line;
+    Index->Label[Slot].Block = Block;
+    Index->Label[Slot].Declaration = Declaration;
+}
+
+/* find the goto labels and blocks of a function body. if Index has room for them they're 
+ * added to it. returns the number of labels, or -1 if the function can't be indexed 
+ * because its blocks are nested too deeply or it has something in it which has to be 
+ * parsed even when a goto skips it, like a preprocessor directive or a struct definition */
+static int ParseGotoLabels(struct ParseState *Parser, struct ParseGotoIndex *Index)
+{
+    struct
+    {
+        const unsigned char *Start;         /* just after the opening brace, or NULL for an initialiser */
+        const unsigned char *Declaration;   /* the last declaration directly in the block */
+        int Block;                          /* where the block is in the index */
+    } Stack[PARSE_GOTO_DEPTH];
+    const unsigned char *TokenPos;
+    short int TokenLine;
+    struct Value *LexValue;
+    enum LexToken Token;
+    enum LexToken LastToken = TokenNone;
+    int LabelColon = FALSE;
+    int StatementStart;
+    int Depth = -1;
+    int Brackets = 0;
+    int NumLabels = 0;
+    
+    Index->NumBlocks = 0;
+    do
+    {
+        TokenPos = Parser->Pos;
+        TokenLine = Parser->Line;
+        Token = LexGetRawToken(Parser, &LexValue, TRUE);
+        StatementStart = Depth >= 0 && Stack[Depth].Start != NULL && Brackets == 0 && 
+                (LastToken == TokenSemicolon || LastToken == TokenLeftBrace || LastToken == TokenRightBrace || LastToken == TokenColon);
+        
+        switch (Token)
+        {
+            case TokenLeftBrace:
+                if (++Depth >= PARSE_GOTO_DEPTH)
+                    return -1;
+                
+                Stack[Depth].Declaration = NULL;
+                if (Depth > 0 && (Stack[Depth-1].Start == NULL || LastToken == TokenAssign))
+                    Stack[Depth].Start = NULL;
+                else
+                {
+                    Stack[Depth].Start = Parser->Pos;
+                    Stack[Depth].Block = Index->NumBlocks++;
+                    if (Index->Block != NULL)
+                        Index->Block[Stack[Depth].Block].Start = Parser->Pos;
+                }
+                break;
+            
+            case TokenRightBrace:
+                if (Depth < 0)
+                    return -1;
+                
+                if (Stack[Depth].Start != NULL && Index->Block != NULL)
+                {
+                    Index->Block[Stack[Depth].Block].End = TokenPos;
+                    Index->Block[Stack[Depth].Block].Line = TokenLine;
+                }
+                Depth--;
+                break;
+            
+            case TokenOpenBracket:
+                Brackets++;
+                break;
+            
+            case TokenCloseBracket:
+                Brackets--;
+                break;
+            
+            case TokenIdentifier:
+                if (LexRawPeekToken(Parser) == TokenColon && LastToken != TokenCase && LastToken != TokenQuestionMark)
+                {
+                    /* it's a label, or might be part of a conditional expression. labels
+                     * which don't start a statement directly in a block aren't indexed */
+                    LexGetRawToken(Parser, NULL, TRUE);
+                    LabelColon = StatementStart && (LastToken != TokenColon || LabelColon);
+                    if (Index->Label != NULL)
+                        ParseGotoAddLabel(Index, LexValue->Val->Identifier, LabelColon ? TokenPos : NULL, TokenLine, 
+                                LabelColon ? Stack[Depth].Start : NULL, LabelColon ? Stack[Depth].Declaration : NULL);
+                    
+                    NumLabels++;
+                    LastToken = TokenColon;
+                    continue;
+                }
+                
+                if (StatementStart && (LexRawPeekToken(Parser) == TokenIdentifier || LexRawPeekToken(Parser) == TokenAsterisk))
+                    Stack[Depth].Declaration = TokenPos;   /* it might be declared with a typedef */
+                break;
+            
+            case TokenStructType: case TokenUnionType: case TokenEnumType:
+                if (LexRawPeekToken(Parser) == TokenIdentifier)
+                    LexGetRawToken(Parser, NULL, TRUE);
+                
+                if (LexRawPeekToken(Parser) == TokenLeftBrace)
+                    return -1;
+                
+                if (StatementStart)
+                    Stack[Depth].Declaration = TokenPos;
+                break;
+            
+            case TokenIntType: case TokenCharType: case TokenFloatType: case TokenDoubleType: case TokenVoidType: 
+            case TokenLongType: case TokenSignedType: case TokenShortType: case TokenStaticType: case TokenAutoType: 
+            case TokenRegisterType: case TokenExternType: case TokenUnsignedType: case TokenTypedef:
+                if (StatementStart)
+                    Stack[Depth].Declaration = TokenPos;
+                break;
+            
+            case TokenHashDefine: case TokenHashInclude: case TokenHashIf: case TokenHashIfdef: 
+            case TokenHashIfndef: case TokenHashElse: case TokenHashEndif:
+            case TokenEOF: case TokenEndOfFunction:
+                return -1;
+            
+            default:
+                break;
+        }
+        
+        LastToken = Token;
+        LabelColon = FALSE;
+    } while (Depth >= 0);
+    
+    return NumLabels;
+}
+
+/* get the goto index of the function we're running, making it the first time a goto 
+ * is run in it. returns NULL if we're not in a function or it can't be indexed */
+static struct ParseGotoIndex *ParseGetGotoIndex(struct ParseState *Parser)
+{
+    Picoc *pc = Parser->pc;
+    struct FuncDef *Func = (pc->TopStackFrame != NULL) ? pc->TopStackFrame->Func : NULL;
+    struct ParseGotoIndex *Index;
+    struct ParseGotoIndex Scan;
+    struct ParseState ScanParser;
+    int NumLabels;
+    int HashSize = 2;
+    int Size;
+    
+    if (Func == NULL || Func->Body == NULL)
+        return NULL;
+    
+    if (Func->Gotos == NULL)
+    {
+        /* count the labels and blocks then make room for them and add them */
+        memset((void *)&Scan, '\0', sizeof(Scan));
+        ParserCopy(&ScanParser, Func->Body);
+        NumLabels = ParseGotoLabels(&ScanParser, &Scan);
+        while (HashSize < NumLabels * 2)
+            HashSize *= 2;
+        
+        if (NumLabels <= 0)
+        {
+            HashSize = 0;
+            Scan.NumBlocks = 0;
+        }
+        
+        Size = sizeof(struct ParseGotoIndex) + sizeof(struct ParseGotoLabel) * HashSize + sizeof(struct ParseGotoBlock) * Scan.NumBlocks;
+        Index = HeapAllocMem(pc, Size);
+        if (Index == NULL)
+            ProgramFail(Parser, "out of memory");
+        
+        HEAP_ALLOC_USE(pc, PicocHeapTables, Size);
+        Index->Label = (struct ParseGotoLabel *)((char *)Index + sizeof(struct ParseGotoIndex));
+        Index->Block = (struct ParseGotoBlock *)((char *)Index->Label + sizeof(struct ParseGotoLabel) * HashSize);
+        if (NumLabels > 0)
+        {
+            Index->HashSize = HashSize;
+            ParserCopy(&ScanParser, Func->Body);
+            if (ParseGotoLabels(&ScanParser, Index) != NumLabels)
+                Index->HashSize = 0;
+        }
+        
+        Func->Gotos = Index;
+    }
+    
+    return (Func->Gotos->HashSize != 0) ? Func->Gotos : NULL;
+}
+
+/* carry on with a goto in a block which starts at Block. if the label is directly in the 
+ * block go straight to it, as long as that doesn't skip a declaration which the search 
+ * would have made. if the label isn't anywhere in the block skip the rest of it */
+static void ParseGotoJump(struct ParseState *Parser, const unsigned char *Block)
+{
+    struct ParseGotoIndex *Index = ParseGetGotoIndex(Parser);
+    struct ParseGotoLabel *Label;
+    int Slot;
+    int Low;
+    int High;
+    int Middle;
+    
+    if (Index == NULL)
+        return;
+    
+    for (Slot = PARSE_GOTO_HASH(Parser->SearchGotoLabel, Index->HashSize); Index->Label[Slot].Name != NULL && Index->Label[Slot].Name != Parser->SearchGotoLabel; Slot = (Slot + 1) & (Index->HashSize - 1))
+    {}
+    
+    Label = &Index->Label[Slot];
+    if (Label->Name == NULL || Label->Pos == NULL)
+        return;
+    
+    if (Label->Block == Block)
+    {
+        if (Label->Declaration == NULL || Parser->Pos > Label->Declaration)
+        {
+            Parser->Pos = Label->Pos;
+            Parser->Line = Label->Line;
+        }
+        return;
+    }
+    
+    for (Low = 0, High = Index->NumBlocks - 1; Low <= High; )
+    {
+        Middle = (Low + High) / 2;
+        if (Index->Block[Middle].Start == Block)
+        {
+            if (Label->Pos < Block || Label->Pos > Index->Block[Middle].End)
+            {
+                Parser->Pos = Index->Block[Middle].End;
+                Parser->Line = Index->Block[Middle].Line;
+            }
+            return;
+        }
+        else if (Index->Block[Middle].Start < Block)
+            Low = Middle + 1;
+        else
+            High = Middle - 1;
+    }
+}
+
 /* parse a block of code and return what mode it returned in */
 enum RunMode ParseBlock(struct ParseState *Parser, int AbsorbOpenBrace, int Condition)
 {
-    int16_t PrevScopeID = 0, ScopeID = VariableScopeBegin(Parser, &PrevScopeID);
+    const unsigned char *Block;
+    
+    VariableScopeBegin(Parser);
 
     if (AbsorbOpenBrace && LexGetToken(Parser, NULL, TRUE) != TokenLeftBrace)
         ProgramFail(Parser, "'{' expected");
 
+    Block = Parser->Pos;
+
     if (Parser->Mode == RunModeSkip || !Condition)
     { 
         /* condition failed - skip this block instead */
@@ -540,17 +1034,381 @@ enum RunMode ParseBlock(struct ParseState *Parser, int AbsorbOpenBrace, int Cond
     { 
         /* just run it in its current mode */
         while (ParseStatement(Parser, TRUE) == ParseResultOk)
-        {}
+        {
+            if (Parser->Mode == RunModeGoto)
+                ParseGotoJump(Parser, Block);
+        }
     }
     
     if (LexGetToken(Parser, NULL, TRUE) != TokenRightBrace)
         ProgramFail(Parser, "'}' expected");
 
-    VariableScopeEnd(Parser, ScopeID, PrevScopeID);
+    VariableScopeEnd(Parser);
 
     return Parser->Mode;
 }
 
+/* where a case label of an indexed switch statement goes to */
+struct ParseCaseLabel
+{
+    const unsigned char *Pos;       /* the statement after the label, or NULL for an empty hash slot */
+    short int Line;
+    int Value;
+};
+
+/* the case labels of a switch statement in a function, indexed by their values the first
+ * time it's run so it can go straight to the right one instead of searching for it */
+struct ParseSwitch
+{
+    const unsigned char *Pos;       /* the switch's opening brace */
+    struct ParseSwitch *Next;       /* the next switch in the same function */
+    int Indexed;                    /* FALSE if its labels can't be indexed so it has to search */
+    int HashSize;                   /* the size of Case, a power of two */
+    struct ParseCaseLabel Default;  /* the default label, Pos is NULL if there isn't one */
+    struct ParseCaseLabel End;      /* the switch's closing brace */
+    struct ParseCaseLabel *Case;    /* the case labels hashed by their values */
+};
+
+#define PARSE_CONSTANT_MACRO_DEPTH 8    /* how deeply macros defined as other macros are followed */
+#define PARSE_CASE_HASH(Value, Size) ((int)(((uint32_t)(Value) * (uint32_t)0x9e3779b9UL) >> 16) & ((Size) - 1))
+
+static int ParseCountConstantTokens(struct ParseState *Parser, enum LexToken EndToken, int MacrosOnly, int Depth);
+
+/* check whether a name always has the same integer value. it can be an integer constant
+ * like an enum value or a macro with no parameters whose body is a constant expression.
+ * MacrosOnly only allows macros, which unlike enum values can't be hidden by a local */
+static int ParseIsConstantName(Picoc *pc, const char *Ident, int MacrosOnly, int Depth)
+{
+    struct Value *Val = VariableGetConstant(pc, Ident);
+    struct ParseState MacroParser;
+    
+    if (Val == NULL)
+        return FALSE;
+    
+    if (IS_INTEGER_NUMERIC(Val) && !MacrosOnly)
+        return TRUE;
+    
+    if (Val->Typ != &pc->MacroType || Val->Val->MacroDef.NumParams != 0 || Depth >= PARSE_CONSTANT_MACRO_DEPTH)
+        return FALSE;
+    
+    ParserCopy(&MacroParser, &Val->Val->MacroDef.Body);
+    return ParseCountConstantTokens(&MacroParser, TokenEndOfFunction, MacrosOnly, Depth + 1) > 0;
+}
+
+/* count the tokens up to EndToken if they're an integer constant expression, which will
+ * give the same value every time it's evaluated. if EndToken is TokenNone the expression
+ * runs until a token which ends an expression, like a semicolon or an unmatched bracket.
+ * leaves the parser after the end token. returns 0 if it isn't a constant expression */
+static int ParseCountConstantTokens(struct ParseState *Parser, enum LexToken EndToken, int MacrosOnly, int Depth)
+{
+    struct Value *LexValue;
+    enum LexToken Token;
+    int Brackets = 0;
+    int Count = 0;
+    
+    while ((Token = LexGetRawToken(Parser, &LexValue, TRUE)) != EndToken || Brackets > 0)
+    {
+        if (Token == TokenIdentifier)
+        {
+            if (!ParseIsConstantName(Parser->pc, LexValue->Val->Identifier, MacrosOnly, Depth))
+                return 0;
+        }
+        else if (Token == TokenOpenBracket)
+            Brackets++;
+        else if (Token == TokenCloseBracket && Brackets > 0)
+            Brackets--;
+        else if (!((Token >= TokenLogicalOr && Token <= TokenModulus) || Token == TokenUnaryNot || Token == TokenUnaryExor || 
+                Token == TokenIntegerConstant || Token == TokenCharacterConstant))
+        {
+            if (EndToken == TokenNone && Brackets == 0 && (Token == TokenComma || Token == TokenColon || Token == TokenCloseBracket || 
+                    Token == TokenRightSquareBracket || Token == TokenSemicolon || Token == TokenRightBrace || Token == TokenEndOfFunction))
+                break;
+            
+            return 0;
+        }
+        
+        Count++;
+    }
+    
+    return Count;
+}
+
+/* check whether the tokens up to EndToken, or to the end of the expression if it's TokenNone,
+ * are an integer constant expression. MacrosOnly doesn't allow names other than macros. 
+ * returns how many tokens there are or 0 if it isn't constant */
+int ParseIsConstantExpression(struct ParseState *Parser, enum LexToken EndToken, int MacrosOnly)
+{
+    return ParseCountConstantTokens(Parser, EndToken, MacrosOnly, 0);
+}
+
+/* skip over a switch statement nested in the one we're indexing. Parser is just after the "switch" */
+static int ParseSkipSwitch(struct ParseState *Parser)
+{
+    enum LexToken Token;
+    int Depth = 0;
+    
+    while ((Token = LexGetRawToken(Parser, NULL, TRUE)) != TokenLeftBrace)
+    {
+        if (Token == TokenEOF || Token == TokenEndOfFunction || Token == TokenRightBrace)
+            return FALSE;
+    }
+    
+    for (Depth = 1; Depth > 0; )
+    {
+        Token = LexGetRawToken(Parser, NULL, TRUE);
+        if (Token == TokenLeftBrace)
+            Depth++;
+        else if (Token == TokenRightBrace)
+            Depth--;
+        else if (Token == TokenEOF || Token == TokenEndOfFunction || (Token >= TokenHashDefine && Token <= TokenHashEndif))
+            return FALSE;
+    }
+    
+    return TRUE;
+}
+
+/* add a case label to a switch's index. the first label with a value is the one a 
+ * search would have found */
+static void ParseSwitchAddCase(struct ParseSwitch *Switch, struct ParseState *Parser, int Value)
+{
+    int Slot;
+    
+    for (Slot = PARSE_CASE_HASH(Value, Switch->HashSize); Switch->Case[Slot].Pos != NULL; Slot = (Slot + 1) & (Switch->HashSize - 1))
+    {
+        if (Switch->Case[Slot].Value == Value)
+            return;
+    }
+    
+    Switch->Case[Slot].Pos = Parser->Pos;
+    Switch->Case[Slot].Line = Parser->Line;
+    Switch->Case[Slot].Value = Value;
+}
+
+/* find the labels of a switch statement. Parser is at its opening brace. if Switch has 
+ * room for the case labels they're evaluated and added to it. returns the number of case
+ * labels, or -1 if the labels can't be indexed because they aren't all constants directly
+ * inside the switch's block or because the block has something in it which has to be 
+ * parsed even when it's skipped, like a preprocessor directive or a struct definition */
+static int ParseSwitchLabels(struct ParseState *Parser, struct ParseSwitch *Switch)
+{
+    struct ParseState CaseParser;
+    struct Value *LexValue;
+    enum LexToken Token;
+    int NumCases = 0;
+    int Depth = 0;
+    int Value;
+    
+    do
+    {
+        Switch->End.Pos = Parser->Pos;
+        Switch->End.Line = Parser->Line;
+        Token = LexGetRawToken(Parser, &LexValue, TRUE);
+        switch (Token)
+        {
+            case TokenLeftBrace: 
+                Depth++; 
+                break;
+            
+            case TokenRightBrace: 
+                Depth--; 
+                break;
+            
+            case TokenSwitch:
+                if (!ParseSkipSwitch(Parser))
+                    return -1;
+                break;
+            
+            case TokenCase:
+                if (Depth != 1)
+                    return -1;
+                
+                ParserCopy(&CaseParser, Parser);
+                if (!ParseIsConstantExpression(Parser, TokenColon, FALSE))
+                    return -1;
+                
+                if (Switch->Case != NULL)
+                {
+                    CaseParser.Mode = RunModeRun;
+                    Value = ExpressionParseInt(&CaseParser);
+                    if (LexGetRawToken(&CaseParser, NULL, TRUE) != TokenColon || CaseParser.Pos != Parser->Pos)
+                        return -1;
+                    
+                    ParseSwitchAddCase(Switch, Parser, Value);
+                }
+                
+                NumCases++;
+                break;
+            
+            case TokenDefault:
+                if (Depth != 1 || LexGetRawToken(Parser, NULL, TRUE) != TokenColon)
+                    return -1;
+                
+                if (Switch->Default.Pos == NULL)
+                {
+                    Switch->Default.Pos = Parser->Pos;
+                    Switch->Default.Line = Parser->Line;
+                }
+                break;
+            
+            case TokenStructType: case TokenUnionType: case TokenEnumType:
+                if (LexRawPeekToken(Parser) == TokenIdentifier)
+                    LexGetRawToken(Parser, NULL, TRUE);
+                
+                if (LexRawPeekToken(Parser) == TokenLeftBrace)
+                    return -1;
+                break;
+            
+            case TokenHashDefine: case TokenHashInclude: case TokenHashIf: case TokenHashIfdef: 
+            case TokenHashIfndef: case TokenHashElse: case TokenHashEndif:
+            case TokenEOF: case TokenEndOfFunction:
+                return -1;
+            
+            default:
+                break;
+        }
+    } while (Depth > 0);
+    
+    return NumCases;
+}
+
+/* get the index of a switch statement in the function we're running, making it the first
+ * time the switch is run. Parser is at the switch's opening brace. returns NULL if we're
+ * not in a function or the switch can't be indexed */
+static struct ParseSwitch *ParseGetSwitch(struct ParseState *Parser)
+{
+    Picoc *pc = Parser->pc;
+    struct FuncDef *Func = (pc->TopStackFrame != NULL) ? pc->TopStackFrame->Func : NULL;
+    struct ParseSwitch *Switch;
+    struct ParseSwitch Scan;
+    struct ParseState ScanParser;
+    int NumCases;
+    int HashSize = 2;
+    
+    if (Func == NULL)
+        return NULL;
+    
+    for (Switch = Func->Switches; Switch != NULL; Switch = Switch->Next)
+    {
+        if (Switch->Pos == Parser->Pos)
+            return Switch->Indexed ? Switch : NULL;
+    }
+    
+    /* count the labels then make room for them and add them */
+    memset((void *)&Scan, '\0', sizeof(Scan));
+    ParserCopy(&ScanParser, Parser);
+    NumCases = ParseSwitchLabels(&ScanParser, &Scan);
+    while (HashSize < NumCases * 2)
+        HashSize *= 2;
+    
+    if (NumCases < 0)
+        HashSize = 0;
+    
+    Switch = HeapAllocMem(pc, sizeof(struct ParseSwitch) + sizeof(struct ParseCaseLabel) * HashSize);
+    if (Switch == NULL)
+        ProgramFail(Parser, "out of memory");
+    
+    HEAP_ALLOC_USE(pc, PicocHeapTables, sizeof(struct ParseSwitch) + sizeof(struct ParseCaseLabel) * HashSize);
+    Switch->Pos = Parser->Pos;
+    Switch->HashSize = HashSize;
+    Switch->Case = (struct ParseCaseLabel *)((char *)Switch + sizeof(struct ParseSwitch));
+    if (NumCases >= 0)
+    {
+        ParserCopy(&ScanParser, Parser);
+        Switch->Indexed = ParseSwitchLabels(&ScanParser, Switch) == NumCases;
+    }
+    
+    Switch->Next = Func->Switches;
+    Func->Switches = Switch;
+    return Switch->Indexed ? Switch : NULL;
+}
+
+/* run a switch statement's block from the label for a value, or skip it if there isn't one */
+static void ParseSwitchBlock(struct ParseState *Parser, struct ParseSwitch *Switch, int Value)
+{
+    struct ParseCaseLabel *Label;
+    const unsigned char *Block;
+    int Slot;
+    
+    for (Slot = PARSE_CASE_HASH(Value, Switch->HashSize); Switch->Case[Slot].Pos != NULL && Switch->Case[Slot].Value != Value; Slot = (Slot + 1) & (Switch->HashSize - 1))
+    {}
+    
+    Label = &Switch->Case[Slot];
+    if (Label->Pos == NULL)
+        Label = (Switch->Default.Pos != NULL) ? &Switch->Default : &Switch->End;
+    
+    VariableScopeBegin(Parser);
+    LexGetToken(Parser, NULL, TRUE);
+    Block = Parser->Pos;
+    Parser->Pos = Label->Pos;
+    Parser->Line = Label->Line;
+    Parser->Mode = RunModeRun;
+    while (ParseStatement(Parser, TRUE) == ParseResultOk)
+    {
+        if (Parser->Mode == RunModeBreak || Parser->Mode == RunModeContinue || Parser->Mode == RunModeReturn)
+        {
+            /* the rest of the block would only be skipped */
+            Parser->Pos = Switch->End.Pos;
+            Parser->Line = Switch->End.Line;
+            break;
+        }
+        else if (Parser->Mode == RunModeGoto)
+            ParseGotoJump(Parser, Block);
+    }
+    
+    if (LexGetToken(Parser, NULL, TRUE) != TokenRightBrace)
+        ProgramFail(Parser, "'}' expected");
+
+    VariableScopeEnd(Parser);
+}
+
+/* free the switch and goto indexes, the constant expression values, the struct member sites and the compiled loops of a function */
+void ParseFreeIndexes(Picoc *pc, struct FuncDef *Def)
+{
+#ifndef NO_BYTECODE
+    while (Def->Loops != NULL)
+    {
+        struct ParseLoop *Next = Def->Loops->Next;
+        
+        if (Def->Loops->Condition != NULL)
+            HeapFreeMem(pc, Def->Loops->Condition);
+        if (Def->Loops->Increment != NULL)
+            HeapFreeMem(pc, Def->Loops->Increment);
+        HeapFreeMem(pc, Def->Loops);
+        Def->Loops = Next;
+    }
+    
+#endif
+#ifndef NO_FOLDING
+    if (Def->Folds != NULL)
+    {
+        HeapFreeMem(pc, Def->Folds);
+        Def->Folds = NULL;
+    }
+    
+#endif
+#ifndef NO_MEMBER_CACHE
+    if (Def->MemberSites != NULL)
+    {
+        HeapFreeMem(pc, Def->MemberSites);
+        Def->MemberSites = NULL;
+    }
+    
+#endif
+    if (Def->Gotos != NULL)
+    {
+        HeapFreeMem(pc, Def->Gotos);
+        Def->Gotos = NULL;
+    }
+    
+    while (Def->Switches != NULL)
+    {
+        struct ParseSwitch *Next = Def->Switches->Next;
+        
+        HeapFreeMem(pc, Def->Switches);
+        Def->Switches = Next;
+    }
+}
+
 /* parse a typedef declaration */
 void ParseTypedef(struct ParseState *Parser)
 {
@@ -570,6 +1428,28 @@ void ParseTypedef(struct ParseState *Parser)
     }
 }
 
+/* the statement budget has run out. yield if we're running in a time slice, otherwise
+ * stop the program */
+void ParseStatementBudget(struct ParseState *Parser)
+{
+    Picoc *pc = Parser->pc;
+    
+    /* with no budget the count has just wrapped around */
+    if (pc->StatementBudget == 0)
+        return;
+    
+    pc->StatementsLeft = pc->StatementBudget;
+#ifndef NO_TIME_SLICE
+    if (pc->Slice != NULL)
+    {
+        PlatformSliceYield(pc);
+        return;
+    }
+#endif
+
+    ProgramFail(Parser, "statement budget exceeded");
+}
+
 /* parse a statement */
 enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemicolon)
 {
@@ -580,6 +1460,10 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
     struct ParseState PreState;
     enum LexToken Token;
     
+    /* stop or yield if we've run our share of statements */
+    if (Parser->Mode == RunModeRun && --Parser->pc->StatementsLeft == 0)
+        ParseStatementBudget(Parser);
+    
     /* if we're debugging, check for a breakpoint */
     if (Parser->DebugMode && Parser->Mode == RunModeRun)
         DebugCheckStatement(Parser);
@@ -588,6 +1472,12 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
     ParserCopy(&PreState, Parser);
     Token = LexGetToken(Parser, &LexerValue, TRUE);
     
+#ifndef NO_PROFILER
+    /* the line's only up to date once we've got the first token */
+    if (Parser->pc->Profiling && Parser->Mode == RunModeRun)
+        ProfileStatement(Parser);
+#endif
+
     switch (Token)
     {
         case TokenEOF:
@@ -690,27 +1580,46 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
         case TokenWhile:
             {
                 struct ParseState PreConditional;
+                struct ParseState PreStatement;
+                struct ParseState After;
+                struct ParseLoopRun Run;
                 enum RunMode PreMode = Parser->Mode;
 
                 if (LexGetToken(Parser, NULL, TRUE) != TokenOpenBracket)
                     ProgramFail(Parser, "'(' expected");
                     
                 ParserCopyPos(&PreConditional, Parser);
-                do
+                Condition = ExpressionParseInt(Parser);
+                if (LexGetToken(Parser, NULL, TRUE) != TokenCloseBracket)
+                    ProgramFail(Parser, "')' expected");
+                
+                ParserCopyPos(&PreStatement, Parser);
+                if (ParseStatementMaybeRun(Parser, Condition, TRUE) != ParseResultOk)
+                    ProgramFail(Parser, "statement expected");
+                
+                if (Parser->Mode == RunModeContinue)
+                    Parser->Mode = PreMode;
+                
+                ParserCopyPos(&After, Parser);
+                
+                if (Condition && Parser->Mode == RunModeRun)
+                    ParseLoopStart(Parser, &Run, &PreConditional, NULL);
+                
+                while (Condition && Parser->Mode == RunModeRun)
                 {
                     ParserCopyPos(Parser, &PreConditional);
-                    Condition = ExpressionParseInt(Parser);
-                    if (LexGetToken(Parser, NULL, TRUE) != TokenCloseBracket)
-                        ProgramFail(Parser, "')' expected");
-                    
-                    if (ParseStatementMaybeRun(Parser, Condition, TRUE) != ParseResultOk)
-                        ProgramFail(Parser, "statement expected");
-                    
-                    if (Parser->Mode == RunModeContinue)
-                        Parser->Mode = PreMode;
-                    
-                } while (Parser->Mode == RunModeRun && Condition);
+                    Condition = ParseLoopCondition(Parser, &Run);
+                    if (Condition)
+                    {
+                        ParserCopyPos(Parser, &PreStatement);
+                        ParseStatement(Parser, TRUE);
+                        
+                        if (Parser->Mode == RunModeContinue)
+                            Parser->Mode = PreMode;
+                    }
+                }
                 
+                ParserCopyPos(Parser, &After);
                 if (Parser->Mode == RunModeBreak)
                     Parser->Mode = PreMode;
 
@@ -809,12 +1718,21 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
                 /* new block so we can store parser state */
                 enum RunMode OldMode = Parser->Mode;
                 int OldSearchLabel = Parser->SearchLabel;
-                Parser->Mode = RunModeCaseSearch;
-                Parser->SearchLabel = Condition;
+                struct ParseSwitch *Switch = (OldMode == RunModeRun) ? ParseGetSwitch(Parser) : NULL;
                 
-                ParseBlock(Parser, TRUE, (OldMode != RunModeSkip) && (OldMode != RunModeReturn));
+                if (Switch != NULL)
+                    ParseSwitchBlock(Parser, Switch, Condition);
+                else if (OldMode == RunModeRun)
+                {
+                    Parser->Mode = RunModeCaseSearch;
+                    Parser->SearchLabel = Condition;
+                    ParseBlock(Parser, TRUE, TRUE);
+                }
+                else
+                    ParseBlock(Parser, TRUE, FALSE);    /* we're not running so don't look for a case */
                 
-                if (Parser->Mode != RunModeReturn)
+                /* a return, continue or goto carries on outside the switch */
+                if (Parser->Mode != RunModeReturn && Parser->Mode != RunModeContinue && Parser->Mode != RunModeGoto)
                     Parser->Mode = OldMode;
 
                 Parser->SearchLabel = OldSearchLabel;
@@ -914,12 +1832,18 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
             if (Parser->Mode == RunModeRun)
             { 
                 /* delete this variable or function */
+                VariableScopeForget(Parser->pc, LexerValue->Val->Identifier);
                 CValue = TableDelete(Parser->pc, &Parser->pc->GlobalTable, LexerValue->Val->Identifier);
 
                 if (CValue == NULL)
                     ProgramFail(Parser, "'%s' is not defined", LexerValue->Val->Identifier);
                 
+#ifndef BUILTIN_MINI_STDLIB
+                if (CValue == Parser->pc->ErrnoValue)
+                    Parser->pc->ErrnoValue = NULL;
+#endif
                 VariableFree(Parser->pc, CValue);
+                Parser->pc->GlobalGeneration++;
             }
             break;
         }
@@ -938,15 +1862,12 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
     return ParseResultOk;
 }
 
-/* quick scan a source file for definitions */
-void PicocParse(Picoc *pc, const char *FileName, const char *Source, int SourceLen, int RunIt, int CleanupNow, int CleanupSource, int EnableDebugger)
+/* parse a token stream, cleaning up the tokens afterwards or at PicocCleanup() */
+static void PicocParseTokens(Picoc *pc, char *RegFileName, const char *Source, void *Tokens, int RunIt, int CleanupNow, int CleanupSource, int EnableDebugger)
 {
     struct ParseState Parser;
     enum ParseResult Ok;
     struct CleanupTokenNode *NewCleanupNode;
-    char *RegFileName = TableStrRegister(pc, FileName);
-
-    void *Tokens = LexAnalyse(pc, RegFileName, Source, SourceLen, NULL);
 
     /* allocate a cleanup node so we can clean up the tokens later */
     if (!CleanupNow)
@@ -966,6 +1887,7 @@ void PicocParse(Picoc *pc, const char *FileName, const char *Source, int SourceL
     }
     
     /* do the parsing */
+    StdErrnoBind(pc);
     LexInitParser(&Parser, pc, Source, Tokens, RegFileName, NULL, RunIt, EnableDebugger);
 
     do {
@@ -980,12 +1902,51 @@ void PicocParse(Picoc *pc, const char *FileName, const char *Source, int SourceL
         HeapFreeMem(pc, Tokens);
 }
 
+/* quick scan a source file for definitions */
+void PicocParse(Picoc *pc, const char *FileName, const char *Source, int SourceLen, int RunIt, int CleanupNow, int CleanupSource, int EnableDebugger)
+{
+    char *RegFileName = TableStrRegister(pc, FileName);
+    void *Tokens = LexAnalyse(pc, RegFileName, Source, SourceLen, NULL);
+
+    PicocParseTokens(pc, RegFileName, Source, Tokens, RunIt, CleanupNow, CleanupSource, EnableDebugger);
+}
+
+#ifndef NO_TOKEN_IMAGE
+/* save the tokens of some source text as an image which PicocParseTokenImage() can run without
+ * lexing it again. returns the image, which the caller frees with HeapFreeMem() */
+void *PicocSaveTokenImage(Picoc *pc, const char *FileName, const char *Source, int SourceLen, int *ImageLen)
+{
+    char *RegFileName = TableStrRegister(pc, FileName);
+    int TokenLen;
+    void *Tokens = LexAnalyse(pc, RegFileName, Source, SourceLen, &TokenLen);
+    void *Image = LexImageCreate(pc, RegFileName, Tokens, TokenLen, ImageLen);
+
+    HeapFreeMem(pc, Tokens);
+    return Image;
+}
+
+/* load a token image saved by PicocSaveTokenImage(), ready for PicocParseTokenImage(). the
+ * image isn't needed afterwards. returns NULL if it wasn't saved by a picoc like this one */
+void *PicocLoadTokenImage(Picoc *pc, const void *Image, int ImageLen, const char **FileName)
+{
+    return LexImageLoad(pc, Image, ImageLen, (char **)FileName);
+}
+
+/* scan the tokens from a token image. FileName is the one PicocLoadTokenImage() gave. the
+ * source isn't available so errors are reported without it */
+void PicocParseTokenImage(Picoc *pc, const char *FileName, void *Tokens, int RunIt, int EnableDebugger)
+{
+    PicocParseTokens(pc, (char *)FileName, NULL, Tokens, RunIt, FALSE, FALSE, EnableDebugger);
+}
+#endif
+
 /* parse interactively */
 void PicocParseInteractiveNoStartPrompt(Picoc *pc, int EnableDebugger)
 {
     struct ParseState Parser;
     enum ParseResult Ok;
     
+    StdErrnoBind(pc);
     LexInitParser(&Parser, pc, NULL, NULL, pc->StrEmpty, NULL, TRUE, EnableDebugger);
     PicocPlatformSetExitPoint(pc);
     LexInteractiveClear(pc, &Parser);
@@ -995,8 +1956,7 @@ void PicocParseInteractiveNoStartPrompt(Picoc *pc, int EnableDebugger)
         LexInteractiveStatementPrompt(pc);
         Ok = ParseStatement(&Parser, TRUE);
         LexInteractiveCompleted(pc, &Parser);
-        extern int memused, varmemused;
-        debugline("memused: %d/%d\n", memused, varmemused);
+        debugline("memused: %d/%d\n", pc->HeapMemUsed, pc->VariableMemUsed);
     } while (Ok == ParseResultOk);
     
     if (Ok == ParseResultError)
@@ -1017,10 +1977,19 @@ void PicocParseLineByLine(Picoc *pc, const char *FileName, void *FilePointer, in
     struct ParseState Parser;
     enum ParseResult Ok;
     char *RegFileName = TableStrRegister(pc, FileName);
+    struct TokenLine *OuterHead = pc->InteractiveHead;
+    struct TokenLine *OuterTail = pc->InteractiveTail;
+    struct TokenLine *OuterCurrentLine = pc->InteractiveCurrentLine;
 
+    StdErrnoBind(pc);
     LexInitParser(&Parser, pc, NULL, NULL, RegFileName, FilePointer, TRUE, EnableDebugger);
     /*PicocPlatformSetExitPoint(pc);*/
-    LexInteractiveClear(pc, &Parser);
+
+    /* a file included line by line gets its own lines, so the lines of the file which
+     * included it are still there when we return to it. the last lines of the outermost
+     * file are kept until it's finished with */
+    pc->InteractiveHead = NULL;
+    pc->InteractiveTail = NULL;
 
     do
     {
@@ -1031,4 +2000,12 @@ void PicocParseLineByLine(Picoc *pc, const char *FileName, void *FilePointer, in
 
     if (Ok == ParseResultError)
         ProgramFail(&Parser, "parse error");
+
+    if (OuterHead != NULL)
+    {
+        LexInteractiveClear(pc, &Parser);
+        pc->InteractiveHead = OuterHead;
+        pc->InteractiveTail = OuterTail;
+        pc->InteractiveCurrentLine = OuterCurrentLine;
+    }
 }
@@ -11,11 +11,32 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifndef NO_PROFILER
+/* write the flat profile to stderr and the folded stacks to a file */
+static void WriteProfile(Picoc *pc, const char *FoldedFileName)
+{
+    FILE *FoldedFile;
+
+    PicocProfileStop(pc);
+    PicocProfileReport(pc, stderr);
+    FoldedFile = fopen(FoldedFileName, "w");
+    if (FoldedFile == NULL)
+    {
+        fprintf(stderr, "can't write file %s\n", FoldedFileName);
+        return;
+    }
+
+    PicocProfileFolded(pc, FoldedFile, FALSE);
+    fclose(FoldedFile);
+}
+#endif
+
 int main(int argc, char **argv)
 {
     int ParamCount = 1;
     int DontRunMain = FALSE;
     int LineByLine = FALSE;
+    const char *ProfileFileName = NULL;
     int StackSize = getenv("STACKSIZE") ? atoi(getenv("STACKSIZE")) : HEAP_SIZE;
     Picoc pc;
     
@@ -25,11 +46,17 @@ int main(int argc, char **argv)
     {
         printf("Format: picoc <csource1.c>... [- <arg1>...]    : run a program (calls main() to start it)\n"
                "        picoc -s <csource1.c>... [- <arg1>...] : script mode - runs the program without calling main()\n"
-               "        picoc -i                               : interactive mode\n");
+               "        picoc -i                               : interactive mode\n"
+               "        picoc -c <csource.c> <image>           : save a pre-tokenised image which can be run like a source file\n"
+               "        picoc -p <stacks> <csource1.c>...      : profile - writes a flat profile to stderr and folded stacks to a file\n");
         exit(1);
     }
     
-    PicocInitialise(&pc, StackSize);
+    if (!PicocInitialise(&pc, StackSize))
+    {
+        printf("not enough memory for the stack and heap\n");
+        exit(1);
+    }
     
     for (; ParamCount<=argc; ++ParamCount)
     {
@@ -50,6 +77,31 @@ int main(int argc, char **argv)
             PicocIncludeAllSystemHeaders(&pc);
             PicocParseInteractive(&pc);
             goto cleanup;
+#ifndef NO_TOKEN_IMAGE
+        case 'c':
+            if (ParamCount + 2 >= argc)
+            {
+                printf("picoc -c needs a source file and an image file\n");
+                exit(1);
+            }
+
+            if (!PicocPlatformSetExitPoint(&pc))
+                PicocPlatformSaveTokenImage(&pc, argv[ParamCount+1], argv[ParamCount+2]);
+
+            goto cleanup;
+#endif
+#ifndef NO_PROFILER
+        case 'p':
+            if (ParamCount + 1 >= argc)
+            {
+                printf("picoc -p needs a file for the folded stacks\n");
+                exit(1);
+            }
+
+            ProfileFileName = argv[++ParamCount];
+            PicocProfileStart(&pc);
+            break;
+#endif
         }
     }
 
@@ -77,10 +129,7 @@ int main(int argc, char **argv)
 #endif
     {
         if (PicocPlatformSetExitPoint(&pc))
-        {
-            PicocCleanup(&pc);
-            return pc.PicocExitValue;
-        }
+            goto cleanup;
         
         for (; ParamCount < argc && strcmp(argv[ParamCount], "-") != 0; ParamCount++)
         {
@@ -95,6 +144,10 @@ int main(int argc, char **argv)
     }
     
 cleanup:
+#ifndef NO_PROFILER
+    if (ProfileFileName != NULL)
+        WriteProfile(&pc, ProfileFileName);
+#endif
     PicocCleanup(&pc);
     return pc.PicocExitValue;
 }
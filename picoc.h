@@ -49,17 +49,86 @@ void PicocFreeCharBuffer(Picoc *pc, char *buf);
 
 #endif
 
+/* a script function which the host can call without looking it up each time */
+struct PicocFunction
+{
+    struct Value *FuncValue;
+    char *FuncName;
+};
+
+/* how the stack and the heap are being used, from PicocHeapStats(). with USE_MALLOC_HEAP
+ * only the stack and the allocation counts are filled in */
+#define PICOC_HEAP_RANGES 32
+
+struct PicocHeapStats
+{
+    int Size;                   /* bytes shared by the stack and the heap */
+    int StackUsed;              /* bytes on the stack */
+    int StackHighWater;         /* the most bytes there have been on the stack */
+    int HeapSize;               /* bytes from the bottom of the heap to the top */
+    int HeapHighWater;          /* the biggest the heap has been */
+    int HeapUsed;               /* bytes in allocated blocks */
+    int HeapFree;               /* bytes in free blocks inside the heap */
+    int Unused;                 /* bytes between the stack and the heap */
+    int FreeBlocks;
+    int LargestFreeBlock;
+    int FreeBytes[PICOC_HEAP_RANGES];       /* bytes in free blocks of 2^n to 2^(n+1)-1 bytes */
+    long Allocations[PicocHeapUses];        /* blocks allocated since PicocInitialise() */
+    long AllocatedBytes[PicocHeapUses];     /* bytes asked for in those blocks */
+};
+
 /* parse.c */
 void PicocParse(Picoc *pc, const char *FileName, const char *Source, int SourceLen, int RunIt, int CleanupNow, int CleanupSource, int EnableDebugger);
 void PicocParseInteractive(Picoc *pc);
 void PicocParseLineByLine(Picoc *pc, const char *FileName, void *FilePointer, int EnableDebugger);
+#ifndef NO_TOKEN_IMAGE
+void *PicocSaveTokenImage(Picoc *pc, const char *FileName, const char *Source, int SourceLen, int *ImageLen);
+void *PicocLoadTokenImage(Picoc *pc, const void *Image, int ImageLen, const char **FileName);
+void PicocParseTokenImage(Picoc *pc, const char *FileName, void *Tokens, int RunIt, int EnableDebugger);
+#endif
 
 /* platform.c */
 void PicocCallMain(Picoc *pc, int argc, char **argv);
-void PicocInitialise(Picoc *pc, int StackSize);
+int PicocInitialise(Picoc *pc, int StackSize);
 void PicocCleanup(Picoc *pc);
+void PicocSetStatementBudget(Picoc *pc, int Statements);
+int PicocGetFunction(Picoc *pc, const char *FuncName, struct PicocFunction *Func);
+void PicocCallFunctionHandle(Picoc *pc, struct PicocFunction *Func, union AnyValue *Args, int NumArgs, union AnyValue *Result);
+void PicocCallFunction(Picoc *pc, const char *FuncName, union AnyValue *Args, int NumArgs, union AnyValue *Result);
+#ifndef NO_SNAPSHOT
+void *PicocSnapshot(Picoc *pc, int *SnapshotLen);
+int PicocRestore(Picoc *pc, const void *Snapshot, int SnapshotLen);
+struct PicocPool;
+struct PicocPool *PicocPoolCreate(Picoc *Template, int NumInstances);
+void PicocPoolFree(struct PicocPool *Pool);
+Picoc *PicocPoolGet(struct PicocPool *Pool);
+void PicocPoolPut(struct PicocPool *Pool, Picoc *pc);
+#endif
 void PicocPlatformScanFile(Picoc *pc, const char *FileName);
 void PicocPlatformScanFileByLine(Picoc *pc, const char *FileName);
+#ifndef NO_TOKEN_IMAGE
+void PicocPlatformSaveTokenImage(Picoc *pc, const char *FileName, const char *ImageFileName);
+#endif
+#ifndef NO_SNAPSHOT
+void PicocPlatformSaveSnapshot(Picoc *pc, const char *FileName);
+int PicocPlatformLoadSnapshot(Picoc *pc, const char *FileName);
+#endif
+#ifndef NO_TIME_SLICE
+int PicocPlatformStartSlice(Picoc *pc, void (*Run)(Picoc *pc, void *Arg), void *Arg);
+int PicocPlatformResumeSlice(Picoc *pc);
+void PicocPlatformStopSlice(Picoc *pc);
+#endif
+
+/* heap.c */
+void PicocHeapStats(Picoc *pc, struct PicocHeapStats *Stats);
+
+/* profile.c */
+#ifndef NO_PROFILER
+void PicocProfileStart(Picoc *pc);
+void PicocProfileStop(Picoc *pc);
+void PicocProfileReport(Picoc *pc, FILE *Stream);
+void PicocProfileFolded(Picoc *pc, FILE *Stream, int CountStatements);
+#endif
 
 /* include.c */
 void PicocIncludeAllSystemHeaders(Picoc *pc);
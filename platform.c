@@ -5,13 +5,17 @@
 #include "interpreter.h"
 
 
-/* initialise everything */
-void PicocInitialise(Picoc *pc, int StackSize)
+/* initialise everything. StackSize is the memory for the stack and heap - on UNIX hosts
+ * less may be used if there isn't that much address space. returns FALSE if there's no
+ * memory for them, in which case the instance can't be used or cleaned up */
+int PicocInitialise(Picoc *pc, int StackSize)
 {
     memset(pc, '\0', sizeof(*pc));
     PlatformInit(pc);
     BasicIOInit(pc);
-    HeapInit(pc, StackSize);
+    if (!HeapInit(pc, StackSize))
+        return FALSE;
+    
     TableInit(pc);
     VariableInit(pc);
     LexInit(pc);
@@ -26,11 +30,15 @@ void PicocInitialise(Picoc *pc, int StackSize)
 #endif
     PlatformLibraryInit(pc);
     DebugInit(pc);
+    return TRUE;
 }
 
 /* free memory */
 void PicocCleanup(Picoc *pc)
 {
+#ifndef NO_PROFILER
+    ProfileCleanup(pc);
+#endif
     DebugCleanup(pc);
 #ifndef NO_HASH_INCLUDE
     IncludeCleanup(pc);
@@ -44,50 +52,700 @@ void PicocCleanup(Picoc *pc)
     PlatformCleanup(pc);
 }
 
-/* platform-dependent code for running programs */
-#if defined(UNIX_HOST) || defined(WIN32)
+/* limit how many statements can run before the program is stopped with an error, or before
+ * it yields if it's running in a time slice. 0 means there's no limit */
+void PicocSetStatementBudget(Picoc *pc, int Statements)
+{
+    pc->StatementBudget = Statements;
+    pc->StatementsLeft = Statements;
+}
 
-#define CALL_MAIN_NO_ARGS_RETURN_VOID "main();"
-#define CALL_MAIN_WITH_ARGS_RETURN_VOID "main(__argc,__argv);"
-#define CALL_MAIN_NO_ARGS_RETURN_INT "__exit_value = main();"
-#define CALL_MAIN_WITH_ARGS_RETURN_INT "__exit_value = main(__argc,__argv);"
+#ifndef NO_SNAPSHOT
+#define SNAPSHOT_MAGIC "picosnap"
+#define SNAPSHOT_VERSION 2
 
-void PicocCallMain(Picoc *pc, int argc, char **argv)
+/* used to check that a snapshot's pointers to static data are valid here */
+static const char SnapshotModule[] = SNAPSHOT_MAGIC;
+
+/* a snapshot is this header, a table of where the pointers into the instance are, and then
+ * the two used ends of the instance: from the start of the instance to the top of the stack
+ * and from the bottom of the heap to the end of the instance. when the stack and heap have
+ * memory of their own it's treated as if it followed on straight after the instance */
+struct SnapshotHeader
 {
-    /* check if the program wants arguments */
-    struct Value *FuncValue = NULL;
+    char Magic[sizeof(SNAPSHOT_MAGIC)];
+    int Version;
+    int InstanceSize;
+    int MemorySize;             /* the size of the stack and heap's own memory, if they have it */
+    int StackUsed;              /* bytes from the start of the instance to the top of the stack */
+    int HeapUsed;               /* bytes from the bottom of the heap to the end of the instance */
+    int NumRelocations;
+    const void *Module;         /* where our static data was when this was saved */
+    const void *Library;        /* where the C library's was */
+};
 
-    if (!VariableDefined(pc, TableStrRegister(pc, "main")))
-        ProgramFailNoParser(pc, "main() is not defined");
-        
-    VariableGet(pc, NULL, TableStrRegister(pc, "main"), &FuncValue);
-    if (FuncValue->Typ->Base != TypeFunction)
-        ProgramFailNoParser(pc, "main is not a function - can't call it");
+/* round an offset up to where a pointer can be */
+#define SNAPSHOT_ALIGN(Offset) (((Offset) + (int)sizeof(void *) - 1) & ~((int)sizeof(void *) - 1))
+
+/* the size of an instance including its stack and heap memory */
+#define SNAPSHOT_SIZE(Header) ((Header)->InstanceSize + (Header)->MemorySize)
+
+/* is this an offset into an instance where a pointer can be stored */
+static int SnapshotPointerFits(struct SnapshotHeader *Header, int Offset)
+{
+    return Offset >= 0 && ((Offset + (int)sizeof(void *) <= Header->StackUsed) ||
+        (Offset >= SNAPSHOT_SIZE(Header) - Header->HeapUsed && Offset + (int)sizeof(void *) <= SNAPSHOT_SIZE(Header)));
+}
+
+/* where an offset into the instance is in the saved copy of its two used ends */
+static unsigned char *SnapshotCopyPos(struct SnapshotHeader *Header, unsigned char *Copy, int Offset)
+{
+    if (Offset < Header->StackUsed)
+        return &Copy[Offset];
+    else
+        return &Copy[Header->StackUsed + Offset - (SNAPSHOT_SIZE(Header) - Header->HeapUsed)];
+}
+
+/* where an offset into the instance is, given where its stack and heap memory is */
+static unsigned char *SnapshotAddress(Picoc *pc, unsigned char *Memory, int Offset)
+{
+#ifdef USE_MALLOC_STACK
+    if (Offset >= (int)sizeof(*pc))
+        return &Memory[Offset - sizeof(*pc)];
+#endif
+    return (unsigned char *)pc + Offset;
+}
+
+/* the offset into the instance a pointer points to, -1 if it points somewhere else */
+static long SnapshotOffset(Picoc *pc, unsigned long Ptr)
+{
+#ifdef USE_MALLOC_STACK
+    if (Ptr >= (unsigned long)pc && Ptr < (unsigned long)pc + sizeof(*pc))
+        return Ptr - (unsigned long)pc;
+
+    if (Ptr >= (unsigned long)pc->HeapMemory && Ptr <= (unsigned long)pc->HeapMemory + pc->HeapMemorySize)
+        return sizeof(*pc) + Ptr - (unsigned long)pc->HeapMemory;
+#else
+    if (Ptr >= (unsigned long)pc && Ptr <= (unsigned long)pc + sizeof(*pc))
+        return Ptr - (unsigned long)pc;
+#endif
 
-    if (FuncValue->Val->FuncDef.NumParams != 0)
+    return -1;
+}
+
+/* copy part of the instance to or from a snapshot. it may run on from the instance into its
+ * stack and heap memory */
+static void SnapshotCopy(Picoc *pc, unsigned char *Memory, int Offset, unsigned char *Copy, int Len, int ToInstance)
+{
+#ifdef USE_MALLOC_STACK
+    if (Offset < (int)sizeof(*pc) && Offset + Len > (int)sizeof(*pc))
     {
-        /* define the arguments */
-        VariableDefinePlatformVar(pc, NULL, "__argc", &pc->IntType, (union AnyValue *)&argc, FALSE);
-        VariableDefinePlatformVar(pc, NULL, "__argv", pc->CharPtrPtrType, (union AnyValue *)&argv, FALSE);
+        int InstanceLen = sizeof(*pc) - Offset;
+
+        SnapshotCopy(pc, Memory, Offset, Copy, InstanceLen, ToInstance);
+        SnapshotCopy(pc, Memory, sizeof(*pc), &Copy[InstanceLen], Len - InstanceLen, ToInstance);
+        return;
     }
+#endif
+
+    if (ToInstance)
+        memcpy((void *)SnapshotAddress(pc, Memory, Offset), (void *)Copy, Len);
+    else
+        memcpy((void *)Copy, (void *)SnapshotAddress(pc, Memory, Offset), Len);
+}
 
-    if (FuncValue->Val->FuncDef.ReturnType == &pc->VoidType)
+/* a part of the heap whose contents are known, so ordinary data in it which happens to look
+ * like a pointer into the instance isn't taken for one */
+struct SnapshotRange
+{
+    unsigned long Start;
+    unsigned long End;
+    struct ValueType *Typ;      /* the type of a variable's data, or NULL if there are no pointers in it */
+};
+
+/* the known parts of the heap, sorted by where they start */
+struct SnapshotRanges
+{
+    int NumRanges;
+    int MaxRanges;
+    struct SnapshotRange *Range;
+};
+
+/* note a known part of the heap */
+static void SnapshotAddRange(Picoc *pc, struct SnapshotRanges *Ranges, const void *Start, int Len, struct ValueType *Typ)
+{
+    if (Start == NULL || Len <= 0 || (unsigned long)Start < (unsigned long)pc->HeapBottom || SnapshotOffset(pc, (unsigned long)Start) < 0)
+        return;
+
+    if (Ranges->NumRanges == Ranges->MaxRanges)
     {
-        if (FuncValue->Val->FuncDef.NumParams == 0)
-            PicocParse(pc, "startup", CALL_MAIN_NO_ARGS_RETURN_VOID, strlen(CALL_MAIN_NO_ARGS_RETURN_VOID), TRUE, TRUE, FALSE, TRUE);
-        else
-            PicocParse(pc, "startup", CALL_MAIN_WITH_ARGS_RETURN_VOID, strlen(CALL_MAIN_WITH_ARGS_RETURN_VOID), TRUE, TRUE, FALSE, TRUE);
+        struct SnapshotRange *NewRange;
+
+        Ranges->MaxRanges = (Ranges->MaxRanges == 0) ? 256 : Ranges->MaxRanges * 2;
+        NewRange = realloc(Ranges->Range, sizeof(struct SnapshotRange) * Ranges->MaxRanges);
+        if (NewRange == NULL)
+        {
+            free(Ranges->Range);
+            ProgramFailNoParser(pc, "out of memory");
+        }
+
+        Ranges->Range = NewRange;
     }
+
+    Ranges->Range[Ranges->NumRanges].Start = (unsigned long)Start;
+    Ranges->Range[Ranges->NumRanges].End = (unsigned long)Start + Len;
+    Ranges->Range[Ranges->NumRanges].Typ = Typ;
+    Ranges->NumRanges++;
+}
+
+static int SnapshotCompareRanges(const void *Range1, const void *Range2)
+{
+    unsigned long Start1 = ((const struct SnapshotRange *)Range1)->Start;
+    unsigned long Start2 = ((const struct SnapshotRange *)Range2)->Start;
+
+    return (Start1 > Start2) - (Start1 < Start2);
+}
+
+/* find the parts of the heap which hold things whose layout we know: the data of global and
+ * static variables, the tokens of function and macro bodies and of the files which have been
+ * parsed, and the shared strings */
+static void SnapshotFindRanges(Picoc *pc, struct SnapshotRanges *Ranges)
+{
+    struct CleanupTokenNode *Node;
+    struct TableEntry *Entry;
+    struct Value *Val;
+    int Pos = 0;
+
+    memset((void *)Ranges, '\0', sizeof(*Ranges));
+    while ((Entry = TableNext(&pc->GlobalTable, &Pos)) != NULL)
+    {
+        Val = Entry->p.v.Val;
+        switch (Val->Typ->Base)
+        {
+            case TypeFunction:
+                if (Val->Val->FuncDef.Body != NULL)
+                    SnapshotAddRange(pc, Ranges, Val->Val->FuncDef.Body->Pos, HeapMemSize((void *)Val->Val->FuncDef.Body->Pos), NULL);
+                break;
+
+            case TypeMacro:
+                SnapshotAddRange(pc, Ranges, Val->Val->MacroDef.Body.Pos, HeapMemSize((void *)Val->Val->MacroDef.Body.Pos), NULL);
+                break;
+
+            case TypeGotoLabel:
+            case Type_Type:
+                break;
+
+            default:
+                SnapshotAddRange(pc, Ranges, Val->Val, TypeSizeValue(Val, FALSE), Val->Typ);
+                break;
+        }
+    }
+
+    for (Node = pc->CleanupTokenList; Node != NULL; Node = Node->Next)
+    {
+        SnapshotAddRange(pc, Ranges, Node->Tokens, HeapMemSize(Node->Tokens), NULL);
+        if (Node->SourceText != NULL)
+            SnapshotAddRange(pc, Ranges, Node->SourceText, HeapMemSize((void *)Node->SourceText), NULL);
+    }
+
+    Pos = 0;
+    while ((Entry = TableNext(&pc->StringTable, &Pos)) != NULL)
+        SnapshotAddRange(pc, Ranges, Entry, &Entry->p.s.Key[Entry->p.s.Len + 1] - (char *)Entry, NULL);
+
+    if (Ranges->NumRanges > 0)
+        qsort((void *)Ranges->Range, Ranges->NumRanges, sizeof(struct SnapshotRange), &SnapshotCompareRanges);
+}
+
+/* can there be a pointer Offset bytes into a value of type Typ */
+static int SnapshotTypeHasPointer(struct ValueType *Typ, int Offset)
+{
+    struct TableEntry *Entry;
+    struct Value *Member;
+    int Pos = 0;
+
+    switch (Typ->Base)
+    {
+        case TypePointer:
+            return Offset == 0;
+
+        case TypeArray:
+            return Typ->FromType->Sizeof > 0 && SnapshotTypeHasPointer(Typ->FromType, Offset % Typ->FromType->Sizeof);
+
+        case TypeStruct:
+        case TypeUnion:
+            if (Typ->Members == NULL)
+                return FALSE;
+
+            while ((Entry = TableNext(Typ->Members, &Pos)) != NULL)
+            {
+                Member = Entry->p.v.Val;
+                if (Offset >= Member->Val->Integer && Offset < Member->Val->Integer + Member->Typ->Sizeof &&
+                        SnapshotTypeHasPointer(Member->Typ, Offset - Member->Val->Integer))
+                    return TRUE;
+            }
+
+            return FALSE;
+
+        default:
+            return FALSE;
+    }
+}
+
+/* find the pointers into the instance between two offsets in it and note where they are.
+ * pointers are aligned so only aligned words are tried. in the parts of the heap whose
+ * layout we know only the words which can hold pointers are tried. the exit point is only
+ * valid in the process which set it so it's left out. returns the number of pointers found */
+static int SnapshotFindPointers(Picoc *pc, struct SnapshotRanges *Ranges, int Pos, int End, int *Relocations)
+{
+    int ExitBufStart = (unsigned char *)&pc->PicocExitBuf - (unsigned char *)pc;
+    int ExitBufEnd = ExitBufStart + sizeof(pc->PicocExitBuf);
+    int NumRelocations = 0;
+    int NextRange = 0;
+    unsigned long Addr;
+    unsigned long Ptr;
+
+    for (Pos = SNAPSHOT_ALIGN(Pos); Pos + (int)sizeof(Ptr) <= End; Pos += sizeof(void *))
+    {
+        if (Pos + (int)sizeof(Ptr) > ExitBufStart && Pos < ExitBufEnd)
+            continue;
+
+#ifdef USE_MALLOC_STACK
+        /* pointers don't run on from the instance into its memory */
+        if (Pos < (int)sizeof(*pc) && Pos + (int)sizeof(Ptr) > (int)sizeof(*pc))
+            continue;
+#endif
+
+        /* is it in a part of the heap we know about */
+        Addr = (unsigned long)SnapshotAddress(pc, pc->HeapMemory, Pos);
+        while (NextRange < Ranges->NumRanges && Ranges->Range[NextRange].End <= Addr)
+            NextRange++;
+
+        if (NextRange < Ranges->NumRanges && Ranges->Range[NextRange].Start <= Addr)
+        {
+            struct SnapshotRange *Range = &Ranges->Range[NextRange];
+
+            if (Range->Typ == NULL || Addr + sizeof(Ptr) > Range->End || !SnapshotTypeHasPointer(Range->Typ, Addr - Range->Start))
+                continue;
+        }
+
+        memcpy((void *)&Ptr, (void *)Addr, sizeof(Ptr));
+        if (SnapshotOffset(pc, Ptr) >= 0)
+        {
+            if (Relocations != NULL)
+                Relocations[NumRelocations] = Pos;
+
+            NumRelocations++;
+        }
+    }
+
+    return NumRelocations;
+}
+
+/* save the state of an instance so it can be restored by PicocRestore(). this must be called
+ * between runs, not from inside a running program. static data and the C library are referred
+ * to directly so a snapshot can only be restored by the same process, or by another run of
+ * the same picoc binary loaded at the same address. returns a malloc()ed snapshot */
+void *PicocSnapshot(Picoc *pc, int *SnapshotLen)
+{
+    struct SnapshotHeader Header;
+    struct SnapshotRanges Ranges;
+    unsigned char *Snapshot;
+    unsigned char *Copy;
+    int *Relocations;
+    int NumStackRelocations;
+    unsigned long Ptr;
+    int Count;
+
+    memset((void *)&Header, '\0', sizeof(Header));
+    memcpy((void *)&Header.Magic[0], (void *)SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    Header.Version = SNAPSHOT_VERSION;
+    Header.InstanceSize = sizeof(*pc);
+#ifdef USE_MALLOC_STACK
+    Header.MemorySize = pc->HeapMemorySize;
+#endif
+    Header.StackUsed = SnapshotOffset(pc, (unsigned long)pc->HeapStackTop);
+    Header.HeapUsed = SNAPSHOT_SIZE(&Header) - SnapshotOffset(pc, (unsigned long)pc->HeapBottom);
+    Header.Module = (const void *)&SnapshotModule[0];
+    Header.Library = (const void *)stdout;
+
+    /* count the pointers first so the whole snapshot can be allocated at once */
+    SnapshotFindRanges(pc, &Ranges);
+    NumStackRelocations = SnapshotFindPointers(pc, &Ranges, 0, Header.StackUsed, NULL);
+    Header.NumRelocations = NumStackRelocations + SnapshotFindPointers(pc, &Ranges, SNAPSHOT_SIZE(&Header) - Header.HeapUsed, SNAPSHOT_SIZE(&Header), NULL);
+
+    *SnapshotLen = sizeof(Header) + Header.NumRelocations * sizeof(int) + Header.StackUsed + Header.HeapUsed;
+    Snapshot = malloc(*SnapshotLen);
+    if (Snapshot == NULL)
+    {
+        free(Ranges.Range);
+        ProgramFailNoParser(pc, "out of memory");
+    }
+
+    Relocations = (int *)(Snapshot + sizeof(Header));
+    SnapshotFindPointers(pc, &Ranges, 0, Header.StackUsed, Relocations);
+    SnapshotFindPointers(pc, &Ranges, SNAPSHOT_SIZE(&Header) - Header.HeapUsed, SNAPSHOT_SIZE(&Header), &Relocations[NumStackRelocations]);
+    free(Ranges.Range);
+
+    Copy = (unsigned char *)&Relocations[Header.NumRelocations];
+    memcpy((void *)Snapshot, (void *)&Header, sizeof(Header));
+    SnapshotCopy(pc, pc->HeapMemory, 0, Copy, Header.StackUsed, FALSE);
+    SnapshotCopy(pc, pc->HeapMemory, SNAPSHOT_SIZE(&Header) - Header.HeapUsed, &Copy[Header.StackUsed], Header.HeapUsed, FALSE);
+    memset((void *)SnapshotCopyPos(&Header, Copy, (unsigned char *)&pc->PicocExitBuf - (unsigned char *)pc), '\0', sizeof(pc->PicocExitBuf));
+
+    /* save the pointers as offsets into the instance */
+    for (Count = 0; Count < Header.NumRelocations; Count++)
+    {
+        unsigned char *Pos = SnapshotCopyPos(&Header, Copy, Relocations[Count]);
+
+        memcpy((void *)&Ptr, (void *)Pos, sizeof(Ptr));
+        Ptr = SnapshotOffset(pc, Ptr);
+        memcpy((void *)Pos, (void *)&Ptr, sizeof(Ptr));
+    }
+
+    return Snapshot;
+}
+
+/* restore a snapshot into an instance. Memory is the stack and heap memory it already has,
+ * or NULL to give it new memory if it needs its own */
+static int SnapshotRestore(Picoc *pc, unsigned char *Memory, const void *Snapshot, int SnapshotLen)
+{
+    struct SnapshotHeader Header;
+    const int *Relocations = (const int *)((const unsigned char *)Snapshot + sizeof(Header));
+    unsigned char *Copy;
+    unsigned long Ptr;
+    int Count;
+
+    if (SnapshotLen < (int)sizeof(Header))
+        return FALSE;
+
+    memcpy((void *)&Header, Snapshot, sizeof(Header));
+    if (memcmp((void *)&Header.Magic[0], (void *)SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+            Header.Version != SNAPSHOT_VERSION || Header.InstanceSize != sizeof(*pc) ||
+#ifdef USE_MALLOC_STACK
+            Header.MemorySize <= 0 ||
+#else
+            Header.MemorySize != 0 ||
+#endif
+            Header.Module != (const void *)&SnapshotModule[0] || Header.Library != (const void *)stdout ||
+            Header.StackUsed < 0 || Header.HeapUsed < 0 || Header.StackUsed > SNAPSHOT_SIZE(&Header) - Header.HeapUsed ||
+            Header.NumRelocations < 0 || Header.NumRelocations > SNAPSHOT_SIZE(&Header) ||
+            SnapshotLen != sizeof(Header) + Header.NumRelocations * sizeof(int) + Header.StackUsed + Header.HeapUsed)
+        return FALSE;
+
+    /* check every saved pointer before anything is overwritten */
+    Copy = (unsigned char *)&Relocations[Header.NumRelocations];
+    for (Count = 0; Count < Header.NumRelocations; Count++)
+    {
+        if (!SnapshotPointerFits(&Header, Relocations[Count]))
+            return FALSE;
+
+        memcpy((void *)&Ptr, (void *)SnapshotCopyPos(&Header, Copy, Relocations[Count]), sizeof(Ptr));
+        if (Ptr > (unsigned long)SNAPSHOT_SIZE(&Header))
+            return FALSE;
+    }
+
+#ifdef USE_MALLOC_STACK
+    if (Memory == NULL && (Memory = HeapGetMemory(Header.MemorySize)) == NULL)
+        return FALSE;
+#endif
+
+    SnapshotCopy(pc, Memory, 0, Copy, Header.StackUsed, TRUE);
+    SnapshotCopy(pc, Memory, SNAPSHOT_SIZE(&Header) - Header.HeapUsed, &Copy[Header.StackUsed], Header.HeapUsed, TRUE);
+
+    /* point the pointers at this instance */
+    for (Count = 0; Count < Header.NumRelocations; Count++)
+    {
+        unsigned char *Pos = SnapshotAddress(pc, Memory, Relocations[Count]);
+
+        memcpy((void *)&Ptr, (void *)Pos, sizeof(Ptr));
+        Ptr = (unsigned long)SnapshotAddress(pc, Memory, Ptr);
+        memcpy((void *)Pos, (void *)&Ptr, sizeof(Ptr));
+    }
+
+#ifndef NO_PROFILER
+    /* a profile and its timer stay with the instance they were started on */
+    pc->Profile = NULL;
+    pc->Profiling = FALSE;
+    pc->ProfileTicks = 0;
+    pc->ProfileTimer = NULL;
+#endif
+
+    PlatformInit(pc);
+    return TRUE;
+}
+
+/* restore an instance saved by PicocSnapshot() into uninitialised memory, in place of
+ * PicocInitialise(). the instance needn't be at the address it was saved from. returns
+ * FALSE if the snapshot wasn't saved by this process or binary */
+int PicocRestore(Picoc *pc, const void *Snapshot, int SnapshotLen)
+{
+    return SnapshotRestore(pc, NULL, Snapshot, SnapshotLen);
+}
+
+#define POOL_KEEP_MEMORY (64*1024)          /* memory an instance can use beyond its snapshot and keep */
+
+/* a set of instances which are all reset to the same state when they're returned */
+struct PicocPool
+{
+    void *Snapshot;             /* the state every instance is reset to */
+    int SnapshotLen;
+    int NumInstances;
+    Picoc **Instances;
+    char *InUse;
+};
+
+/* create a pool of instances which all start in the same state as an initialised instance
+ * (which may have headers included and programs loaded). the pool isn't locked - if it's
+ * used from several threads they must take turns. returns NULL if out of memory */
+struct PicocPool *PicocPoolCreate(Picoc *Template, int NumInstances)
+{
+    struct PicocPool *Pool = calloc(1, sizeof(struct PicocPool));
+    int Count;
+
+    if (Pool == NULL)
+        return NULL;
+
+    Pool->Snapshot = PicocSnapshot(Template, &Pool->SnapshotLen);
+    Pool->Instances = calloc(NumInstances, sizeof(Picoc *));
+    Pool->InUse = calloc(NumInstances, sizeof(char));
+    if (Pool->Instances == NULL || Pool->InUse == NULL)
+    {
+        PicocPoolFree(Pool);
+        return NULL;
+    }
+
+    for (Pool->NumInstances = 0; Pool->NumInstances < NumInstances; Pool->NumInstances++)
+    {
+        Picoc *pc = malloc(sizeof(Picoc));
+        if (pc == NULL)
+        {
+            PicocPoolFree(Pool);
+            return NULL;
+        }
+
+        if (!PicocRestore(pc, Pool->Snapshot, Pool->SnapshotLen))
+        {
+            free(pc);
+            PicocPoolFree(Pool);
+            return NULL;
+        }
+
+        Pool->Instances[Pool->NumInstances] = pc;
+    }
+
+    for (Count = 0; Count < NumInstances; Count++)
+        Pool->InUse[Count] = FALSE;
+
+    return Pool;
+}
+
+/* free a pool and all its instances. instances still in use are freed too */
+void PicocPoolFree(struct PicocPool *Pool)
+{
+    int Count;
+
+    if (Pool->Instances != NULL)
+    {
+        for (Count = 0; Count < Pool->NumInstances; Count++)
+        {
+            HeapCleanup(Pool->Instances[Count]);
+            free(Pool->Instances[Count]);
+        }
+    }
+
+    free(Pool->Instances);
+    free(Pool->InUse);
+    free(Pool->Snapshot);
+    free(Pool);
+}
+
+/* get an unused instance from a pool, NULL if they're all in use */
+Picoc *PicocPoolGet(struct PicocPool *Pool)
+{
+    int Count;
+
+    for (Count = 0; Count < Pool->NumInstances; Count++)
+    {
+        if (!Pool->InUse[Count])
+        {
+            Pool->InUse[Count] = TRUE;
+            return Pool->Instances[Count];
+        }
+    }
+
+    return NULL;
+}
+
+/* return an instance to its pool. it's reset by copying back only the parts of the instance
+ * which were in use when the pool was created - anything the program allocated since is
+ * forgotten rather than freed */
+void PicocPoolPut(struct PicocPool *Pool, Picoc *pc)
+{
+    int Count;
+#ifdef USE_MMAP_STACK
+    unsigned char *StackMax = pc->HeapStackMax;
+    unsigned char *HeapMin = pc->HeapBottomMin;
+#endif
+
+    for (Count = 0; Count < Pool->NumInstances && Pool->Instances[Count] != pc; Count++)
+    {}
+
+    assert(Count < Pool->NumInstances && Pool->InUse[Count]);
+#ifndef NO_TIME_SLICE
+    if (pc->Slice != NULL)
+        PicocPlatformStopSlice(pc);
+#endif
+#ifndef NO_PROFILER
+    ProfileCleanup(pc);
+#endif
+    SnapshotRestore(pc, pc->HeapMemory, Pool->Snapshot, Pool->SnapshotLen);
+#ifdef USE_MMAP_STACK
+    /* give back the memory a big program used so a pool of instances stays small */
+    if (StackMax - (unsigned char *)pc->HeapStackTop > POOL_KEEP_MEMORY)
+        PlatformDiscardMemory(pc->HeapStackTop, StackMax - (unsigned char *)pc->HeapStackTop);
+
+    if ((unsigned char *)pc->HeapBottom - HeapMin > POOL_KEEP_MEMORY)
+        PlatformDiscardMemory(HeapMin, (unsigned char *)pc->HeapBottom - HeapMin);
+#endif
+    Pool->InUse[Count] = FALSE;
+}
+#endif
+
+/* find a function so the host can call it with PicocCallFunctionHandle() without looking it
+ * up each time. returns FALSE if there's no function with that name. the handle is only
+ * valid in this instance, and until the function is deleted */
+int PicocGetFunction(Picoc *pc, const char *FuncName, struct PicocFunction *Func)
+{
+    struct Value *FuncValue = NULL;
+    char *RegFuncName = TableStrRegister(pc, FuncName);
+
+    if (!VariableDefined(pc, RegFuncName))
+        return FALSE;
+
+    VariableGet(pc, NULL, RegFuncName, &FuncValue);
+    if (FuncValue->Typ->Base != TypeFunction)
+        return FALSE;
+
+    Func->FuncValue = FuncValue;
+    Func->FuncName = RegFuncName;
+    return TRUE;
+}
+
+/* where a value of this type is kept in a union AnyValue passed by the host. structs
+ * and unions don't fit so the host passes a pointer to them */
+static void *PlatformHostValue(struct ValueType *Typ, union AnyValue *HostValue)
+{
+    if (Typ->Base == TypeStruct || Typ->Base == TypeUnion)
+        return HostValue->Pointer;
     else
+        return HostValue;
+}
+
+/* the type a parameter is given as by the host. as in C an array parameter is really a
+ * pointer to its first element, so "char *argv[]" is passed as a "char **". fails if
+ * the host has no way to pass the type */
+static struct ValueType *PlatformHostParamType(Picoc *pc, struct ValueType *Typ, const char *FuncName)
+{
+    switch (Typ->Base)
     {
-        VariableDefinePlatformVar(pc, NULL, "__exit_value", &pc->IntType, (union AnyValue *)&pc->PicocExitValue, TRUE);
-    
-        if (FuncValue->Val->FuncDef.NumParams == 0)
-            PicocParse(pc, "startup", CALL_MAIN_NO_ARGS_RETURN_INT, strlen(CALL_MAIN_NO_ARGS_RETURN_INT), TRUE, TRUE, FALSE, TRUE);
-        else
-            PicocParse(pc, "startup", CALL_MAIN_WITH_ARGS_RETURN_INT, strlen(CALL_MAIN_WITH_ARGS_RETURN_INT), TRUE, TRUE, FALSE, TRUE);
+        case TypeArray:
+            return TypeGetMatching(pc, NULL, Typ->FromType, TypePointer, 0, pc->StrEmpty, TRUE);
+            
+        case TypeStruct: case TypeUnion:
+            if (Typ->Sizeof == 0)
+                ProgramFailNoParser(pc, "%s() has a parameter of incomplete type '%t'", FuncName, Typ);
+            return Typ;
+            
+        case TypeVoid: case TypeFunction: case TypeMacro: case TypeGotoLabel: case Type_Type:
+            ProgramFailNoParser(pc, "%s() can't be given a '%t' by the host", FuncName, Typ);
+            return NULL;
+            
+        default:
+            return Typ;
     }
 }
+
+/* call a script function from the host. each argument is in the member of Args[] which
+ * matches its parameter's type. the return value is put in Result the same way if Result
+ * isn't NULL - to return a struct Result->Pointer must point to somewhere to put it. a
+ * function declared with "..." can be given extra arguments but, as when it's called from
+ * a script, it can't get at them */
+void PicocCallFunctionHandle(Picoc *pc, struct PicocFunction *Func, union AnyValue *Args, int NumArgs, union AnyValue *Result)
+{
+    struct FuncDef *Def = &Func->FuncValue->Val->FuncDef;
+    struct ParseState Parser;
+    struct Value *ReturnValue;
+    struct Value **ParamArray;
+    struct ValueType *ParamType;
+    int Count;
+
+    if (NumArgs < Def->NumParams)
+        ProgramFailNoParser(pc, "not enough arguments to '%s'", Func->FuncName);
+
+    if (NumArgs > Def->NumParams && !Def->VarArgs)
+        ProgramFailNoParser(pc, "too many arguments to %s()", Func->FuncName);
+
+    for (Count = 0; Count < Def->NumParams; Count++)
+        PlatformHostParamType(pc, Def->ParamType[Count], Func->FuncName);
+
+    /* the arguments go straight into a new stack frame rather than being parsed. the
+     * debugger is on if it was on when the function was loaded */
+    StdErrnoBind(pc);
+    LexInitParser(&Parser, pc, NULL, NULL, Func->FuncName, NULL, TRUE, Def->Body != NULL && Def->Body->DebugMode);
+    HeapPushStackFrame(pc);
+    ReturnValue = VariableAllocValueFromType(pc, &Parser, Def->ReturnType, FALSE, NULL, FALSE);
+    ParamArray = HeapAllocStack(pc, sizeof(struct Value *) * Def->NumParams);
+    if (ParamArray == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+
+    for (Count = 0; Count < Def->NumParams; Count++)
+    {
+        ParamType = PlatformHostParamType(pc, Def->ParamType[Count], Func->FuncName);
+        ParamArray[Count] = VariableAllocValueFromType(pc, &Parser, ParamType, FALSE, NULL, FALSE);
+        memcpy((void *)ParamArray[Count]->Val, PlatformHostValue(ParamType, &Args[Count]), TypeSizeValue(ParamArray[Count], FALSE));
+    }
+
+    ExpressionCallFunction(&Parser, Func->FuncValue, Func->FuncName, ReturnValue, ParamArray, NumArgs);
+    if (Result != NULL)
+        memcpy(PlatformHostValue(Def->ReturnType, Result), (void *)ReturnValue->Val, TypeSizeValue(ReturnValue, FALSE));
+
+    HeapPopStackFrame(pc);
+}
+
+/* call a script function by name */
+void PicocCallFunction(Picoc *pc, const char *FuncName, union AnyValue *Args, int NumArgs, union AnyValue *Result)
+{
+    struct PicocFunction Func;
+
+    if (!PicocGetFunction(pc, FuncName, &Func))
+        ProgramFailNoParser(pc, "%s() is not defined", FuncName);
+
+    PicocCallFunctionHandle(pc, &Func, Args, NumArgs, Result);
+}
+
+/* platform-dependent code for running programs */
+#if defined(UNIX_HOST) || defined(WIN32)
+
+void PicocCallMain(Picoc *pc, int argc, char **argv)
+{
+    struct PicocFunction Main;
+    union AnyValue Args[2];
+    union AnyValue Result;
+
+    if (!VariableDefined(pc, TableStrRegister(pc, "main")))
+        ProgramFailNoParser(pc, "main() is not defined");
+        
+    if (!PicocGetFunction(pc, "main", &Main))
+        ProgramFailNoParser(pc, "main is not a function - can't call it");
+
+    /* main() can be called with or without arguments */
+    Args[0].Integer = argc;
+    Args[1].Pointer = argv;
+    Result.Integer = 0;
+    PicocCallFunctionHandle(pc, &Main, Args, (Main.FuncValue->Val->FuncDef.NumParams != 0) ? 2 : 0, &Result);
+    if (Main.FuncValue->Val->FuncDef.ReturnType != &pc->VoidType)
+        pc->PicocExitValue = Result.Integer;
+}
 #endif
 
 void PrintSourceTextErrorLine(IOFILE *Stream, const char *FileName, const char *SourceText, int Line, int CharacterPos)
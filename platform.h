@@ -26,20 +26,18 @@
 #endif
 
 #if 0
-#define GLOBAL_TABLE_SIZE 97                /* global variable table */
-#define STRING_TABLE_SIZE 97                /* shared string table size */
-#define STRING_LITERAL_TABLE_SIZE 97        /* string literal table size */
-#define RESERVED_WORD_TABLE_SIZE 97         /* reserved word table size */
+#define GLOBAL_TABLE_SIZE 128               /* global variable table (can expand) */
+#define STRING_TABLE_SIZE 128               /* shared string table size (can expand) */
+#define STRING_LITERAL_TABLE_SIZE 64        /* string literal table size (can expand) */
 #else
-#define GLOBAL_TABLE_SIZE 97                /* global variable table */
-#define STRING_TABLE_SIZE 97                /* shared string table size */
-#define STRING_LITERAL_TABLE_SIZE 97        /* string literal table size */
-#define RESERVED_WORD_TABLE_SIZE 97         /* reserved word table size */
+#define GLOBAL_TABLE_SIZE 128               /* global variable table (can expand) */
+#define STRING_TABLE_SIZE 128               /* shared string table size (can expand) */
+#define STRING_LITERAL_TABLE_SIZE 64        /* string literal table size (can expand) */
 #endif
 #define PARAMETER_MAX 16                    /* maximum number of parameters to a function */
 #define LINEBUFFER_MAX 256                  /* maximum number of characters on a line */
-#define LOCAL_TABLE_SIZE 11                 /* size of local variable table (can expand) */
-#define STRUCT_TABLE_SIZE 11                /* size of struct/union member table (can expand) */
+#define LOCAL_TABLE_SIZE 16                 /* size of local variable table (can expand) */
+#define STRUCT_TABLE_SIZE 8                 /* size of struct/union member table (can expand) */
 
 #define INTERACTIVE_PROMPT_START "starting picoc " PICOC_VERSION "\n"
 #define INTERACTIVE_PROMPT_STATEMENT "picoc> "
@@ -47,9 +45,13 @@
 
 /* host platform includes */
 #ifdef UNIX_HOST
-# undef USE_MALLOC_STACK                   /* stack is allocated using malloc() */
+# define USE_MALLOC_STACK                   /* stack is allocated using malloc() */
+# define USE_MMAP_STACK                     /* ...or rather mmap(), so only the parts in use take memory */
 # undef USE_MALLOC_HEAP                    /* heap is allocated using malloc() */
-# define HEAP_SIZE (4096*1024)
+# define USE_TLSF_HEAP                      /* heap uses size classes and coalesces free blocks */
+# ifdef __SSE2__
+#  define USE_SSE2_LEXER                    /* the lexer skips comments and strings sixteen bytes at a time */
+# endif
 # define BUILTIN_MINI_STDLIB
 # define debugline printf
 # include <stdio.h>
@@ -63,6 +65,13 @@
 # include <stdarg.h>
 # include <setjmp.h>
 # include <stdint.h>
+# include <signal.h>
+# if UINTPTR_MAX > 0xffffffffUL
+#  define HEAP_SIZE (256*1024*1024)         /* address space for the stack and the heap */
+# else
+#  define HEAP_SIZE (16*1024*1024)          /* ...but not so much that 32 bit hosts run out with a few instances */
+# endif
+# define HEAP_MIN_SIZE (1024*1024)          /* the least we'll take if there isn't HEAP_SIZE to be had */
 # ifndef NO_FP
 #  include <math.h>
 #  define PICOC_MATH_LIBRARY
@@ -166,6 +175,13 @@ extern int ExitBuf[];
 # define NO_FP
 /*# define NO_PRINTF*/
 # define NO_DEBUGGER
+# define NO_BYTECODE                    /* don't compile functions - saves memory */
+# define NO_FOLDING                     /* don't keep the values of constant expressions - saves memory */
+# define NO_MEMBER_CACHE                /* don't remember where struct members are - saves memory */
+# define NO_TOKEN_IMAGE                 /* no saved token images - there's no file system */
+# define NO_SNAPSHOT                    /* no instance snapshots */
+# define NO_TIME_SLICE                  /* no time slices - they need a stack for each program */
+# define NO_PROFILER                    /* no profiler */
 # define NO_CALLOC
 # define NO_REALLOC
 /*# define NO_STRING_FUNCTIONS */
@@ -183,5 +199,23 @@ extern int ExitBuf[];
 
 #endif
 
+/* with the system's malloc() there's no heap of our own to manage */
+#ifdef USE_MALLOC_HEAP
+# undef USE_TLSF_HEAP
+#endif
+
+/* snapshots relocate pointers into the instance and its stack and heap memory, so the heap
+ * has to be picoc's own */
+#if defined(USE_MALLOC_HEAP) || defined(SURVEYOR_HOST)
+# define NO_SNAPSHOT
+#endif
+
+/* time slices switch stacks with ucontext and the profiler samples with a timer signal,
+ * which only UNIX hosts have */
+#ifndef UNIX_HOST
+# define NO_TIME_SLICE
+# define NO_PROFILER
+#endif
+
 
 #endif /* PLATFORM_H */
@@ -1,3 +1,4 @@
+#include "../picoc.h"
 #include "../interpreter.h"
 
 void UnixSetupFunc()
@@ -15,15 +16,33 @@ void Clineno (struct ParseState *Parser, struct Value *ReturnValue, struct Value
     ReturnValue->Val->Integer = Parser->Line;
 }
 
+void Cheapstats (struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
+{
+    PicocHeapStats(Parser->pc, Param[0]->Val->Pointer);
+}
+
+/* the same layout as struct PicocHeapStats */
+const char UnixDefs[] = "\
+struct heapstats \
+{ \
+    int size; int stackused; int stackhighwater; int heapsize; int heaphighwater; \
+    int heapused; int heapfree; int unused; int freeblocks; int largestfreeblock; \
+    int freebytes[32]; \
+    long allocations[5]; long allocatedbytes[5]; \
+}; \
+enum heapuse { HEAP_VALUES, HEAP_TOKENS, HEAP_TABLES, HEAP_TYPES, HEAP_OTHER };\
+";
+
 /* list of all library functions and their prototypes */
 struct LibraryFunction UnixFunctions[] =
 {
     { Ctest,        "void test(int);" },
     { Clineno,      "int lineno();" },
+    { Cheapstats,   "void heapstats(struct heapstats *);" },
     { NULL,         NULL }
 };
 
 void PlatformLibraryInit(Picoc *pc)
 {
-    IncludeRegister(pc, "picoc_unix.h", &UnixSetupFunc, &UnixFunctions[0], NULL);
+    IncludeRegister(pc, "picoc_unix.h", &UnixSetupFunc, &UnixFunctions[0], UnixDefs);
 }
@@ -1,9 +1,6 @@
 #include "../picoc.h"
 #include "../interpreter.h"
 
-/* mark where to end the program for platforms which require this */
-jmp_buf PicocExitBuf;
-
 void PlatformInit(Picoc *pc)
 {
 }
@@ -73,10 +70,80 @@ char *PlatformReadFile(Picoc *pc, const char *FileName)
     return ReadText;    
 }
 
+#ifndef NO_TOKEN_IMAGE
+/* read and scan a file saved by PicocPlatformSaveTokenImage(). returns FALSE if the file isn't a token image */
+static int PlatformScanTokenImage(Picoc *pc, const char *FileName)
+{
+    struct stat FileInfo;
+    const char *SourceFileName;
+    char *Image;
+    void *Tokens;
+    FILE *InFile;
+    int BytesRead;
+    
+    if (stat(FileName, &FileInfo) || FileInfo.st_size < sizeof(LEX_IMAGE_MAGIC))
+        return FALSE;
+    
+    InFile = fopen(FileName, "rb");
+    if (InFile == NULL)
+        return FALSE;
+    
+    Image = malloc(FileInfo.st_size);
+    if (Image == NULL)
+        ProgramFailNoParser(pc, "out of memory\n");
+        
+    BytesRead = fread(Image, 1, FileInfo.st_size, InFile);
+    fclose(InFile);
+    if (BytesRead != FileInfo.st_size || memcmp(Image, LEX_IMAGE_MAGIC, sizeof(LEX_IMAGE_MAGIC)) != 0)
+    {
+        free(Image);
+        return FALSE;
+    }
+    
+    Tokens = PicocLoadTokenImage(pc, Image, BytesRead, &SourceFileName);
+    free(Image);
+    if (Tokens == NULL)
+        ProgramFailNoParser(pc, "%s wasn't saved by this version of picoc", FileName);
+
+    PicocParseTokenImage(pc, SourceFileName, Tokens, TRUE, TRUE);
+    return TRUE;
+}
+
+/* save a source file as a token image which can be run without lexing it again */
+void PicocPlatformSaveTokenImage(Picoc *pc, const char *FileName, const char *ImageFileName)
+{
+    char *SourceStr = PlatformReadFile(pc, FileName);
+    FILE *ImageFile;
+    void *Image;
+    int ImageLen;
+    int BytesWritten;
+
+    Image = PicocSaveTokenImage(pc, FileName, SourceStr, strlen(SourceStr), &ImageLen);
+    free(SourceStr);
+
+    ImageFile = fopen(ImageFileName, "wb");
+    if (ImageFile == NULL)
+        ProgramFailNoParser(pc, "can't write file %s\n", ImageFileName);
+
+    BytesWritten = fwrite(Image, 1, ImageLen, ImageFile);
+    if (fclose(ImageFile) != 0 || BytesWritten != ImageLen)
+        ProgramFailNoParser(pc, "can't write file %s\n", ImageFileName);
+
+    HeapFreeMem(pc, Image);
+}
+#endif
+
 /* read and scan a file for definitions */
 void PicocPlatformScanFile(Picoc *pc, const char *FileName)
 {
-    char *SourceStr = PlatformReadFile(pc, FileName);
+    char *SourceStr;
+
+#ifndef NO_TOKEN_IMAGE
+    if (PlatformScanTokenImage(pc, FileName))
+        return;
+#endif
+
+    SourceStr = PlatformReadFile(pc, FileName);
     PicocParse(pc, FileName, SourceStr, strlen(SourceStr), TRUE, FALSE, TRUE, TRUE);
 }
 
@@ -6,23 +6,42 @@
 #include <readline/history.h>
 #endif
 
-/* mark where to end the program for platforms which require this */
-jmp_buf PicocExitBuf;
+#if !defined(NO_TOKEN_IMAGE) || !defined(NO_SNAPSHOT) || defined(USE_MMAP_STACK)
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#ifndef NO_TIME_SLICE
+#include <ucontext.h>
+
+#define SLICE_STACK_SIZE (1024*1024)        /* the C stack a program runs on in a time slice */
+
+/* a program running in time slices. it has its own C stack so it can be left part way
+ * through a statement and carried on with later */
+struct PlatformSlice
+{
+    ucontext_t Host;                    /* where to go back to at the end of a slice */
+    ucontext_t Program;                 /* where the program is up to */
+    void (*Run)(Picoc *pc, void *Arg);
+    void *Arg;
+    Picoc *pc;
+    int Finished;
+    jmp_buf HostExitBuf;                /* the host's exit point, which the program's replaces while it runs */
+    char *Stack;
+};
+#endif
 
 #ifndef NO_DEBUGGER
 #include <signal.h>
 
-Picoc *break_pc = NULL;
-
 static void BreakHandler(int Signal)
 {
-    break_pc->DebugManualBreak = TRUE;
+    DebugBreak();
 }
 
 void PlatformInit(Picoc *pc)
 {
     /* capture the break signal and pass it to the debugger */
-    break_pc = pc;
     signal(SIGINT, BreakHandler);
 }
 #else
@@ -31,8 +50,116 @@ void PlatformInit(Picoc *pc)
 }
 #endif
 
+#ifndef NO_PROFILER
+#ifdef __linux__
+#include <signal.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#define PROFILE_TICK_USEC 1000              /* how often the profiler takes a sample */
+
+/* older C libraries don't name the thread a timer signals */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* each timer tells us which instance it's timing */
+static void ProfileHandler(int Signal, siginfo_t *Info, void *Context)
+{
+    if (Info->si_code == SI_TIMER && Info->si_value.sival_ptr != NULL)
+        ProfileTick((Picoc *)Info->si_value.sival_ptr);
+}
+
+/* start or stop an instance's profiling timer. each instance has its own timer which counts
+ * the CPU time used by the thread which started it and only signals that thread, so
+ * instances on other threads aren't sampled or stopped with it. it should be stopped on the
+ * same thread, so a signal which is still pending is taken before the instance goes away */
+void PlatformProfileTimer(Picoc *pc, int On)
+{
+    struct sigaction Action;
+    struct sigevent Event;
+    struct itimerspec Interval;
+    timer_t *Timer = pc->ProfileTimer;
+
+    if (On && Timer == NULL)
+    {
+        memset(&Action, '\0', sizeof(Action));
+        Action.sa_sigaction = ProfileHandler;
+        Action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&Action.sa_mask);
+        sigaction(SIGPROF, &Action, NULL);
+
+        Timer = malloc(sizeof(timer_t));
+        if (Timer == NULL)
+            ProgramFailNoParser(pc, "out of memory");
+
+        memset(&Event, '\0', sizeof(Event));
+        Event.sigev_notify = SIGEV_THREAD_ID;
+        Event.sigev_signo = SIGPROF;
+        Event.sigev_value.sival_ptr = (void *)pc;
+        Event.sigev_notify_thread_id = syscall(SYS_gettid);
+        if (timer_create(CLOCK_THREAD_CPUTIME_ID, &Event, Timer) != 0)
+        {
+            /* we can still count statements */
+            free(Timer);
+            return;
+        }
+
+        memset(&Interval, '\0', sizeof(Interval));
+        Interval.it_interval.tv_nsec = PROFILE_TICK_USEC * 1000;
+        Interval.it_value.tv_nsec = PROFILE_TICK_USEC * 1000;
+        timer_settime(*Timer, 0, &Interval, NULL);
+        pc->ProfileTimer = Timer;
+    }
+    else if (!On && Timer != NULL)
+    {
+        timer_delete(*Timer);
+        free(Timer);
+        pc->ProfileTimer = NULL;
+    }
+}
+#else
+/* per-thread CPU timers are a Linux extension. without them profiles only count statements */
+void PlatformProfileTimer(Picoc *pc, int On)
+{
+}
+#endif
+#endif
+
+#ifdef USE_MMAP_STACK
+/* reserve address space for the stack and heap. pages only take memory once they're used */
+void *PlatformMapMemory(int Size)
+{
+    void *Memory = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    return (Memory == MAP_FAILED) ? NULL : Memory;
+}
+
+void PlatformUnmapMemory(void *Memory, int Size)
+{
+    if (Memory != NULL)
+        munmap(Memory, Size);
+}
+
+/* give back the memory used by the whole pages in a range. they read as zero when they're
+ * next used */
+void PlatformDiscardMemory(void *Memory, int Size)
+{
+    unsigned long PageSize = sysconf(_SC_PAGESIZE);
+    unsigned long Start = ((unsigned long)Memory + PageSize - 1) & ~(PageSize - 1);
+    unsigned long End = ((unsigned long)Memory + Size) & ~(PageSize - 1);
+
+    if (End > Start)
+        madvise((void *)Start, End - Start, MADV_DONTNEED);
+}
+#endif
+
 void PlatformCleanup(Picoc *pc)
 {
+#ifndef NO_TIME_SLICE
+    if (pc->Slice != NULL)
+        PicocPlatformStopSlice(pc);
+#endif
 }
 
 /* get a line of interactive input */
@@ -122,10 +249,218 @@ char *PlatformReadFile(Picoc *pc, const char *FileName)
     return ReadText;    
 }
 
+#ifndef NO_TOKEN_IMAGE
+/* read and scan a file saved by PicocPlatformSaveTokenImage(). the image is mapped into
+ * memory rather than read. returns FALSE if the file isn't a token image */
+static int PlatformScanTokenImage(Picoc *pc, const char *FileName)
+{
+    struct stat FileInfo;
+    const char *SourceFileName;
+    void *Image;
+    void *Tokens;
+    int ImageFile = open(FileName, O_RDONLY);
+
+    if (ImageFile < 0)
+        return FALSE;
+
+    if (fstat(ImageFile, &FileInfo) || FileInfo.st_size < sizeof(LEX_IMAGE_MAGIC))
+    {
+        close(ImageFile);
+        return FALSE;
+    }
+
+    Image = mmap(NULL, FileInfo.st_size, PROT_READ, MAP_PRIVATE, ImageFile, 0);
+    close(ImageFile);
+    if (Image == MAP_FAILED)
+        return FALSE;
+
+    if (memcmp(Image, LEX_IMAGE_MAGIC, sizeof(LEX_IMAGE_MAGIC)) != 0)
+    {
+        munmap(Image, FileInfo.st_size);
+        return FALSE;
+    }
+
+    Tokens = PicocLoadTokenImage(pc, Image, FileInfo.st_size, &SourceFileName);
+    munmap(Image, FileInfo.st_size);
+    if (Tokens == NULL)
+        ProgramFailNoParser(pc, "%s wasn't saved by this version of picoc", FileName);
+
+    PicocParseTokenImage(pc, SourceFileName, Tokens, TRUE, TRUE);
+    return TRUE;
+}
+
+/* save a source file as a token image which can be run without lexing it again */
+void PicocPlatformSaveTokenImage(Picoc *pc, const char *FileName, const char *ImageFileName)
+{
+    char *SourceStr = PlatformReadFile(pc, FileName);
+    FILE *ImageFile;
+    void *Image;
+    int ImageLen;
+    int BytesWritten;
+
+    Image = PicocSaveTokenImage(pc, FileName, SourceStr, strlen(SourceStr), &ImageLen);
+    free(SourceStr);
+
+    ImageFile = fopen(ImageFileName, "wb");
+    if (ImageFile == NULL)
+        ProgramFailNoParser(pc, "can't write file %s\n", ImageFileName);
+
+    BytesWritten = fwrite(Image, 1, ImageLen, ImageFile);
+    if (fclose(ImageFile) != 0 || BytesWritten != ImageLen)
+        ProgramFailNoParser(pc, "can't write file %s\n", ImageFileName);
+
+    HeapFreeMem(pc, Image);
+}
+#endif
+
+#ifndef NO_SNAPSHOT
+/* save a snapshot of an instance to a file */
+void PicocPlatformSaveSnapshot(Picoc *pc, const char *FileName)
+{
+    FILE *SnapshotFile;
+    void *Snapshot;
+    int SnapshotLen;
+    int BytesWritten;
+
+    Snapshot = PicocSnapshot(pc, &SnapshotLen);
+    SnapshotFile = fopen(FileName, "wb");
+    if (SnapshotFile == NULL)
+    {
+        free(Snapshot);
+        ProgramFailNoParser(pc, "can't write file %s\n", FileName);
+    }
+
+    BytesWritten = fwrite(Snapshot, 1, SnapshotLen, SnapshotFile);
+    free(Snapshot);
+    if (fclose(SnapshotFile) != 0 || BytesWritten != SnapshotLen)
+        ProgramFailNoParser(pc, "can't write file %s\n", FileName);
+}
+
+/* restore an instance from a file saved by PicocPlatformSaveSnapshot(). there's no instance
+ * to report errors with yet so this returns FALSE if it can't be restored */
+int PicocPlatformLoadSnapshot(Picoc *pc, const char *FileName)
+{
+    struct stat FileInfo;
+    void *Snapshot;
+    int Restored;
+    int SnapshotFile = open(FileName, O_RDONLY);
+
+    if (SnapshotFile < 0)
+        return FALSE;
+
+    if (fstat(SnapshotFile, &FileInfo))
+    {
+        close(SnapshotFile);
+        return FALSE;
+    }
+
+    Snapshot = mmap(NULL, FileInfo.st_size, PROT_READ, MAP_PRIVATE, SnapshotFile, 0);
+    close(SnapshotFile);
+    if (Snapshot == MAP_FAILED)
+        return FALSE;
+
+    Restored = PicocRestore(pc, Snapshot, FileInfo.st_size);
+    munmap(Snapshot, FileInfo.st_size);
+    return Restored;
+}
+#endif
+
+#ifndef NO_TIME_SLICE
+/* the start of a time sliced program's stack. makecontext() can only pass ints so the
+ * slice's address comes in two halves */
+static void PlatformSliceMain(unsigned int High, unsigned int Low)
+{
+    struct PlatformSlice *Slice = (struct PlatformSlice *)(((uintptr_t)High << 16 << 16) | Low);
+    Picoc *pc = Slice->pc;
+
+    if (!PicocPlatformSetExitPoint(pc))
+        Slice->Run(pc, Slice->Arg);
+
+    /* returning goes back to the host via uc_link */
+    Slice->Finished = TRUE;
+}
+
+/* start Run(pc, Arg) in a time slice. it runs until it's used the statement budget set by
+ * PicocSetStatementBudget(). returns TRUE if it's yielded and should be carried on with
+ * PicocPlatformResumeSlice(), FALSE if it's finished */
+int PicocPlatformStartSlice(Picoc *pc, void (*Run)(Picoc *pc, void *Arg), void *Arg)
+{
+    struct PlatformSlice *Slice;
+
+    if (pc->Slice != NULL)
+        ProgramFailNoParser(pc, "already running in a time slice");
+
+    Slice = malloc(sizeof(struct PlatformSlice));
+    if (Slice == NULL || (Slice->Stack = malloc(SLICE_STACK_SIZE)) == NULL)
+    {
+        free(Slice);
+        ProgramFailNoParser(pc, "out of memory");
+    }
+
+    Slice->Run = Run;
+    Slice->Arg = Arg;
+    Slice->pc = pc;
+    Slice->Finished = FALSE;
+    memcpy(Slice->HostExitBuf, pc->PicocExitBuf, sizeof(jmp_buf));
+    getcontext(&Slice->Program);
+    Slice->Program.uc_stack.ss_sp = Slice->Stack;
+    Slice->Program.uc_stack.ss_size = SLICE_STACK_SIZE;
+    Slice->Program.uc_link = &Slice->Host;
+    makecontext(&Slice->Program, (void (*)())PlatformSliceMain, 2, (unsigned int)((uintptr_t)Slice >> 16 >> 16), (unsigned int)(uintptr_t)Slice);
+    pc->Slice = Slice;
+
+    return PicocPlatformResumeSlice(pc);
+}
+
+/* run the next slice of a program. returns TRUE if it's yielded again, FALSE if it's finished */
+int PicocPlatformResumeSlice(Picoc *pc)
+{
+    struct PlatformSlice *Slice = pc->Slice;
+
+    /* it may be carried on by a different thread from the last slice */
+    StdErrnoBind(pc);
+    swapcontext(&Slice->Host, &Slice->Program);
+    if (!Slice->Finished)
+        return TRUE;
+
+    PicocPlatformStopSlice(pc);
+    return FALSE;
+}
+
+/* give up on a program which has yielded, or clean up after one which has finished. the
+ * instance is left part way through whatever it was doing so it should be cleaned up or
+ * put back in its pool */
+void PicocPlatformStopSlice(Picoc *pc)
+{
+    struct PlatformSlice *Slice = pc->Slice;
+
+    memcpy(pc->PicocExitBuf, Slice->HostExitBuf, sizeof(jmp_buf));
+    pc->Slice = NULL;
+    free(Slice->Stack);
+    free(Slice);
+}
+
+/* called when the statement budget runs out in a time slice - go back to the host until
+ * it resumes us */
+void PlatformSliceYield(Picoc *pc)
+{
+    struct PlatformSlice *Slice = pc->Slice;
+
+    swapcontext(&Slice->Program, &Slice->Host);
+}
+#endif
+
 /* read and scan a file for definitions */
 void PicocPlatformScanFile(Picoc *pc, const char *FileName)
 {
-    char *SourceStr = PlatformReadFile(pc, FileName);
+    char *SourceStr;
+
+#ifndef NO_TOKEN_IMAGE
+    if (PlatformScanTokenImage(pc, FileName))
+        return;
+#endif
+
+    SourceStr = PlatformReadFile(pc, FileName);
 
     /* ignore "#!/path/to/picoc" .. by replacing the "#!" with "//" */
     if (SourceStr != NULL && SourceStr[0] == '#' && SourceStr[1] == '!') 
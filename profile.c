@@ -0,0 +1,381 @@
+/* picoc's profiler - counts the statements run in each function and on each source
+ * line, and samples where the program is up to on a timer tick. the results can be
+ * written as a flat profile or as folded stacks for flame graph tools */
+
+#include "interpreter.h"
+
+#ifndef NO_PROFILER
+
+#define PROFILE_LINE_TABLE_SIZE 211         /* source line hash table size */
+
+/* a function called from a particular chain of callers */
+struct ProfileNode
+{
+    const char *FuncName;
+    struct ProfileNode *Parent;
+    struct ProfileNode *FirstChild;         /* the functions this one has called */
+    struct ProfileNode *NextSibling;
+    long Calls;
+    long Statements;                        /* statements run in this function itself */
+    long Samples;                           /* timer ticks seen in this function itself */
+};
+
+/* a source line which has been run */
+struct ProfileLine
+{
+    struct ProfileLine *Next;               /* the next line in this hash chain */
+    const char *FileName;
+    int Line;
+    const char *FuncName;                   /* the function it's in */
+    long Statements;
+    long Samples;
+};
+
+/* everything we've collected for an instance */
+struct Profile
+{
+    struct ProfileNode Root;                /* statements run outside any function */
+    struct ProfileLine *LineHashTable[PROFILE_LINE_TABLE_SIZE];
+    struct ProfileLine *LastLine;           /* statements often follow each other on a line */
+    int NumLines;
+    int Ticks;                              /* the tick count when we last took a sample */
+};
+
+/* a function's totals over every chain of callers, for the flat profile */
+struct ProfileFunction
+{
+    const char *FuncName;
+    long Calls;
+    long Statements;
+    long Samples;
+};
+
+/* free a calling tree */
+static void ProfileFreeNodes(struct ProfileNode *Node)
+{
+    struct ProfileNode *Child;
+    struct ProfileNode *NextChild;
+
+    for (Child = Node->FirstChild; Child != NULL; Child = NextChild)
+    {
+        NextChild = Child->NextSibling;
+        ProfileFreeNodes(Child);
+        free(Child);
+    }
+}
+
+/* throw away everything we've collected */
+static void ProfileFree(struct Profile *Profile)
+{
+    struct ProfileLine *Line;
+    struct ProfileLine *NextLine;
+    int Count;
+
+    ProfileFreeNodes(&Profile->Root);
+    for (Count = 0; Count < PROFILE_LINE_TABLE_SIZE; Count++)
+    {
+        for (Line = Profile->LineHashTable[Count]; Line != NULL; Line = NextLine)
+        {
+            NextLine = Line->Next;
+            free(Line);
+        }
+    }
+
+    free(Profile);
+}
+
+/* start collecting a new profile */
+void PicocProfileStart(Picoc *pc)
+{
+    if (pc->Profile != NULL)
+        ProfileFree(pc->Profile);
+
+    pc->Profile = calloc(1, sizeof(struct Profile));
+    if (pc->Profile == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+
+    pc->Profile->Root.FuncName = "(top level)";
+    pc->Profile->Ticks = pc->ProfileTicks;
+    pc->Profiling = TRUE;
+    PlatformProfileTimer(pc, TRUE);
+}
+
+/* stop collecting. what's been collected is kept until the next start or cleanup. other
+ * instances' profiles carry on */
+void PicocProfileStop(Picoc *pc)
+{
+    pc->Profiling = FALSE;
+    PlatformProfileTimer(pc, FALSE);
+}
+
+/* free the profile */
+void ProfileCleanup(Picoc *pc)
+{
+    if (pc->Profiling)
+        PicocProfileStop(pc);
+
+    if (pc->Profile != NULL)
+        ProfileFree(pc->Profile);
+
+    pc->Profile = NULL;
+}
+
+/* called on each tick of an instance's profiling timer, usually from a signal handler */
+void ProfileTick(Picoc *pc)
+{
+    pc->ProfileTicks++;
+}
+
+/* the calling tree node for a stack frame */
+static struct ProfileNode *ProfileFrameNode(Picoc *pc, struct StackFrame *Frame)
+{
+    if (Frame == NULL || Frame->ProfileNode == NULL)
+        return &pc->Profile->Root;
+    else
+        return Frame->ProfileNode;
+}
+
+/* a function has been called - find where it is in the calling tree */
+void ProfileCall(Picoc *pc, struct StackFrame *Frame)
+{
+    struct ProfileNode *Parent = ProfileFrameNode(pc, Frame->PreviousStackFrame);
+    struct ProfileNode *Node;
+
+    for (Node = Parent->FirstChild; Node != NULL && Node->FuncName != Frame->FuncName; Node = Node->NextSibling)
+    {}
+
+    if (Node == NULL)
+    {
+        Node = calloc(1, sizeof(struct ProfileNode));
+        if (Node == NULL)
+            ProgramFailNoParser(pc, "out of memory");
+
+        Node->FuncName = Frame->FuncName;
+        Node->Parent = Parent;
+        Node->NextSibling = Parent->FirstChild;
+        Parent->FirstChild = Node;
+    }
+
+    Node->Calls++;
+    Frame->ProfileNode = Node;
+}
+
+/* a statement is about to be run */
+void ProfileStatement(struct ParseState *Parser)
+{
+    Picoc *pc = Parser->pc;
+    struct Profile *Profile = pc->Profile;
+    struct ProfileNode *Node = ProfileFrameNode(pc, pc->TopStackFrame);
+    struct ProfileLine *Line = Profile->LastLine;
+    int Ticks = pc->ProfileTicks;
+
+    if (Line == NULL || Line->Line != Parser->Line || Line->FileName != Parser->FileName)
+    {
+        /* look the line up, or add it if this is the first time it's been run */
+        int HashValue = ((unsigned long)Parser->FileName + Parser->Line) % PROFILE_LINE_TABLE_SIZE;
+
+        for (Line = Profile->LineHashTable[HashValue]; Line != NULL && (Line->Line != Parser->Line || Line->FileName != Parser->FileName); Line = Line->Next)
+        {}
+
+        if (Line == NULL)
+        {
+            Line = calloc(1, sizeof(struct ProfileLine));
+            if (Line == NULL)
+                ProgramFail(Parser, "out of memory");
+
+            Line->FileName = Parser->FileName;
+            Line->Line = Parser->Line;
+            Line->FuncName = Node->FuncName;
+            Line->Next = Profile->LineHashTable[HashValue];
+            Profile->LineHashTable[HashValue] = Line;
+            Profile->NumLines++;
+        }
+
+        Profile->LastLine = Line;
+    }
+
+    Node->Statements++;
+    Line->Statements++;
+    if (Ticks != Profile->Ticks)
+    {
+        /* the timer has ticked since the last statement - we're the sample */
+        Node->Samples += Ticks - Profile->Ticks;
+        Line->Samples += Ticks - Profile->Ticks;
+        Profile->Ticks = Ticks;
+    }
+}
+
+/* add a calling tree's totals into a list of functions */
+static int ProfileAddFunctions(struct ProfileNode *Node, struct ProfileFunction *Function, int NumFunctions)
+{
+    struct ProfileNode *Child;
+    int Count;
+
+    for (Count = 0; Count < NumFunctions && Function[Count].FuncName != Node->FuncName; Count++)
+    {}
+
+    if (Count == NumFunctions)
+    {
+        Function[Count].FuncName = Node->FuncName;
+        NumFunctions++;
+    }
+
+    Function[Count].Calls += Node->Calls;
+    Function[Count].Statements += Node->Statements;
+    Function[Count].Samples += Node->Samples;
+
+    for (Child = Node->FirstChild; Child != NULL; Child = Child->NextSibling)
+        NumFunctions = ProfileAddFunctions(Child, Function, NumFunctions);
+
+    return NumFunctions;
+}
+
+/* count the nodes in a calling tree */
+static int ProfileCountNodes(struct ProfileNode *Node)
+{
+    struct ProfileNode *Child;
+    int Count = 1;
+
+    for (Child = Node->FirstChild; Child != NULL; Child = Child->NextSibling)
+        Count += ProfileCountNodes(Child);
+
+    return Count;
+}
+
+/* sort functions by samples then statements, most first */
+static int ProfileCompareFunctions(const void *Left, const void *Right)
+{
+    const struct ProfileFunction *LeftFunction = Left;
+    const struct ProfileFunction *RightFunction = Right;
+
+    if (LeftFunction->Samples != RightFunction->Samples)
+        return (LeftFunction->Samples < RightFunction->Samples) ? 1 : -1;
+    else if (LeftFunction->Statements != RightFunction->Statements)
+        return (LeftFunction->Statements < RightFunction->Statements) ? 1 : -1;
+    else
+        return 0;
+}
+
+/* sort lines the same way */
+static int ProfileCompareLines(const void *Left, const void *Right)
+{
+    const struct ProfileLine *LeftLine = *(const struct ProfileLine **)Left;
+    const struct ProfileLine *RightLine = *(const struct ProfileLine **)Right;
+
+    if (LeftLine->Samples != RightLine->Samples)
+        return (LeftLine->Samples < RightLine->Samples) ? 1 : -1;
+    else if (LeftLine->Statements != RightLine->Statements)
+        return (LeftLine->Statements < RightLine->Statements) ? 1 : -1;
+    else
+        return 0;
+}
+
+/* a count as a percentage of a total */
+static double ProfilePercent(long Count, long Total)
+{
+    return (Total == 0) ? 0.0 : (100.0 * Count / Total);
+}
+
+/* write a flat profile of the functions and then the source lines, busiest first */
+void PicocProfileReport(Picoc *pc, FILE *Stream)
+{
+    struct Profile *Profile = pc->Profile;
+    struct ProfileFunction *Function;
+    struct ProfileLine **LineList;
+    struct ProfileLine *Line;
+    long TotalStatements = 0;
+    long TotalSamples = 0;
+    int NumFunctions;
+    int NumLines = 0;
+    int Count;
+
+    if (Profile == NULL)
+        return;
+
+    Function = calloc(ProfileCountNodes(&Profile->Root), sizeof(struct ProfileFunction));
+    LineList = malloc(sizeof(struct ProfileLine *) * (Profile->NumLines + 1));
+    if (Function == NULL || LineList == NULL)
+    {
+        free(Function);
+        free(LineList);
+        ProgramFailNoParser(pc, "out of memory");
+    }
+
+    NumFunctions = ProfileAddFunctions(&Profile->Root, Function, 0);
+    for (Count = 0; Count < NumFunctions; Count++)
+    {
+        TotalStatements += Function[Count].Statements;
+        TotalSamples += Function[Count].Samples;
+    }
+
+    qsort(Function, NumFunctions, sizeof(struct ProfileFunction), ProfileCompareFunctions);
+    fprintf(Stream, "%ld samples, %ld statements\n\n", TotalSamples, TotalStatements);
+    fprintf(Stream, "  %%samples   samples  %%statements  statements     calls  function\n");
+    for (Count = 0; Count < NumFunctions; Count++)
+    {
+        if (Function[Count].Statements != 0)
+            fprintf(Stream, "  %7.2f%% %9ld  %10.2f%% %11ld %9ld  %s\n",
+                ProfilePercent(Function[Count].Samples, TotalSamples), Function[Count].Samples,
+                ProfilePercent(Function[Count].Statements, TotalStatements), Function[Count].Statements,
+                Function[Count].Calls, Function[Count].FuncName);
+    }
+
+    for (Count = 0; Count < PROFILE_LINE_TABLE_SIZE; Count++)
+    {
+        for (Line = Profile->LineHashTable[Count]; Line != NULL; Line = Line->Next)
+            LineList[NumLines++] = Line;
+    }
+
+    qsort(LineList, NumLines, sizeof(struct ProfileLine *), ProfileCompareLines);
+    fprintf(Stream, "\n  %%samples   samples  %%statements  statements  line\n");
+    for (Count = 0; Count < NumLines; Count++)
+    {
+        Line = LineList[Count];
+        fprintf(Stream, "  %7.2f%% %9ld  %10.2f%% %11ld  %s:%d (%s)\n",
+            ProfilePercent(Line->Samples, TotalSamples), Line->Samples,
+            ProfilePercent(Line->Statements, TotalStatements), Line->Statements,
+            Line->FileName, Line->Line, Line->FuncName);
+    }
+
+    free(Function);
+    free(LineList);
+}
+
+/* write the chain of calls which led to a node, outermost first. the root isn't part of it */
+static void ProfileFoldCallers(struct ProfileNode *Node, FILE *Stream)
+{
+    if (Node->Parent->Parent != NULL)
+    {
+        ProfileFoldCallers(Node->Parent, Stream);
+        fputc(';', Stream);
+    }
+
+    fputs(Node->FuncName, Stream);
+}
+
+/* write a calling tree's stacks, one line for each chain of calls */
+static void ProfileFoldNodes(struct ProfileNode *Node, FILE *Stream, int CountStatements)
+{
+    struct ProfileNode *Child;
+    long Value = CountStatements ? Node->Statements : Node->Samples;
+
+    if (Value != 0 && Node->Parent != NULL)
+    {
+        ProfileFoldCallers(Node, Stream);
+        fprintf(Stream, " %ld\n", Value);
+    }
+
+    for (Child = Node->FirstChild; Child != NULL; Child = Child->NextSibling)
+        ProfileFoldNodes(Child, Stream, CountStatements);
+}
+
+/* write the profile as folded stacks - each chain of calls followed by the samples in it, or
+ * the statements run in it if CountStatements is TRUE. this is the input flame graph tools
+ * expect */
+void PicocProfileFolded(Picoc *pc, FILE *Stream, int CountStatements)
+{
+    if (pc->Profile != NULL)
+        ProfileFoldNodes(&pc->Profile->Root, Stream, CountStatements);
+}
+
+#endif /* !NO_PROFILER */
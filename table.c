@@ -1,56 +1,154 @@
 /* picoc hash table module. This hash table code is used for both symbol tables
- * and the shared string table. */
+ * and the shared string table. 
+ *
+ * the tables use open addressing with linear probing. each slot holds a pointer to an
+ * entry, so a search only touches the entries it compares. a table grows to twice its
+ * size when it gets half full. it starts off in the slots it was initialised with and
+ * moves to slots on the heap when it first grows. */
  
 #include "interpreter.h"
 
 /* initialise the shared string system */
 void TableInit(Picoc *pc)
 {
-    TableInitTable(&pc->StringTable, &pc->StringHashTable[0], STRING_TABLE_SIZE, TRUE);
+    TableInitTable(pc, &pc->StringTable, &pc->StringHashTable[0], STRING_TABLE_SIZE, TRUE);
+    pc->StringIndex = NULL;
+    pc->StringIndexUsed = 0;
+    pc->StringIndexSize = 0;
     pc->StrEmpty = TableStrRegister(pc, "");
 }
 
-/* hash function for strings */
-static unsigned int TableHash(const char *Key, int Len)
+/* rotate a 32 bit value left */
+#define TABLE_ROTATE(x, n) ((uint32_t)(((x) << (n)) | ((x) >> (32 - (n)))))
+
+/* hash function for strings. it's murmur-style, taking four bytes at a time. it doesn't 
+ * need a finishing step since TABLE_MIX() mixes the bits again */
+static uint32_t TableHash(const char *Key, int Len)
 {
-    unsigned int Hash = Len;
-    int Offset;
-    int Count;
+    uint32_t Hash = (uint32_t)Len;
+    uint32_t Word;
     
-    for (Count = 0, Offset = 8; Count < Len; Count++, Offset+=7)
+    for (; Len >= 4; Len -= 4, Key += 4)
     {
-        if (Offset > sizeof(unsigned int) * 8 - 7)
-            Offset -= sizeof(unsigned int) * 8 - 6;
-            
-        Hash ^= *Key++ << Offset;
+        memcpy((void *)&Word, (void *)Key, sizeof(Word));
+        Word *= (uint32_t)0xcc9e2d51UL;
+        Hash ^= TABLE_ROTATE(Word, 15) * (uint32_t)0x1b873593UL;
+        Hash = TABLE_ROTATE(Hash, 13) * 5 + (uint32_t)0xe6546b64UL;
     }
     
-    return Hash;
+    for (Word = 0; Len > 0; Len--)
+        Word = (Word << 8) | (unsigned char)Key[Len-1];
+    
+    Word *= (uint32_t)0xcc9e2d51UL;
+    return Hash ^ (TABLE_ROTATE(Word, 15) * (uint32_t)0x1b873593UL);
 }
 
-/* initialise a table */
-void TableInitTable(struct Table *Tbl, struct TableEntry **HashTable, int Size, int OnHeap)
+/* spread a hash over the slots of a table. multiplying by 2^32 / golden ratio mixes the
+ * low bits into the high ones, which we take as the slot number */
+#define TABLE_MIX(Tbl, Hash) ((int)((uint32_t)((uint32_t)(Hash) * (uint32_t)0x9e3779b9UL) >> (Tbl)->Shift))
+
+/* shared strings have unique addresses so we don't need to hash their contents. the address 
+ * is taken relative to the heap so it hashes the same if the instance is moved by PicocRestore() */
+#define TABLE_KEY_HASH(Tbl, Key) TABLE_MIX(Tbl, (char *)(Key) - (char *)(Tbl)->HashBase)
+
+/* initialise a table. Size must be a power of two */
+void TableInitTable(Picoc *pc, struct Table *Tbl, struct TableEntry **HashTable, int Size, int OnHeap)
 {
+    int Bits;
+    
+    for (Bits = 0; (1 << Bits) < Size; Bits++)
+    {}
+    
+    assert(Size == 1 << Bits && Size >= 2);
     Tbl->Size = Size;
+    Tbl->Count = 0;
+    Tbl->Shift = 32 - Bits;
     Tbl->OnHeap = OnHeap;
+    Tbl->Grown = FALSE;
     Tbl->HashTable = HashTable;
+    Tbl->HashBase = HEAP_HASH_BASE(pc);
     memset((void *)HashTable, '\0', sizeof(struct TableEntry *) * Size);
 }
 
-/* check a hash table entry for a key */
-static struct TableEntry *TableSearch(struct Table *Tbl, const char *Key, int *AddAt)
+/* free the slots a table has grown into */
+void TableFree(Picoc *pc, struct Table *Tbl)
+{
+    if (Tbl->Grown)
+        HeapFreeMem(pc, Tbl->HashTable);
+    
+    Tbl->Grown = FALSE;
+}
+
+/* the slot an entry in a table of values would be stored in if there were no collisions.
+ * a variable which is out of scope is still stored where its name hashes to */
+static int TableValueSlot(struct Table *Tbl, struct TableEntry *Entry)
+{
+    return TABLE_KEY_HASH(Tbl, TABLE_VISIBLE_KEY(Entry->p.v.Key));
+}
+
+/* the slot an entry in the shared string table would be stored in if there were no collisions */
+static int TableIdentifierSlot(struct Table *Tbl, struct TableEntry *Entry)
+{
+    return TABLE_MIX(Tbl, Entry->p.s.Hash);
+}
+
+/* make room for some more entries, doubling the number of slots until the table will be at most half full */
+static void TableMakeRoom(Picoc *pc, struct Table *Tbl, int NumNew, int (*HomeSlot)(struct Table *, struct TableEntry *))
+{
+    struct TableEntry **OldHashTable = Tbl->HashTable;
+    struct TableEntry **NewHashTable;
+    int OldSize = Tbl->Size;
+    int NewSize = Tbl->Size;
+    int Count;
+    int Slot;
+    
+    if ((Tbl->Count + NumNew) * 2 <= Tbl->Size)
+        return;
+    
+    while ((Tbl->Count + NumNew) * 2 > NewSize)
+        NewSize *= 2;
+    
+    NewHashTable = HeapAllocMem(pc, sizeof(struct TableEntry *) * NewSize);
+    if (NewHashTable == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+    
+    HEAP_ALLOC_USE(pc, PicocHeapTables, sizeof(struct TableEntry *) * NewSize);
+    memset((void *)NewHashTable, '\0', sizeof(struct TableEntry *) * NewSize);
+    for (; Tbl->Size < NewSize; Tbl->Size *= 2)
+        Tbl->Shift--;
+    
+    Tbl->HashTable = NewHashTable;
+    
+    for (Count = 0; Count < OldSize; Count++)
+    {
+        if (OldHashTable[Count] != NULL)
+        {
+            for (Slot = HomeSlot(Tbl, OldHashTable[Count]); NewHashTable[Slot] != NULL; Slot = (Slot + 1) & (Tbl->Size - 1))
+            {}
+            
+            NewHashTable[Slot] = OldHashTable[Count];
+        }
+    }
+    
+    if (Tbl->Grown)
+        HeapFreeMem(pc, OldHashTable);
+    
+    Tbl->Grown = TRUE;
+}
+
+/* check a hash table entry for a key. returns the slot it's in or the empty slot it can be added at */
+static int TableSearch(struct Table *Tbl, const char *Key)
 {
     struct TableEntry *Entry;
-    int HashValue = ((unsigned long)Key) % Tbl->Size;   /* shared strings have unique addresses so we don't need to hash them */
+    int Slot;
     
-    for (Entry = Tbl->HashTable[HashValue]; Entry != NULL; Entry = Entry->Next)
+    for (Slot = TABLE_KEY_HASH(Tbl, Key); (Entry = Tbl->HashTable[Slot]) != NULL; Slot = (Slot + 1) & (Tbl->Size - 1))
     {
         if (Entry->p.v.Key == Key)
-            return Entry;   /* found */
+            break;   /* found */
     }
     
-    *AddAt = HashValue;    /* didn't find it in the chain */
-    return NULL;
+    return Slot;
 }
 
 /* set an identifier to a value. returns FALSE if it already exists. 
@@ -58,11 +156,15 @@ static struct TableEntry *TableSearch(struct Table *Tbl, const char *Key, int *A
 int TableSet(Picoc *pc, struct Table *Tbl, char *Key, struct Value *Val, const char *DeclFileName, int DeclLine, int DeclColumn)
 {
     int AddAt;
-    struct TableEntry *FoundEntry = TableSearch(Tbl, Key, &AddAt);
     
-    if (FoundEntry == NULL)
+    TableMakeRoom(pc, Tbl, 1, &TableValueSlot);
+    AddAt = TableSearch(Tbl, Key);
+    if (Tbl->HashTable[AddAt] == NULL)
     {   /* add it to the table */
         struct TableEntry *NewEntry = VariableAlloc(pc, NULL, sizeof(struct TableEntry), Tbl->OnHeap);
+        if (Tbl->OnHeap)
+            HEAP_ALLOC_USE(pc, PicocHeapTables, sizeof(struct TableEntry));
+            
 #ifndef DISABLE_TABLEENTRY_DECL
         NewEntry->DeclFileName = DeclFileName;
         NewEntry->DeclLine = DeclLine;
@@ -70,8 +172,8 @@ int TableSet(Picoc *pc, struct Table *Tbl, char *Key, struct Value *Val, const c
 #endif
         NewEntry->p.v.Key = Key;
         NewEntry->p.v.Val = Val;
-        NewEntry->Next = Tbl->HashTable[AddAt];
         Tbl->HashTable[AddAt] = NewEntry;
+        Tbl->Count++;
         debugline("TableSet: %d: %s\n", sizeof(struct TableEntry), Key);
         return TRUE;
     }
@@ -83,8 +185,7 @@ int TableSet(Picoc *pc, struct Table *Tbl, char *Key, struct Value *Val, const c
  * Key must be a shared string from TableStrRegister() */
 int TableGet(struct Table *Tbl, const char *Key, struct Value **Val, const char **DeclFileName, int *DeclLine, int *DeclColumn)
 {
-    int AddAt;
-    struct TableEntry *FoundEntry = TableSearch(Tbl, Key, &AddAt);
+    struct TableEntry *FoundEntry = Tbl->HashTable[TableSearch(Tbl, Key)];
     if (FoundEntry == NULL)
         return FALSE;
     
@@ -105,63 +206,118 @@ int TableGet(struct Table *Tbl, const char *Key, struct Value **Val, const char
 /* remove an entry from the table */
 struct Value *TableDelete(Picoc *pc, struct Table *Tbl, const char *Key)
 {
-    struct TableEntry **EntryPtr;
-    int HashValue = ((unsigned long)Key) % Tbl->Size;   /* shared strings have unique addresses so we don't need to hash them */
+    int Mask = Tbl->Size - 1;
+    int Slot = TableSearch(Tbl, Key);
+    struct TableEntry *DeleteEntry = Tbl->HashTable[Slot];
+    struct Value *Val;
+    int NextSlot;
+    int HomeSlot;
+    
+    if (DeleteEntry == NULL)
+        return NULL;
     
-    for (EntryPtr = &Tbl->HashTable[HashValue]; *EntryPtr != NULL; EntryPtr = &(*EntryPtr)->Next)
+    /* move back any entries after it which would no longer be found past the gap */
+    for (NextSlot = (Slot + 1) & Mask; Tbl->HashTable[NextSlot] != NULL; NextSlot = (NextSlot + 1) & Mask)
     {
-        if ((*EntryPtr)->p.v.Key == Key)
+        HomeSlot = TableValueSlot(Tbl, Tbl->HashTable[NextSlot]);
+        if (((NextSlot - HomeSlot) & Mask) >= ((NextSlot - Slot) & Mask))
         {
-            struct TableEntry *DeleteEntry = *EntryPtr;
-            struct Value *Val = DeleteEntry->p.v.Val;
-            *EntryPtr = DeleteEntry->Next;
-            HeapFreeMem(pc, DeleteEntry);
-
-            return Val;
+            Tbl->HashTable[Slot] = Tbl->HashTable[NextSlot];
+            Slot = NextSlot;
         }
     }
+    
+    Tbl->HashTable[Slot] = NULL;
+    Tbl->Count--;
+    Val = DeleteEntry->p.v.Val;
+    HeapFreeMem(pc, DeleteEntry);
 
+    return Val;
+}
+
+/* find the entries stored under a key, including variables which are out of scope. 
+ * Pos should be -1 to get the first one and is then left where to carry on from.
+ * returns NULL when there are no more */
+struct TableEntry *TableFindNext(struct Table *Tbl, const char *Key, int *Pos)
+{
+    struct TableEntry *Entry;
+    int Slot = (*Pos < 0) ? TABLE_KEY_HASH(Tbl, Key) : ((*Pos + 1) & (Tbl->Size - 1));
+    
+    for (; (Entry = Tbl->HashTable[Slot]) != NULL; Slot = (Slot + 1) & (Tbl->Size - 1))
+    {
+        if (TABLE_VISIBLE_KEY(Entry->p.v.Key) == Key)
+        {
+            *Pos = Slot;
+            return Entry;
+        }
+    }
+    
     return NULL;
 }
 
-/* check a hash table entry for an identifier */
-static struct TableEntry *TableSearchIdentifier(struct Table *Tbl, const char *Key, int Len, int *AddAt)
+/* step through all the entries in a table. Pos should be 0 to get the first one.
+ * returns NULL after the last one */
+struct TableEntry *TableNext(struct Table *Tbl, int *Pos)
 {
     struct TableEntry *Entry;
-    int HashValue = TableHash(Key, Len) % Tbl->Size;
     
-    for (Entry = Tbl->HashTable[HashValue]; Entry != NULL; Entry = Entry->Next)
+    while (*Pos < Tbl->Size)
     {
-        if (strncmp(&Entry->p.Key[0], (char *)Key, Len) == 0 && Entry->p.Key[Len] == '\0')
-            return Entry;   /* found */
+        if ((Entry = Tbl->HashTable[(*Pos)++]) != NULL)
+            return Entry;
     }
     
-    *AddAt = HashValue;    /* didn't find it in the chain */
     return NULL;
 }
 
-/* set an identifier and return the identifier. share if possible */
-char *TableSetIdentifier(Picoc *pc, struct Table *Tbl, const char *Ident, int IdentLen)
+/* check a hash table entry for an identifier. returns the slot it's in or the empty slot it can be added at */
+static int TableSearchIdentifier(struct Table *Tbl, const char *Key, int Len, uint32_t Hash)
 {
-    int AddAt;
-    struct TableEntry *FoundEntry = TableSearchIdentifier(Tbl, Ident, IdentLen, &AddAt);
+    struct TableEntry *Entry;
+    int Slot;
     
-    if (FoundEntry != NULL)
-        return &FoundEntry->p.Key[0];
+    for (Slot = TABLE_MIX(Tbl, Hash); (Entry = Tbl->HashTable[Slot]) != NULL; Slot = (Slot + 1) & (Tbl->Size - 1))
+    {
+        if (Entry->p.s.Hash == Hash && Entry->p.s.Len == Len && memcmp((void *)&Entry->p.s.Key[0], (void *)Key, Len) == 0)
+            break;   /* found */
+    }
+    
+    return Slot;
+}
+
+/* add an identifier to a table which has room for it. returns the shared copy */
+static char *TableAddIdentifier(Picoc *pc, struct Table *Tbl, const char *Ident, int IdentLen)
+{
+    uint32_t Hash = TableHash(Ident, IdentLen);
+    int AddAt = TableSearchIdentifier(Tbl, Ident, IdentLen, Hash);
+    
+    if (Tbl->HashTable[AddAt] != NULL)
+        return &Tbl->HashTable[AddAt]->p.s.Key[0];
     else
     {   /* add it to the table - we economise by not allocating the whole structure here */
-        struct TableEntry *NewEntry = HeapAllocMem(pc, sizeof(struct TableEntry) - sizeof(union TableEntryPayload) + IdentLen + 1);
+        struct TableEntry *NewEntry = HeapAllocMem(pc, sizeof(struct TableEntry) - sizeof(union TableEntryPayload) + sizeof(struct StringEntry) + IdentLen);
         if (NewEntry == NULL)
             ProgramFailNoParser(pc, "out of memory");
             
-        strncpy((char *)&NewEntry->p.Key[0], (char *)Ident, IdentLen);
-        NewEntry->p.Key[IdentLen] = '\0';
-        NewEntry->Next = Tbl->HashTable[AddAt];
+        HEAP_ALLOC_USE(pc, PicocHeapTables, sizeof(struct TableEntry) - sizeof(union TableEntryPayload) + sizeof(struct StringEntry) + IdentLen);
+        NewEntry->p.s.Hash = Hash;
+        NewEntry->p.s.Len = IdentLen;
+        NewEntry->p.s.Index = -1;
+        memcpy((void *)&NewEntry->p.s.Key[0], (void *)Ident, IdentLen);
+        NewEntry->p.s.Key[IdentLen] = '\0';
         Tbl->HashTable[AddAt] = NewEntry;
-        return &NewEntry->p.Key[0];
+        Tbl->Count++;
+        return &NewEntry->p.s.Key[0];
     }
 }
 
+/* set an identifier and return the identifier. share if possible */
+char *TableSetIdentifier(Picoc *pc, struct Table *Tbl, const char *Ident, int IdentLen)
+{
+    TableMakeRoom(pc, Tbl, 1, &TableIdentifierSlot);
+    return TableAddIdentifier(pc, Tbl, Ident, IdentLen);
+}
+
 /* register a string in the shared string store */
 char *TableStrRegister2(Picoc *pc, const char *Str, int Len)
 {
@@ -173,19 +329,70 @@ char *TableStrRegister(Picoc *pc, const char *Str)
     return TableStrRegister2(pc, Str, strlen((char *)Str));
 }
 
-/* free all the strings */
-void TableStrFree(Picoc *pc)
+/* register a list of strings in the shared string store, making room for them all at 
+ * once. if Registered isn't NULL it gets the shared copy of each string */
+void TableStrRegisterList(Picoc *pc, const char **Strs, int NumStrs, char **Registered)
 {
-    struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
+    char *RegStr;
     int Count;
     
-    for (Count = 0; Count < pc->StringTable.Size; Count++)
+    TableMakeRoom(pc, &pc->StringTable, NumStrs, &TableIdentifierSlot);
+    for (Count = 0; Count < NumStrs; Count++)
     {
-        for (Entry = pc->StringTable.HashTable[Count]; Entry != NULL; Entry = NextEntry)
+        RegStr = TableAddIdentifier(pc, &pc->StringTable, Strs[Count], strlen((char *)Strs[Count]));
+        if (Registered != NULL)
+            Registered[Count] = RegStr;
+    }
+}
+
+/* get the number tokens refer to a shared string by, numbering it if it's new. the 
+ * numbers are small so they take less space in the tokens than a pointer would */
+int TableStrIndex(Picoc *pc, const char *Str)
+{
+    struct TableEntry Dummy;
+    struct TableEntry *Entry = (struct TableEntry *)(Str - ((char *)&Dummy.p.s.Key[0] - (char *)&Dummy));
+    
+    if (Entry->p.s.Index < 0)
+    {
+        if (pc->StringIndexUsed == pc->StringIndexSize)
         {
-            NextEntry = Entry->Next;
-            HeapFreeMem(pc, Entry);
+            int NewSize = pc->StringIndexSize == 0 ? STRING_TABLE_SIZE : pc->StringIndexSize * 2;
+            char **NewIndex = HeapAllocMem(pc, sizeof(char *) * NewSize);
+            if (NewIndex == NULL)
+                ProgramFailNoParser(pc, "out of memory");
+            
+            HEAP_ALLOC_USE(pc, PicocHeapTables, sizeof(char *) * NewSize);
+            if (pc->StringIndex != NULL)
+            {
+                memcpy((void *)NewIndex, (void *)pc->StringIndex, sizeof(char *) * pc->StringIndexUsed);
+                HeapFreeMem(pc, pc->StringIndex);
+            }
+            
+            pc->StringIndex = NewIndex;
+            pc->StringIndexSize = NewSize;
         }
+        
+        pc->StringIndex[pc->StringIndexUsed] = &Entry->p.s.Key[0];
+        Entry->p.s.Index = pc->StringIndexUsed++;
     }
+    
+    return Entry->p.s.Index;
+}
+
+/* free all the strings */
+void TableStrFree(Picoc *pc)
+{
+    struct TableEntry *Entry;
+    int Pos = 0;
+    
+    while ((Entry = TableNext(&pc->StringTable, &Pos)) != NULL)
+        HeapFreeMem(pc, Entry);
+    
+    TableFree(pc, &pc->StringTable);
+    if (pc->StringIndex != NULL)
+        HeapFreeMem(pc, pc->StringIndex);
+    
+    pc->StringIndex = NULL;
+    pc->StringIndexUsed = 0;
+    pc->StringIndexSize = 0;
 }
@@ -0,0 +1,69 @@
+#include <stdio.h>
+
+int Total = 0;
+
+int fib(int n)
+{
+    if (n < 2)
+        return n;
+
+    return fib(n-1) + fib(n-2);
+}
+
+int sum(int from, int to)
+{
+    int i;
+    int s = 0;
+
+    for (i = from; i <= to; i++)
+    {
+        if (i % 3 == 0)
+            continue;
+
+        if (i > 50)
+            break;
+
+        s += i;
+        Total++;
+    }
+
+    return s;
+}
+
+int mix(int a, int b)
+{
+    int c = a * b - (a << 2) + (b >> 1);
+
+    c ^= a | b & 7;
+    return c > 0 ? c : -c + !a + ~b;
+}
+
+void count(int n)
+{
+    int c = 0;
+
+    do
+    {
+        printf("%d ", c);
+        c++;
+    } while (c < n);
+
+    printf("\n");
+}
+
+int main()
+{
+    int i;
+
+    for (i = 0; i < 15; i++)
+        printf("%d ", fib(i));
+
+    printf("\n");
+    printf("%d %d\n", sum(1, 10), sum(40, 100));
+    printf("%d\n", Total);
+    printf("%d %d %d\n", mix(3, 4), mix(-5, 2), mix(0, 9));
+    count(5);
+    printf("%c%c\n", 'o', 'k');
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+
+int Count;
+
+void count(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        int Square = i * i;
+        char *Name = "square";
+
+        printf("%s %d: %d\n", Name, i, Square);
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        int Twice = i * 2;
+        int Copy[2];
+
+        Copy[0] = Twice;
+        printf("twice %d: %d\n", i, Copy[0]);
+    }
+}
+
+int calls(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        static int Calls = 0;
+
+        Calls++;
+        if (i == n - 1)
+            return Calls;
+    }
+
+    return 0;
+}
+
+/* a define isn't scoped - it's there for the rest of the program, however often it's run */
+void setup()
+{
+    {
+#define SIZE 10
+    }
+}
+
+int main()
+{
+    int j;
+
+    count(3);
+    printf("calls %d", calls(3));
+    printf(" %d\n", calls(2));
+    setup();
+    setup();
+    printf("size %d\n", SIZE);
+
+    for (j = 0; j < 10000; j++)
+    {
+        int Block = j;
+
+        Count += Block;
+    }
+
+    {
+        int First = 1;
+        printf("first %d\n", First);
+    }
+
+    {
+        int Second = 2;
+        printf("second %d\n", Second);
+    }
+
+    printf("%d %d\n", j, Count);
+
+    return 0;
+}
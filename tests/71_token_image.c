@@ -0,0 +1,34 @@
+#include <stdio.h>
+
+#define GREETING "hello"
+#define COUNT 3
+
+struct Point
+{
+    int x;
+    int y;
+};
+
+int main()
+{
+    struct Point p;
+    char c = 'z';
+    long big = 1234567L;
+    double half = 0.5;
+    int i;
+
+    p.x = 10;
+    p.y = 20;
+
+    for (i = 0; i < COUNT; i++)
+        printf("%s %d\n", GREETING, i);
+
+#ifdef COUNT
+    printf("%d %d %c %ld\n", p.x, p.y, c, big);
+#else
+    printf("not here\n");
+#endif
+    printf("%f\n", half);
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <picoc_unix.h>
+
+struct heapstats before;
+struct heapstats after;
+
+int depth(int n)
+{
+    int pad[64];
+
+    pad[0] = n;
+    if (n == 0)
+        return 0;
+
+    return depth(n - 1) + pad[0];
+}
+
+int check(struct heapstats *s)
+{
+    int i;
+    int free = 0;
+
+    for (i = 0; i < 32; i++)
+        free += s->freebytes[i];
+
+    printf("%d %d %d %d\n", s->size == s->stackused + s->unused + s->heapsize,
+        s->stackused <= s->stackhighwater, s->heapsize <= s->heaphighwater,
+        s->heapused + s->heapfree <= s->heapsize);
+    printf("%d %d\n", free == s->heapfree, s->largestfreeblock <= s->heapfree);
+
+    return 0;
+}
+
+heapstats(&before);
+check(&before);
+printf("%d\n", depth(50));
+
+struct point { int x; int y; };
+struct point pt;
+
+heapstats(&after);
+check(&after);
+printf("%d\n", after.stackhighwater > before.stackhighwater);
+printf("%d\n", after.heapused > before.heapused);
+printf("%d %d\n", after.allocations[HEAP_VALUES] > before.allocations[HEAP_VALUES],
+    after.allocations[HEAP_TYPES] > before.allocations[HEAP_TYPES]);
+printf("%d %d\n", after.allocations[HEAP_TOKENS] > 0, after.allocations[HEAP_TABLES] > 0);
+
+void main() {}
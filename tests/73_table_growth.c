@@ -0,0 +1,75 @@
+#include <stdio.h>
+
+/* enough globals, locals and struct members to make each kind of table grow twice. a table
+ * grows when an entry would make it more than half full. the globals start with
+ * GLOBAL_TABLE_SIZE (128) slots, and the smallest library defines 26 of them already. the
+ * locals start with LOCAL_TABLE_SIZE (16) slots and the members with STRUCT_TABLE_SIZE (8) */
+
+int g0 = 0, g1 = 1, g2 = 2, g3 = 3, g4 = 4, g5 = 5, g6 = 6, g7 = 7, g8 = 8, g9 = 9;
+int g10 = 10, g11 = 11, g12 = 12, g13 = 13, g14 = 14, g15 = 15, g16 = 16, g17 = 17, g18 = 18, g19 = 19;
+int g20 = 20, g21 = 21, g22 = 22, g23 = 23, g24 = 24, g25 = 25, g26 = 26, g27 = 27, g28 = 28, g29 = 29;
+int g30 = 30, g31 = 31, g32 = 32, g33 = 33, g34 = 34, g35 = 35, g36 = 36, g37 = 37, g38 = 38, g39 = 39;
+int g40 = 40, g41 = 41, g42 = 42, g43 = 43, g44 = 44, g45 = 45, g46 = 46, g47 = 47, g48 = 48, g49 = 49;
+int g50 = 50, g51 = 51, g52 = 52, g53 = 53, g54 = 54, g55 = 55, g56 = 56, g57 = 57, g58 = 58, g59 = 59;
+
+/* deleting a global moves back the entries after it in its probe sequence. that's done
+ * here, where the table is nearly half full and has long probe sequences. the globals after
+ * them have to be found afterwards, and so do the ones which are added again */
+delete g0; delete g1; delete g2; delete g3; delete g4; delete g5; delete g6; delete g7; delete g8; delete g9;
+int g0 = 100, g1 = 101, g2 = 102, g3 = 103, g4 = 104, g5 = 105, g6 = 106, g7 = 107, g8 = 108, g9 = 109;
+
+int g60 = 60, g61 = 61, g62 = 62, g63 = 63, g64 = 64, g65 = 65, g66 = 66, g67 = 67, g68 = 68, g69 = 69;
+int g70 = 70, g71 = 71, g72 = 72, g73 = 73, g74 = 74, g75 = 75, g76 = 76, g77 = 77, g78 = 78, g79 = 79;
+int g80 = 80, g81 = 81, g82 = 82, g83 = 83, g84 = 84, g85 = 85, g86 = 86, g87 = 87, g88 = 88, g89 = 89;
+int g90 = 90, g91 = 91, g92 = 92, g93 = 93, g94 = 94, g95 = 95, g96 = 96, g97 = 97, g98 = 98, g99 = 99;
+int g100 = 100, g101 = 101, g102 = 102;
+
+struct Members
+{
+    int m0;
+    int m1;
+    int m2;
+    int m3;
+    int m4;
+    int m5;
+    int m6;
+    int m7;
+    int m8;
+};
+
+/* it takes a long so it isn't compiled, which would keep its locals out of a table */
+long locals(long a)
+{
+    long l0 = a, l1 = l0 + 1, l2 = l1 + 1, l3 = l2 + 1, l4 = l3 + 1, l5 = l4 + 1, l6 = l5 + 1, l7 = l6 + 1;
+    long l8 = l7 + 1, l9 = l8 + 1, l10 = l9 + 1, l11 = l10 + 1, l12 = l11 + 1, l13 = l12 + 1, l14 = l13 + 1, l15 = l14 + 1;
+
+    return l0 + l8 + l15;
+}
+
+int main()
+{
+    struct Members s;
+    int Sum = 0;
+
+    Sum += g0 + g1 + g2 + g3 + g4 + g5 + g6 + g7 + g8 + g9;
+    Sum += g10 + g11 + g12 + g13 + g14 + g15 + g16 + g17 + g18 + g19;
+    Sum += g20 + g21 + g22 + g23 + g24 + g25 + g26 + g27 + g28 + g29;
+    Sum += g30 + g31 + g32 + g33 + g34 + g35 + g36 + g37 + g38 + g39;
+    Sum += g40 + g41 + g42 + g43 + g44 + g45 + g46 + g47 + g48 + g49;
+    Sum += g50 + g51 + g52 + g53 + g54 + g55 + g56 + g57 + g58 + g59;
+    Sum += g60 + g61 + g62 + g63 + g64 + g65 + g66 + g67 + g68 + g69;
+    Sum += g70 + g71 + g72 + g73 + g74 + g75 + g76 + g77 + g78 + g79;
+    Sum += g80 + g81 + g82 + g83 + g84 + g85 + g86 + g87 + g88 + g89;
+    Sum += g90 + g91 + g92 + g93 + g94 + g95 + g96 + g97 + g98 + g99;
+    Sum += g100 + g101 + g102;
+
+    s.m0 = 1;
+    s.m4 = 5;
+    s.m8 = 9;
+    printf("%d %d %d\n", g0, g9, g102);
+    printf("%d\n", Sum);
+    printf("%d %d\n", s.m0 + s.m8, s.m4);
+    printf("%ld\n", locals(1));
+    printf("%ld\n", locals(5));
+    return 0;
+}
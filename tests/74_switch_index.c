@@ -0,0 +1,143 @@
+#include <stdio.h>
+
+/* switch statements which go straight to their case labels, and some which have to search */
+
+#define STATE_IDLE 0
+#define STATE_RUN (STATE_IDLE + 1)
+#define STATE_STOP STATE_RUN * 2
+
+enum Colour { Red, Green = 5, Blue };
+
+int Classify(int c)
+{
+    switch (c)
+    {
+        case ' ': case '\t':
+            return 1;
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            return 2;
+        case -1:
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+int State(int s)
+{
+    int Result = 0;
+
+    switch (s)
+    {
+        case STATE_IDLE:
+            Result += 1;
+        case STATE_RUN:
+            Result += 10;
+            break;
+        case STATE_STOP:
+            Result += 100;
+            break;
+        case STATE_STOP:
+            Result += 1000;
+            break;
+    }
+
+    return Result;
+}
+
+int Paint(int c)
+{
+    int Count = 0;
+
+    switch (c)
+    {
+        case Red:
+        {
+            int x = 7;
+            Count = x;
+            break;
+        }
+        case Green:
+            switch (Count)
+            {
+                case 0: Count = 50; break;
+                default: Count = 60; break;
+            }
+            break;
+        case Blue:
+            Count = 6;
+    }
+
+    return Count;
+}
+
+int Variable(int s, int v)
+{
+    switch (s)
+    {
+        case 1: return 100;
+        case v: return 200;
+        default: return 300;
+    }
+}
+
+int Nested(int s)
+{
+    switch (s)
+    {
+        case 1:
+        {
+            case 2:
+                return 20;
+        }
+        default:
+            return 30;
+    }
+}
+
+int Searching(int s)
+{
+    int Result = 0;
+
+    switch (s)
+    {
+        case 0:
+            switch (Result)
+            {
+                case 0: Result = 10; break;
+            }
+        case 1:
+            Result += 1;
+    }
+
+    return Result;
+}
+
+int main()
+{
+    int Count;
+    int Total = 0;
+
+    printf("%d %d %d %d %d\n", Classify(' '), Classify('7'), Classify(-1), Classify('x'), Classify('\t'));
+    printf("%d %d %d %d\n", State(0), State(1), State(2), State(3));
+    printf("%d %d %d %d\n", Paint(Red), Paint(Green), Paint(Blue), Paint(9));
+    printf("%d %d %d\n", Variable(1, 4), Variable(4, 4), Variable(4, 5));
+    printf("%d %d %d\n", Nested(1), Nested(2), Nested(3));
+    printf("%d\n", Searching(1));
+
+    for (Count = 0; Count < 1000; Count++)
+    {
+        switch (Count % 7)
+        {
+            case 0: Total += 1; break;
+            case 3: Total += 3; break;
+            case 6: Total += 6; continue;
+        }
+
+        Total++;
+    }
+
+    printf("%d\n", Total);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+
+/* gotos which jump straight to their labels */
+
+int Machine(int Input)
+{
+    int Steps = 0;
+
+    goto start;
+
+even:
+    Steps++;
+    Input /= 2;
+    goto check;
+
+odd:
+    Steps++;
+    Input = Input * 3 + 1;
+
+check:
+    if (Input == 1)
+        goto done;
+
+start:
+    if (Input % 2 == 0)
+        goto even;
+    else
+        goto odd;
+
+done:
+    return Steps;
+}
+
+int Search(int Target)
+{
+    int x;
+    int y;
+
+    for (x = 0; x < 10; x++)
+    {
+        for (y = 0; y < 10; y++)
+        {
+            if (x * y == Target)
+                goto found;
+        }
+    }
+
+    return -1;
+
+found:
+    return x * 10 + y;
+}
+
+void Skipped()
+{
+    goto later;
+    int Count;
+    printf("not printed\n");
+
+later:
+    Count = 42;
+    printf("Count = %d\n", Count);
+}
+
+void Inner()
+{
+    int Total = 0;
+
+    goto inside;
+    printf("not printed\n");
+
+    {
+        int Value = 10;
+        printf("not printed\n");
+inside:
+        Value = 20;
+        Total += Value;
+    }
+
+    printf("Total = %d\n", Total);
+}
+
+int Backward()
+{
+    int Count = 0;
+    int Sum = 0;
+
+again:
+    {
+        int Square = Count * Count;
+        Sum += Square;
+    }
+
+    Count++;
+    while (Count < 5)
+        goto again;
+
+    return Sum;
+}
+
+int Switching(int s)
+{
+    int Result = 0;
+
+    switch (s)
+    {
+        case 0:
+            Result = 1;
+            goto out;
+        case 1:
+            Result = 2;
+        next:
+            Result *= 10;
+            break;
+        default:
+            goto next;
+    }
+
+    Result++;
+out:
+    return Result;
+}
+
+int main()
+{
+    int Count;
+    int Total = 0;
+
+    printf("%d %d %d\n", Machine(6), Machine(7), Machine(27));
+    printf("%d %d %d\n", Search(12), Search(49), Search(97));
+    Skipped();
+    Inner();
+    printf("%d\n", Backward());
+    printf("%d %d %d\n", Switching(0), Switching(1), Switching(2));
+
+    for (Count = 0; Count < 100; Count++)
+        Total += Machine(Count + 1);
+
+    printf("%d\n", Total);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+
+/* loops whose conditions and increments are compiled after the first time round */
+
+#define SIZE 8
+#define LIMIT (SIZE * 2 + 1)
+
+enum { Steps = 3 };
+
+int Global = 0;
+float Scale = 0.5;
+
+int Twice(int x)
+{
+    return x * 2;
+}
+
+int Count(int Depth)
+{
+    int i;
+    int Total = 0;
+
+    for (i = 0; i < Steps; i++)
+    {
+        if (Depth > 0)
+            Total += Count(Depth - 1);
+        else
+            Total++;
+    }
+
+    return Total;
+}
+
+int main()
+{
+    float Values[SIZE];
+    float Sum = 0.0;
+    int i;
+    int j;
+    int n = 10;
+    int Total = 0;
+    char c;
+
+    for (i = 0; i < SIZE; i++)
+        Values[i] = i * Scale;
+
+    for (i = SIZE - 1; i >= 0; i -= 2)
+        Sum += Values[i];
+
+    printf("%f %d\n", Sum, i);
+
+    for (i = 0; i < LIMIT; ++i)
+    {
+        if (i % 3 == 0)
+            continue;
+
+        if (i > 13)
+            break;
+
+        Total += i;
+    }
+
+    printf("%d %d\n", Total, i);
+
+    while ((n -= 3) > 0)
+        Total += n;
+
+    printf("%d %d\n", Total, n);
+
+    for (Global = 0; Global < 5 && Total > 0; Global++)
+        Total -= Global;
+
+    printf("%d %d\n", Total, Global);
+
+    j = 10;
+    for (i = 0; i < j; j--)
+        i += 2;
+
+    printf("%d %d %d\n", Total, i, j);
+
+    for (i = 0; Twice(i) < 10; i++)
+        Total += Sum;
+
+    printf("%d\n", Total);
+
+    for (c = 'a'; c < 'f'; c++)
+        printf("%c", c);
+
+    printf("\n");
+
+    i = 0;
+    while (i < 100)
+    {
+        i++;
+        if (i == 7)
+            goto done;
+    }
+
+done:
+    printf("%d\n", i);
+    printf("%d\n", Count(3));
+
+    Total = 0;
+    for (i = 0; i < 100; i++)
+        for (j = i; j < 100; j++)
+            Total += j - i;
+
+    printf("%d\n", Total);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+
+/* expressions made of constants are worked out once and their values kept */
+
+#define WIDTH 64
+#define HEIGHT (WIDTH / 2)
+#define AREA (WIDTH * HEIGHT)
+#define NEGATIVE -(WIDTH + 1)
+#define LETTER 'a'
+#define SQUARE(x) ((x) * (x))
+
+enum Colour { Red = 3, Green, Blue };
+
+int Table[HEIGHT / 8] = { WIDTH, HEIGHT * 2, AREA % 1000, 1 << 4 };
+
+int Pixel(int x, int y)
+{
+    return y * WIDTH + x + (HEIGHT - 1) * 0;
+}
+
+int Shades(int c)
+{
+    int Red = 100;
+    
+    return c * (Red + Green) + Blue;
+}
+
+int Mixed(int n)
+{
+    int Count;
+    int Total = 0;
+    char Letter = LETTER;
+    
+    for (Count = 0; Count < n; Count++)
+    {
+        Total += Count % 2 ? WIDTH / 4 : -HEIGHT / 8;
+        Total += Table[AREA / 1024 - 1] + SQUARE(2 + 1);
+        if (Count > WIDTH * 1000)
+            Total += 1 / (WIDTH - WIDTH);
+    }
+    
+    return Total + Letter + (LETTER + 1) + sizeof(WIDTH * 2);
+}
+
+int Radius()
+{
+    return RADIUS * 2 + 1;
+}
+
+#define RADIUS 5
+
+/* a kept value has to be worked out again when a macro it used is defined again */
+#define SCALE 1
+
+int Scaled(int v)
+{
+    return SCALE * 3 + (v + SCALE) * 100;
+}
+
+int ScaledBefore = Scaled(10);
+delete SCALE;
+#define SCALE 2
+int ScaledAfter = Scaled(10);
+
+int main()
+{
+    int Count;
+    
+    printf("%d %d %d %d\n", Table[0], Table[1], Table[2], Table[3]);
+    printf("%d %d %d\n", Pixel(3, 2), Pixel(0, HEIGHT), NEGATIVE);
+    printf("%d %d\n", Shades(1), Shades(2));
+    for (Count = 0; Count < 3; Count++)
+        printf("%d\n", Mixed(Count * 5));
+    printf("%d %d\n", Radius(), Radius());
+    printf("%d %d\n", ScaledBefore, ScaledAfter);
+    
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+
+/* struct members used again and again, and the same member name in different structs */
+
+struct Reading
+{
+    int Sensor;
+    int Value;
+    char Flag;
+};
+
+struct Other
+{
+    char Pad[5];
+    int Value;
+};
+
+union Both
+{
+    int Value;
+    char Bytes[4];
+};
+
+#define VALUE(r) (r).Value
+
+struct Reading Readings[10];
+
+int Total(struct Reading *r, int Count)
+{
+    int Sum = 0;
+    int i;
+
+    for (i = 0; i < Count; i++)
+        Sum += r[i].Value * r[i].Sensor;
+
+    return Sum;
+}
+
+int main()
+{
+    struct Reading *r;
+    struct Other o;
+    union Both b;
+    int Count;
+    int Sum = 0;
+
+    for (Count = 0; Count < 10; Count++)
+    {
+        r = &Readings[Count];
+        r->Sensor = Count;
+        r->Value = Count * 3;
+        r->Flag = 'a' + Count;
+    }
+
+    printf("%d\n", Total(Readings, 10));
+
+    o.Value = 77;
+    b.Value = 0;
+    b.Bytes[0] = 1;
+    for (Count = 0; Count < 3; Count++)
+    {
+        Sum += VALUE(Readings[Count + 1]);
+        Sum += VALUE(o);
+        Sum += VALUE(b) != 0;
+    }
+
+    printf("%d %c %c\n", Sum, Readings[2].Flag, Readings[9].Flag);
+    return 0;
+}
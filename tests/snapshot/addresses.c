@@ -0,0 +1,74 @@
+#include <stdio.h>
+
+/* global variables holding real pointers into the instance, and ordinary data which
+ * looks like pointers into it. after a restore at another address the pointers have to
+ * follow the instance and the data has to stay as it was */
+
+#define CHECK_BITS 0x5a5a
+
+union Number
+{
+    double FP;
+    long Bits;
+};
+
+union Text
+{
+    char Chars[16];
+    long Bits[2];
+};
+
+struct Mixed
+{
+    long Bits;
+    int *Ptr;
+    char Chars[8];
+};
+
+int Real = 42;
+int *RealPtr;
+long RealBits;
+long Fake;
+union Number FakeNumber;
+union Text FakeText;
+struct Mixed Both[2];
+long Check[5];
+
+RealPtr = &Real;
+RealBits = (long)&Real;
+Fake = RealBits;
+FakeNumber.Bits = RealBits;
+FakeText.Bits[1] = RealBits;
+Both[1].Bits = RealBits;
+Both[1].Ptr = &Real;
+Check[0] = Fake ^ CHECK_BITS;
+Check[1] = FakeNumber.Bits ^ CHECK_BITS;
+Check[2] = FakeText.Bits[1] ^ CHECK_BITS;
+Check[3] = Both[1].Bits ^ CHECK_BITS;
+
+/* returns how many values are wrong in the restored instance */
+int check()
+{
+    int Wrong = 0;
+
+    if ((long)&Real == RealBits)
+    {
+        printf("the instance wasn't moved\n");
+        Wrong++;
+    }
+
+    if (RealPtr != &Real || *RealPtr != 42 || Both[1].Ptr != &Real || *Both[1].Ptr != 42)
+    {
+        printf("a pointer wasn't relocated\n");
+        Wrong++;
+    }
+
+    if ((Fake ^ CHECK_BITS) != Check[0] || (FakeNumber.Bits ^ CHECK_BITS) != Check[1] ||
+            (FakeText.Bits[1] ^ CHECK_BITS) != Check[2] || (Both[1].Bits ^ CHECK_BITS) != Check[3])
+    {
+        printf("data which looks like a pointer was changed\n");
+        Wrong++;
+    }
+
+    return Wrong;
+}
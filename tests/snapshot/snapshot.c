@@ -0,0 +1,66 @@
+/* checks that an instance restored from a snapshot at another address has its pointers
+ * moved with it, while ordinary data which happens to look like an address in the
+ * instance is left alone. the script sets up the values and checks them itself.
+ *
+ * usage: snapshot <script.c> */
+
+#include "../../picoc.h"
+
+int main(int argc, char **argv)
+{
+    Picoc *Original = malloc(sizeof(Picoc));
+    Picoc *Restored = malloc(sizeof(Picoc));
+    struct PicocFunction Check;
+    union AnyValue Result;
+    void *Snapshot;
+    int SnapshotLen;
+    int Passed = FALSE;
+
+    if (argc != 2)
+    {
+        printf("Format: snapshot <script.c>\n");
+        exit(1);
+    }
+
+    if (Original == NULL || Restored == NULL)
+    {
+        printf("out of memory\n");
+        exit(1);
+    }
+
+    if (!PicocInitialise(Original, HEAP_SIZE))
+    {
+        printf("out of memory\n");
+        exit(1);
+    }
+
+    if (PicocPlatformSetExitPoint(Original))
+    {
+        PicocCleanup(Original);
+        exit(1);
+    }
+
+    PicocPlatformScanFile(Original, argv[1]);
+    Snapshot = PicocSnapshot(Original, &SnapshotLen);
+
+    /* the original is kept until the end so the restored instance can't reuse its memory */
+    if (!PicocRestore(Restored, Snapshot, SnapshotLen))
+        printf("can't restore the snapshot\n");
+    else
+    {
+        if (!PicocPlatformSetExitPoint(Restored) && PicocGetFunction(Restored, "check", &Check))
+        {
+            PicocCallFunctionHandle(Restored, &Check, NULL, 0, &Result);
+            Passed = Result.Integer == 0;
+        }
+
+        PicocCleanup(Restored);
+    }
+
+    PicocCleanup(Original);
+    free(Original);
+    free(Snapshot);
+    free(Restored);
+    printf("snapshot test %s\n", Passed ? "passed" : "failed");
+    return !Passed;
+}
@@ -0,0 +1,309 @@
+/* runs the test suite on several threads at once, each test in its own picoc instance,
+ * to check that instances don't share any state. each test's output is captured from
+ * its instance and compared with its .expect file. with -p each thread takes its
+ * instances from a pool, so every test after the first runs in a reset instance. with -s
+ * each test runs in time slices of the given number of statements.
+ *
+ * usage: stress [-j <threads>] [-r <repeats>] [-p] [-s <statements>] <test.c>... */
+
+#include "../../picoc.h"
+
+#include <pthread.h>
+
+#define STRESS_THREADS 8
+#define STRESS_REPEATS 4
+
+/* the output a thread's instance has written so far */
+struct StressOutput
+{
+    char *Text;
+    int Len;
+    int Max;
+};
+
+struct StressThread
+{
+    pthread_t Thread;
+    int ThreadNo;
+    int Failures;
+    int Slices;
+    struct PicocPool *Pool;
+    struct StressOutput Output;
+};
+
+static char **TestNames;
+static int NumTests;
+static int Repeats = STRESS_REPEATS;
+static int SliceStatements;
+static pthread_key_t ThreadKey;
+
+/* read a whole file, NULL if it can't be read */
+static char *StressReadFile(const char *FileName)
+{
+    FILE *InFile = fopen(FileName, "rb");
+    char *Text;
+    long Len;
+
+    if (InFile == NULL)
+        return NULL;
+
+    fseek(InFile, 0, SEEK_END);
+    Len = ftell(InFile);
+    rewind(InFile);
+    Text = malloc(Len + 1);
+    if (Text != NULL)
+        Text[fread(Text, 1, Len, InFile)] = '\0';
+
+    fclose(InFile);
+    return Text;
+}
+
+/* add some text to a thread's captured output */
+static void StressAddOutput(struct StressOutput *Output, const char *Text, int Len)
+{
+    if (Output->Len + Len + 1 > Output->Max)
+    {
+        Output->Max = (Output->Len + Len + 1) * 2;
+        Output->Text = realloc(Output->Text, Output->Max);
+    }
+
+    memcpy(&Output->Text[Output->Len], Text, Len);
+    Output->Len += Len;
+    Output->Text[Output->Len] = '\0';
+}
+
+#ifdef BUILTIN_MINI_STDLIB
+/* the console stream of the instance running on this thread */
+static void StressPutc(unsigned char OutCh, union OutputStreamInfo *Stream)
+{
+    struct StressThread *Thread = pthread_getspecific(ThreadKey);
+    char Ch = OutCh;
+
+    StressAddOutput(&Thread->Output, &Ch, 1);
+}
+#endif
+
+/* compare output with what's expected, ignoring differences in the amount of white space
+ * like "diff -b" */
+static int StressCompare(const char *Got, const char *Expected)
+{
+    while (*Got != '\0' || *Expected != '\0')
+    {
+        int GotSpace = FALSE;
+        int ExpectedSpace = FALSE;
+
+        for (; *Got == ' ' || *Got == '\t' || *Got == '\r'; Got++)
+            GotSpace = TRUE;
+
+        for (; *Expected == ' ' || *Expected == '\t' || *Expected == '\r'; Expected++)
+            ExpectedSpace = TRUE;
+
+        if (GotSpace != ExpectedSpace && *Got != '\n' && *Expected != '\n' && *Got != '\0' && *Expected != '\0')
+            return FALSE;
+
+        if (*Got != *Expected)
+            return FALSE;
+
+        if (*Got != '\0')
+        {
+            Got++;
+            Expected++;
+        }
+    }
+
+    return TRUE;
+}
+
+/* load and run a test program */
+static void StressRunProgram(Picoc *pc, void *TestName)
+{
+    static char *Args[] = { "-", "arg1", "arg2", "arg3", "arg4", NULL };
+
+    PicocPlatformScanFileByLine(pc, TestName);
+    if (strstr(TestName, "args") != NULL)
+        PicocCallMain(pc, 5, Args);
+    else
+        PicocCallMain(pc, 0, &Args[5]);
+}
+
+/* run a test in a new instance and check its output */
+static int StressRunTest(struct StressThread *Thread, Picoc *pc, const char *TestName)
+{
+    char ExpectName[FILENAME_MAX];
+    char *Expected;
+    int Passed;
+#ifndef BUILTIN_MINI_STDLIB
+    FILE *OutFile = tmpfile();
+    char Buf[256];
+    int BytesRead;
+
+    if (OutFile == NULL)
+        return FALSE;
+#endif
+
+    Thread->Output.Len = 0;
+    StressAddOutput(&Thread->Output, "", 0);
+    if (Thread->Pool != NULL)
+        pc = PicocPoolGet(Thread->Pool);
+    else if (!PicocInitialise(pc, HEAP_SIZE))
+    {
+        fprintf(stderr, "out of memory for test %s\n", TestName);
+#ifndef BUILTIN_MINI_STDLIB
+        fclose(OutFile);
+#endif
+        return FALSE;
+    }
+
+    /* capture the instance's output */
+#ifdef BUILTIN_MINI_STDLIB
+    pc->CStdOutBase.Putch = &StressPutc;
+#else
+    pc->CStdOut = OutFile;
+    pc->StdoutValue = OutFile;
+#endif
+
+    if (SliceStatements != 0)
+    {
+        PicocSetStatementBudget(pc, SliceStatements);
+        if (PicocPlatformStartSlice(pc, &StressRunProgram, (void *)TestName))
+        {
+            do
+                Thread->Slices++;
+            while (PicocPlatformResumeSlice(pc));
+        }
+    }
+    else if (!PicocPlatformSetExitPoint(pc))
+        StressRunProgram(pc, (void *)TestName);
+
+    if (Thread->Pool != NULL)
+        PicocPoolPut(Thread->Pool, pc);
+    else
+        PicocCleanup(pc);
+
+#ifndef BUILTIN_MINI_STDLIB
+    rewind(OutFile);
+    while ((BytesRead = fread(Buf, 1, sizeof(Buf), OutFile)) > 0)
+        StressAddOutput(&Thread->Output, Buf, BytesRead);
+
+    fclose(OutFile);
+#endif
+
+    strncpy(ExpectName, TestName, sizeof(ExpectName) - sizeof(".expect"));
+    ExpectName[sizeof(ExpectName) - sizeof(".expect")] = '\0';
+    if (strrchr(ExpectName, '.') != NULL)
+        *strrchr(ExpectName, '.') = '\0';
+
+    strcat(ExpectName, ".expect");
+    Expected = StressReadFile(ExpectName);
+    Passed = Expected != NULL && StressCompare(Thread->Output.Text, Expected);
+    if (!Passed)
+        fprintf(stderr, "error in test %s:\n%s", TestName, Thread->Output.Text);
+
+    free(Expected);
+    return Passed;
+}
+
+/* run every test several times, starting at a different test on each thread */
+static void *StressThreadMain(void *Arg)
+{
+    struct StressThread *Thread = Arg;
+    Picoc *pc = NULL;
+    int Count;
+
+    if (Thread->Pool == NULL && (pc = malloc(sizeof(Picoc))) == NULL)
+    {
+        Thread->Failures++;
+        return NULL;
+    }
+
+    pthread_setspecific(ThreadKey, Thread);
+    for (Count = 0; Count < NumTests * Repeats; Count++)
+    {
+        if (!StressRunTest(Thread, pc, TestNames[(Count + Thread->ThreadNo) % NumTests]))
+            Thread->Failures++;
+    }
+
+    free(Thread->Output.Text);
+    free(pc);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct StressThread *Threads;
+    Picoc *Template = NULL;
+    int NumThreads = STRESS_THREADS;
+    int Failures = 0;
+    int Slices = 0;
+    int ParamCount;
+    int Count;
+
+    for (ParamCount = 1; ParamCount < argc && argv[ParamCount][0] == '-'; ParamCount++)
+    {
+        if (strcmp(argv[ParamCount], "-p") == 0)
+            Template = malloc(sizeof(Picoc));
+        else if (strcmp(argv[ParamCount], "-j") == 0 && ParamCount + 1 < argc)
+            NumThreads = atoi(argv[++ParamCount]);
+        else if (strcmp(argv[ParamCount], "-r") == 0 && ParamCount + 1 < argc)
+            Repeats = atoi(argv[++ParamCount]);
+        else if (strcmp(argv[ParamCount], "-s") == 0 && ParamCount + 1 < argc)
+            SliceStatements = atoi(argv[++ParamCount]);
+        else
+            break;
+    }
+
+    if (ParamCount >= argc || NumThreads < 1)
+    {
+        printf("Format: stress [-j <threads>] [-r <repeats>] [-p] [-s <statements>] <test.c>...\n");
+        exit(1);
+    }
+
+    TestNames = &argv[ParamCount];
+    NumTests = argc - ParamCount;
+    pthread_key_create(&ThreadKey, NULL);
+    Threads = calloc(NumThreads, sizeof(struct StressThread));
+    if (Template != NULL && !PicocInitialise(Template, HEAP_SIZE))
+    {
+        printf("out of memory\n");
+        exit(1);
+    }
+
+    for (Count = 0; Count < NumThreads; Count++)
+    {
+        Threads[Count].ThreadNo = Count;
+        if (Template != NULL)
+            Threads[Count].Pool = PicocPoolCreate(Template, 1);
+    }
+
+    for (Count = 0; Count < NumThreads; Count++)
+    {
+        if (pthread_create(&Threads[Count].Thread, NULL, &StressThreadMain, &Threads[Count]) != 0)
+        {
+            printf("can't create thread %d\n", Count);
+            exit(1);
+        }
+    }
+
+    for (Count = 0; Count < NumThreads; Count++)
+    {
+        pthread_join(Threads[Count].Thread, NULL);
+        Failures += Threads[Count].Failures;
+        Slices += Threads[Count].Slices;
+        if (Threads[Count].Pool != NULL)
+            PicocPoolFree(Threads[Count].Pool);
+    }
+
+    if (Template != NULL)
+    {
+        PicocCleanup(Template);
+        free(Template);
+    }
+
+    free(Threads);
+    printf("%d tests on %d threads, %d failures", NumTests * Repeats * NumThreads, NumThreads, Failures);
+    if (SliceStatements != 0)
+        printf(", %d slices of %d statements", Slices, SliceStatements);
+
+    printf("\n");
+    return Failures != 0;
+}
@@ -44,8 +44,10 @@ uint8_t StrHash(const char *Str)
 /* initialise the variable system */
 void VariableInit(Picoc *pc)
 {
-    TableInitTable(&(pc->GlobalTable), &(pc->GlobalHashTable)[0], GLOBAL_TABLE_SIZE, TRUE);
-    TableInitTable(&pc->StringLiteralTable, &pc->StringLiteralHashTable[0], STRING_LITERAL_TABLE_SIZE, TRUE);
+    TableInitTable(pc, &(pc->GlobalTable), &(pc->GlobalHashTable)[0], GLOBAL_TABLE_SIZE, TRUE);
+    TableInitTable(pc, &pc->StringLiteralTable, &pc->StringLiteralHashTable[0], STRING_LITERAL_TABLE_SIZE, TRUE);
+    pc->GlobalScope.Variables = NULL;
+    pc->GlobalScope.Depth = 0;
     pc->TopStackFrame = NULL;
 }
 
@@ -60,6 +62,12 @@ void VariableFree(Picoc *pc, struct Value *Val)
             if (Val->Val->FuncDef.Body->Pos)
                 HeapFreeMem(pc, (void *)Val->Val->FuncDef.Body->Pos);
             HeapFreeMem(pc, (void *)Val->Val->FuncDef.Body);
+            if (Val->Val->FuncDef.SlotMap != NULL)
+                HeapFreeMem(pc, Val->Val->FuncDef.SlotMap);
+            ParseFreeIndexes(pc, &Val->Val->FuncDef);
+#ifndef NO_BYTECODE
+            BytecodeFree(pc, &Val->Val->FuncDef);
+#endif
         }
 
         /* free macro bodies */
@@ -80,20 +88,17 @@ void VariableFree(Picoc *pc, struct Value *Val)
 void VariableTableCleanup(Picoc *pc, struct Table *HashTable)
 {
     struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
-    int Count;
+    int Pos = 0;
     
-    for (Count = 0; Count < HashTable->Size; Count++)
+    while ((Entry = TableNext(HashTable, &Pos)) != NULL)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != NULL; Entry = NextEntry)
-        {
-            NextEntry = Entry->Next;
-            VariableFree(pc, Entry->p.v.Val);
-                
-            /* free the hash table entry */
-            HeapFreeMem(pc, Entry);
-        }
+        VariableFree(pc, Entry->p.v.Val);
+            
+        /* free the hash table entry */
+        HeapFreeMem(pc, Entry);
     }
+    
+    TableFree(pc, HashTable);
 }
 
 void VariableCleanup(Picoc *pc)
@@ -102,15 +107,13 @@ void VariableCleanup(Picoc *pc)
     VariableTableCleanup(pc, &pc->StringLiteralTable);
 }
 
-int varmemused = 0;
-
 /* allocate some memory, either on the heap or the stack and check if we've run out */
 void *VariableAlloc(Picoc *pc, struct ParseState *Parser, int Size, int OnHeap)
 {
     void *NewValue;
 
     if (OnHeap)
-        varmemused += Size;
+        pc->VariableMemUsed += Size;
 
     if (OnHeap)
         NewValue = HeapAllocMem(pc, Size);
@@ -118,7 +121,12 @@ void *VariableAlloc(Picoc *pc, struct ParseState *Parser, int Size, int OnHeap)
         NewValue = HeapAllocStack(pc, Size);
     
     if (NewValue == NULL)
-        ProgramFail(Parser, "out of memory");
+    {
+        if (Parser == NULL)
+            ProgramFailNoParser(pc, "out of memory");
+        else
+            ProgramFail(Parser, "out of memory");
+    }
     
 #ifdef DEBUG_HEAP
     if (!OnHeap)
@@ -134,6 +142,9 @@ void *VariableAlloc(Picoc *pc, struct ParseState *Parser, int Size, int OnHeap)
 struct Value *VariableAllocValueAndData(Picoc *pc, struct ParseState *Parser, int DataSize, int IsLValue, struct Value *LValueFrom, int OnHeap)
 {
     struct Value *NewValue = VariableAlloc(pc, Parser, MEM_ALIGN(sizeof(struct Value)) + DataSize, OnHeap);
+    if (OnHeap)
+        HEAP_ALLOC_USE(pc, PicocHeapValues, MEM_ALIGN(sizeof(struct Value)) + DataSize);
+        
     NewValue->Val = (union AnyValue *)((char *)NewValue + MEM_ALIGN(sizeof(struct Value)));
     NewValue->Flags = 0;
     if (OnHeap)
@@ -143,8 +154,6 @@ struct Value *VariableAllocValueAndData(Picoc *pc, struct ParseState *Parser, in
     if (IsLValue)
         NewValue->Flags |= FlagIsLValue;
     NewValue->LValueFrom = LValueFrom;
-    if (Parser) 
-        NewValue->ScopeID = Parser->ScopeID;
 
     debugline("sizes: %d/%d/%d\n", sizeof(struct Value), MEM_ALIGN(sizeof(struct Value)), sizeof(NewValue->Flags));
 
@@ -209,129 +218,203 @@ void VariableRealloc(struct ParseState *Parser, struct Value *FromValue, int New
         HeapFreeMem(Parser->pc, FromValue->Val);
         
     FromValue->Val = VariableAlloc(Parser->pc, Parser, NewSize, TRUE);
+    HEAP_ALLOC_USE(Parser->pc, PicocHeapValues, NewSize);
     FromValue->Flags |= FlagAnyValOnHeap;
 }
 
-int VariableScopeBegin(struct ParseState * Parser, int16_t* OldScopeID)
+/* the blocks we're inside in the current function, or at the global level */
+static struct VariableScope *VariableCurrentScope(Picoc *pc)
 {
+    return (pc->TopStackFrame == NULL) ? &pc->GlobalScope : &pc->TopStackFrame->Scope;
+}
+
+/* enter a block */
+void VariableScopeBegin(struct ParseState *Parser)
+{
+    VariableCurrentScope(Parser->pc)->Depth++;
+}
+
+/* leave a block. the variables declared in it go out of scope */
+void VariableScopeEnd(struct ParseState *Parser)
+{
+    struct VariableScope *Scope = VariableCurrentScope(Parser->pc);
     struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
-    Picoc * pc = Parser->pc;
-    int Count;
-    #ifdef VAR_SCOPE_DEBUG
-    int FirstPrint = 0;
-    #endif
-    
-    struct Table * HashTable = (pc->TopStackFrame == NULL) ? &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
 
-    if (Parser->ScopeID == -1) return -1;
+    /* a block left by an error may still have variables deeper than this one */
+    while ((Entry = Scope->Variables) != NULL && Entry->p.v.Val->ScopeDepth >= Scope->Depth)
+    {
+        Entry->p.v.Val->Flags |= FlagOutOfScope;
+        Entry->p.v.Key = TABLE_HIDDEN_KEY(Entry->p.v.Key);  /* alter the key so it won't be found by normal searches */
+        Scope->Variables = Entry->p.v.NextInScope;
+    }
 
-    /* XXX dumb hash, let's hope for no collisions... */
-    *OldScopeID = Parser->ScopeID;
-    /*Parser->ScopeID = (int)(intptr_t)(Parser->SourceText) * ((int)(intptr_t)(Parser->Pos) / sizeof(char*));*/
-    /* or maybe a more human-readable hash for debugging? */
-    /*Parser->ScopeID = Parser->Line * 0x10000 + Parser->CharacterPos;*/
-    Parser->ScopeID = (Parser->SourceText) ? StrHash(Parser->SourceText) : 0 + Parser->Line * 0x100 + Parser->CharacterPos;
-    
-    for (Count = 0; Count < HashTable->Size; Count++)
+    Scope->Depth--;
+}
+
+/* a variable declared in a block is being deleted, so it can't go out of scope any more */
+void VariableScopeForget(Picoc *pc, const char *Ident)
+{
+    struct TableEntry **EntryPtr;
+
+    for (EntryPtr = &VariableCurrentScope(pc)->Variables; *EntryPtr != NULL; EntryPtr = &(*EntryPtr)->p.v.NextInScope)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != NULL; Entry = NextEntry)
+        if ((*EntryPtr)->p.v.Key == Ident)
         {
-            NextEntry = Entry->Next;
-            if (Entry->p.v.Val->ScopeID == Parser->ScopeID && Entry->p.v.Val->Flags & FlagOutOfScope)
-            {
-                Entry->p.v.Val->Flags &= ~FlagOutOfScope;
-                Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key & ~1);
-                #ifdef VAR_SCOPE_DEBUG
-                if (!FirstPrint) { PRINT_SOURCE_POS; }
-                FirstPrint = 1;
-                printf(">>> back into scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
-                #endif
-            }
+            *EntryPtr = (*EntryPtr)->p.v.NextInScope;
+            return;
         }
     }
-
-    return Parser->ScopeID;
 }
 
-void VariableScopeEnd(struct ParseState * Parser, int ScopeID, int16_t PrevScopeID)
+/* add a variable to the block it's declared in */
+static void VariableScopeAdd(Picoc *pc, struct TableEntry *Entry)
 {
-    struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
-    Picoc * pc = Parser->pc;
-    int Count;
-    #ifdef VAR_SCOPE_DEBUG
-    int FirstPrint = 0;
-    #endif
+    struct VariableScope *Scope = VariableCurrentScope(pc);
 
-    struct Table * HashTable = (pc->TopStackFrame == NULL) ? &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
+    Entry->p.v.Val->ScopeDepth = Scope->Depth;
+    if (Scope->Depth > 0)
+    {
+        Entry->p.v.NextInScope = Scope->Variables;
+        Scope->Variables = Entry;
+    }
+}
 
-    if (ScopeID == -1) return;
+/* when a block is entered again its declarations bring the same variables back into scope */
+static struct Value *VariableScopeRevive(Picoc *pc, struct Table *Tbl, char *Ident, struct ValueType *Typ, const unsigned char *DeclPos)
+{
+    struct TableEntry *Entry;
+    int Pos = -1;
 
-    for (Count = 0; Count < HashTable->Size; Count++)
+    while ((Entry = TableFindNext(Tbl, Ident, &Pos)) != NULL)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != NULL; Entry = NextEntry)
+        if (Entry->p.v.Key == TABLE_HIDDEN_KEY(Ident) && Entry->p.v.DeclPos == DeclPos && Entry->p.v.Val->Typ == Typ)
         {
-            NextEntry = Entry->Next;
-            if (Entry->p.v.Val->ScopeID == ScopeID && !(Entry->p.v.Val->Flags & FlagOutOfScope))
-            {
-                #ifdef VAR_SCOPE_DEBUG
-                if (!FirstPrint) { PRINT_SOURCE_POS; }
-                FirstPrint = 1;
-                printf(">>> out of scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
-                #endif
-                Entry->p.v.Val->Flags |= FlagOutOfScope;
-                Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key | 1); /* alter the key so it won't be found by normal searches */
-            }
+            Entry->p.v.Key = Ident;
+            Entry->p.v.Val->Flags &= ~FlagOutOfScope;
+            VariableScopeAdd(pc, Entry);
+            return Entry->p.v.Val;
         }
     }
 
-    Parser->ScopeID = PrevScopeID;
+    return NULL;
+}
+
+/* a new variable has just been put in a table - remember where it was declared and add it 
+ * to the block it's declared in */
+static void VariableScopeDeclare(Picoc *pc, struct Table *Tbl, char *Ident, const unsigned char *DeclPos)
+{
+    struct TableEntry *Entry;
+    int Pos = -1;
+
+    while ((Entry = TableFindNext(Tbl, Ident, &Pos))->p.v.Key != Ident)
+    {}
+
+    Entry->p.v.DeclPos = DeclPos;
+    VariableScopeAdd(pc, Entry);
 }
 
 int VariableDefinedAndOutOfScope(Picoc * pc, const char* Ident)
 {
     struct TableEntry *Entry;
-    int Count;
+    int Pos = -1;
 
     struct Table * HashTable = (pc->TopStackFrame == NULL) ? &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
-    for (Count = 0; Count < HashTable->Size; Count++)
+    while ((Entry = TableFindNext(HashTable, Ident, &Pos)) != NULL)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != NULL; Entry = Entry->Next)
-        {
-            if (Entry->p.v.Val->Flags & FlagOutOfScope && (char*)((intptr_t)Entry->p.v.Key & ~1) == Ident)
-                return TRUE;
-        }
+        if (Entry->p.v.Key == TABLE_HIDDEN_KEY(Ident))
+            return TRUE;
     }
+
     return FALSE;
 }
 
+/* names are hashed by their address relative to the heap so a slot map still works if the
+ * instance is moved by PicocRestore() */
+#define VARIABLE_SLOT_HASH(pc, Ident, HashSize) (((unsigned long)(Ident) - (unsigned long)HEAP_HASH_BASE(pc)) % (HashSize))
+
+/* find the slot for a name in a stack frame, -1 if it doesn't have one */
+static int VariableSlot(Picoc *pc, struct StackFrame *Frame, const char *Ident)
+{
+    struct VariableSlotMap *SlotMap = Frame->SlotMap;
+    int Slot;
+
+    if (SlotMap == NULL)
+        return -1;
+
+    Slot = SlotMap->Index[VARIABLE_SLOT_HASH(pc, Ident, SlotMap->HashSize)];
+    if (Slot == VARIABLE_NO_SLOT || SlotMap->Name[Slot] != Ident)
+        return -1;
+
+    return Slot;
+}
+
+/* remember a newly defined local variable in its slot */
+static void VariableSlotSet(Picoc *pc, const char *Ident, struct Value *Val)
+{
+    int Slot;
+
+    if (pc->TopStackFrame != NULL && (Slot = VariableSlot(pc, pc->TopStackFrame, Ident)) >= 0)
+        pc->TopStackFrame->Slot[Slot] = Val;
+}
+
+/* look up a variable using its stack frame slot. returns FALSE if we have to search the tables instead */
+static int VariableSlotGet(Picoc *pc, const char *Ident, struct Value **LVal)
+{
+    int Slot;
+
+    if (pc->TopStackFrame == NULL || (Slot = VariableSlot(pc, pc->TopStackFrame, Ident)) < 0)
+        return FALSE;
+
+    *LVal = pc->TopStackFrame->Slot[Slot];
+    if (*LVal == NULL)
+    {
+        /* it's never been defined locally so it can only be a global */
+        if (!TableGet(&pc->GlobalTable, Ident, LVal, NULL, NULL, NULL))
+            *LVal = NULL;
+
+        return TRUE;
+    }
+
+    /* if it's gone out of scope a variable of the same name might be back in scope */
+    return !((*LVal)->Flags & FlagOutOfScope);
+}
+
 /* define a variable. Ident must be registered */
 struct Value *VariableDefine(Picoc *pc, struct ParseState *Parser, char *Ident, struct Value *InitValue, struct ValueType *Typ, int MakeWritable)
 {
     struct Value * AssignValue;
     struct Table * currentTable = (pc->TopStackFrame == NULL) ? &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
     
-    int16_t ScopeID = Parser ? Parser->ScopeID : -1;
 #ifdef VAR_SCOPE_DEBUG
-    if (Parser) fprintf(stderr, "def %s %x (%s:%d:%d)\n", Ident, ScopeID, Parser->FileName, Parser->Line, Parser->CharacterPos);
+    if (Parser) fprintf(stderr, "def %s %d (%s:%d:%d)\n", Ident, VariableCurrentScope(pc)->Depth, Parser->FileName, Parser->Line, Parser->CharacterPos);
 #endif
     
-    if (InitValue != NULL)
-        AssignValue = VariableAllocValueAndCopy(pc, Parser, InitValue, pc->TopStackFrame == NULL);
+    if (Parser != NULL && (AssignValue = VariableScopeRevive(pc, currentTable, Ident, (InitValue != NULL) ? InitValue->Typ : Typ, Parser->Pos)) != NULL)
+    {
+        /* it's the same declaration as last time the block was run */
+        if (InitValue != NULL)
+            memcpy((void *)AssignValue->Val, (void *)InitValue->Val, TypeSizeValue(InitValue, TRUE));
+    }
     else
-        AssignValue = VariableAllocValueFromType(pc, Parser, Typ, MakeWritable, NULL, pc->TopStackFrame == NULL);
+    {
+        if (InitValue != NULL)
+            AssignValue = VariableAllocValueAndCopy(pc, Parser, InitValue, pc->TopStackFrame == NULL);
+        else
+            AssignValue = VariableAllocValueFromType(pc, Parser, Typ, MakeWritable, NULL, pc->TopStackFrame == NULL);
+    
+        if (!TableSet(pc, currentTable, Ident, AssignValue, Parser ? ((char *)Parser->FileName) : NULL, Parser ? Parser->Line : 0, Parser ? Parser->CharacterPos : 0))
+            ProgramFail(Parser, "'%s' is already defined", Ident);
+
+        if (Parser != NULL)
+            VariableScopeDeclare(pc, currentTable, Ident, Parser->Pos);
+    }
     
     if (MakeWritable)
         AssignValue->Flags |= FlagIsLValue;
     else
         AssignValue->Flags &= ~FlagIsLValue;
-    AssignValue->ScopeID = ScopeID;
-    AssignValue->Flags &= ~FlagOutOfScope;
 
-    if (!TableSet(pc, currentTable, Ident, AssignValue, Parser ? ((char *)Parser->FileName) : NULL, Parser ? Parser->Line : 0, Parser ? Parser->CharacterPos : 0))
-        ProgramFail(Parser, "'%s' is already defined", Ident);
-    
+    VariableSlotSet(pc, Ident, AssignValue);
     return AssignValue;
 }
 
@@ -354,6 +437,8 @@ struct Value *VariableDefineButIgnoreIdentical(struct ParseState *Parser, char *
         char *MNPos = &MangledName[0];
         char *MNEnd = &MangledName[LINEBUFFER_MAX-1];
         const char *RegisteredMangledName;
+        struct Table *LocalTable = (pc->TopStackFrame == NULL) ? &pc->GlobalTable : &pc->TopStackFrame->LocalTable;
+        struct Value *MirrorValue;
         
         /* make the mangled static name (avoiding using sprintf() to minimise library impact) */
         memset((void *)&MangledName, '\0', sizeof(MangledName));
@@ -382,8 +467,16 @@ struct Value *VariableDefineButIgnoreIdentical(struct ParseState *Parser, char *
             *FirstVisit = TRUE;
         }
 
-        /* static variable exists in the global scope - now make a mirroring variable in our own scope with the short name */
-        VariableDefinePlatformVar(Parser->pc, Parser, Ident, ExistingValue->Typ, ExistingValue->Val, TRUE);
+        /* static variable exists in the global scope - now make a mirroring variable in our own scope with the short name.
+         * it goes out of scope with its block and comes back when the declaration is run again, like other locals */
+        if ((MirrorValue = VariableScopeRevive(pc, LocalTable, Ident, ExistingValue->Typ, Parser->Pos)) != NULL)
+            VariableSlotSet(pc, Ident, MirrorValue);
+        else
+        {
+            VariableDefinePlatformVar(Parser->pc, Parser, Ident, ExistingValue->Typ, ExistingValue->Val, TRUE);
+            VariableScopeDeclare(pc, LocalTable, Ident, Parser->Pos);
+        }
+        
         return ExistingValue;
     }
     else
@@ -415,6 +508,9 @@ int VariableDefined(Picoc *pc, const char *Ident)
 {
     struct Value *FoundValue;
     
+    if (VariableSlotGet(pc, Ident, &FoundValue))
+        return FoundValue != NULL;
+
     if (pc->TopStackFrame == NULL || !TableGet(&pc->TopStackFrame->LocalTable, Ident, &FoundValue, NULL, NULL, NULL))
     {
         if (!TableGet(&pc->GlobalTable, Ident, &FoundValue, NULL, NULL, NULL))
@@ -427,6 +523,9 @@ int VariableDefined(Picoc *pc, const char *Ident)
 /* get the value of a variable. must be defined. Ident must be registered */
 void VariableGet(Picoc *pc, struct ParseState *Parser, const char *Ident, struct Value **LVal)
 {
+    if (VariableSlotGet(pc, Ident, LVal) && *LVal != NULL)
+        return;
+
     if (pc->TopStackFrame == NULL || !TableGet(&pc->TopStackFrame->LocalTable, Ident, LVal, NULL, NULL, NULL))
     {
         if (!TableGet(&pc->GlobalTable, Ident, LVal, NULL, NULL, NULL))
@@ -439,6 +538,26 @@ void VariableGet(Picoc *pc, struct ParseState *Parser, const char *Ident, struct
     }
 }
 
+/* get the value of a name which can't change, like an enum constant or a macro. returns
+ * NULL if the name isn't defined or is a variable. Ident must be registered */
+struct Value *VariableGetConstant(Picoc *pc, const char *Ident)
+{
+    struct Value *FoundValue;
+    struct Value *GlobalValue;
+    
+    if (!TableGet(&pc->GlobalTable, Ident, &GlobalValue, NULL, NULL, NULL) || (GlobalValue->Flags & FlagIsLValue))
+        return NULL;
+    
+    /* a slot which has never been used locally gives the global */
+    if (VariableSlotGet(pc, Ident, &FoundValue))
+        return (FoundValue == GlobalValue) ? GlobalValue : NULL;
+    
+    if (pc->TopStackFrame != NULL && TableGet(&pc->TopStackFrame->LocalTable, Ident, &FoundValue, NULL, NULL, NULL))
+        return NULL;
+    
+    return GlobalValue;
+}
+
 /* define a global variable shared with a platform global. Ident will be registered */
 void VariableDefinePlatformVar(Picoc *pc, struct ParseState *Parser, char *Ident, struct ValueType *Typ, union AnyValue *FromValue, int IsWritable)
 {
@@ -446,8 +565,11 @@ void VariableDefinePlatformVar(Picoc *pc, struct ParseState *Parser, char *Ident
     SomeValue->Typ = Typ;
     SomeValue->Val = FromValue;
     
-    if (!TableSet(pc, (pc->TopStackFrame == NULL) ? &pc->GlobalTable : &pc->TopStackFrame->LocalTable, TableStrRegister(pc, Ident), SomeValue, Parser ? Parser->FileName : NULL, Parser ? Parser->Line : 0, Parser ? Parser->CharacterPos : 0))
+    Ident = TableStrRegister(pc, Ident);
+    if (!TableSet(pc, (pc->TopStackFrame == NULL) ? &pc->GlobalTable : &pc->TopStackFrame->LocalTable, Ident, SomeValue, Parser ? Parser->FileName : NULL, Parser ? Parser->Line : 0, Parser ? Parser->CharacterPos : 0))
         ProgramFail(Parser, "'%s' is already defined", Ident);
+
+    VariableSlotSet(pc, Ident, SomeValue);
 }
 
 /* free and/or pop the top value off the stack. Var must be the top value on the stack! */
@@ -489,9 +611,106 @@ void VariableStackFrameAdd(struct ParseState *Parser, const char *FuncName, int
     ParserCopy(&NewFrame->ReturnParser, Parser);
     NewFrame->FuncName = FuncName;
     NewFrame->Parameter = (NumParams > 0) ? ((void *)((char *)NewFrame + sizeof(struct StackFrame))) : NULL;
-    TableInitTable(&NewFrame->LocalTable, &NewFrame->LocalHashTable[0], LOCAL_TABLE_SIZE, FALSE);
+    TableInitTable(Parser->pc, &NewFrame->LocalTable, &NewFrame->LocalHashTable[0], LOCAL_TABLE_SIZE, FALSE);
     NewFrame->PreviousStackFrame = Parser->pc->TopStackFrame;
     Parser->pc->TopStackFrame = NewFrame;
+#ifndef NO_PROFILER
+    NewFrame->ProfileNode = NULL;
+    if (Parser->pc->Profiling)
+        ProfileCall(Parser->pc, NewFrame);
+#endif
+}
+
+/* give the current stack frame a slot for each name in a function's slot map */
+void VariableStackFrameSlots(struct ParseState *Parser, struct VariableSlotMap *SlotMap)
+{
+    struct StackFrame *Frame = Parser->pc->TopStackFrame;
+
+    Frame->Slot = HeapAllocStack(Parser->pc, sizeof(struct Value *) * SlotMap->NumSlots);
+    if (Frame->Slot == NULL)
+        ProgramFail(Parser, "out of memory");
+
+    Frame->SlotMap = SlotMap;
+}
+
+/* work out a stack frame slot for each name used in a function body so they can be
+ * found without searching the local variable table. returns NULL if there are too many */
+struct VariableSlotMap *VariableSlotMapCreate(Picoc *pc, struct FuncDef *Def)
+{
+    const char *Name[VARIABLE_SLOTS_MAX];
+    struct VariableSlotMap *SlotMap;
+    struct ParseState Parser;
+    struct Value *LexValue;
+    enum LexToken Token;
+    enum LexToken LastToken = TokenNone;
+    int NumSlots = 0;
+    int HashSize;
+    int Count;
+
+    for (Count = 0; Count < Def->NumParams; Count++)
+        Name[NumSlots++] = Def->ParamName[Count];
+
+    /* collect the identifiers in the body, apart from struct members */
+    ParserCopy(&Parser, Def->Body);
+    while ((Token = LexGetRawToken(&Parser, &LexValue, TRUE)) != TokenEndOfFunction && Token != TokenEOF)
+    {
+        if (Token == TokenIdentifier && LastToken != TokenDot && LastToken != TokenArrow)
+        {
+            for (Count = 0; Count < NumSlots && Name[Count] != LexValue->Val->Identifier; Count++)
+            {}
+
+            if (Count == NumSlots)
+            {
+                if (NumSlots == VARIABLE_SLOTS_MAX)
+                    return NULL;
+
+                Name[NumSlots++] = LexValue->Val->Identifier;
+            }
+        }
+
+        LastToken = Token;
+    }
+
+    if (NumSlots == 0)
+        return NULL;
+
+    /* find a hash size where none of the names collide */
+    for (HashSize = NumSlots | 1; HashSize < NumSlots * 16; HashSize += 2)
+    {
+        for (Count = 1; Count < NumSlots; Count++)
+        {
+            int Other;
+
+            for (Other = 0; Other < Count && VARIABLE_SLOT_HASH(pc, Name[Other], HashSize) != VARIABLE_SLOT_HASH(pc, Name[Count], HashSize); Other++)
+            {}
+
+            if (Other < Count)
+                break;
+        }
+
+        if (Count == NumSlots)
+            break;
+    }
+
+    if (HashSize >= NumSlots * 16)
+        return NULL;
+
+    SlotMap = HeapAllocMem(pc, sizeof(struct VariableSlotMap) + sizeof(const char *) * NumSlots + HashSize);
+    if (SlotMap == NULL)
+        return NULL;
+
+    SlotMap->NumSlots = NumSlots;
+    SlotMap->HashSize = HashSize;
+    SlotMap->Name = (const char **)((char *)SlotMap + sizeof(struct VariableSlotMap));
+    SlotMap->Index = (unsigned char *)((char *)SlotMap->Name + sizeof(const char *) * NumSlots);
+    memset((void *)SlotMap->Index, VARIABLE_NO_SLOT, HashSize);
+    for (Count = 0; Count < NumSlots; Count++)
+    {
+        SlotMap->Name[Count] = Name[Count];
+        SlotMap->Index[VARIABLE_SLOT_HASH(pc, Name[Count], HashSize)] = Count;
+    }
+
+    return SlotMap;
 }
 
 /* remove a stack frame */
@@ -501,6 +720,7 @@ void VariableStackFramePop(struct ParseState *Parser)
         ProgramFail(Parser, "stack is empty - can't go back");
         
     ParserCopy(Parser, &Parser->pc->TopStackFrame->ReturnParser);
+    TableFree(Parser->pc, &Parser->pc->TopStackFrame->LocalTable);
     Parser->pc->TopStackFrame = Parser->pc->TopStackFrame->PreviousStackFrame;
     HeapPopStackFrame(Parser->pc);
 }